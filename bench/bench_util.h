@@ -0,0 +1,148 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "clock.h"
+#include "impairment_proxy.h"
+#include "udp_client.h"
+#include "udp_server.h"
+
+// 各基准共用的工具：参数解析、计时、文件读写、百分位数，
+// 以及在同一进程内经回环完成一次请求的夹具
+namespace safe_udp {
+namespace bench {
+// 解析逗号分隔的列表
+inline std::vector<std::string> SplitList(const char *arg) {
+  std::vector<std::string> values;
+  std::stringstream stream(arg);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    values.push_back(item);
+  }
+  return values;
+}
+
+inline std::vector<int> ParseIntList(const char *arg) {
+  std::vector<int> values;
+  for (const std::string &item : SplitList(arg)) {
+    values.push_back(atoi(item.c_str()));
+  }
+  return values;
+}
+
+inline std::vector<double> ParseDoubleList(const char *arg) {
+  std::vector<double> values;
+  for (const std::string &item : SplitList(arg)) {
+    values.push_back(atof(item.c_str()));
+  }
+  return values;
+}
+
+inline double NowSeconds() {
+  struct timeval time;
+  gettimeofday(&time, NULL);
+  return time.tv_sec + time.tv_usec / 1e6;
+}
+
+// 本进程累计的用户态与内核态 CPU 时间（秒）
+inline double CpuSeconds() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+inline std::string ReadFile(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(file),
+                     std::istreambuf_iterator<char>());
+}
+
+inline void WriteFile(const std::string &path, const std::string &content) {
+  std::ofstream file(path, std::ios::binary);
+  file.write(content.data(), content.size());
+}
+
+// 指定长度的随机内容，由调用者的生成器决定，便于复现
+inline std::string RandomContent(int size, std::mt19937 *generator) {
+  std::string content(size, '\0');
+  for (char &c : content) {
+    c = static_cast<char>((*generator)());
+  }
+  return content;
+}
+
+// 第 p 百分位（最近秩），没有样本时返回 0
+inline double Percentile(std::vector<double> values, double p) {
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  size_t index = static_cast<size_t>(p / 100.0 * (values.size() - 1) + 0.5);
+  return values[std::min(index, values.size() - 1)];
+}
+
+// 进程内的一次请求：server 与 client 由调用者创建并设置好窗口、分段大小、密钥等参数，
+// 这里绑定端口，在后台线程中应答请求并由 client 下载 name。服务端打开 server_dir 下
+// 同名的文件（server_dir 以 '/' 结尾），打包请求时打开整个目录。
+// impairment 不为空时在两者之间插入损伤代理，两个方向使用同样的配置。
+// 返回从发出请求到下载结束的时间（微秒，不含服务端线程退出），client 未完成下载时返回 -1
+inline int64_t RunRequest(UdpServer *server, UdpClient *client,
+                          const std::string &server_dir, const std::string &name,
+                          const ImpairmentConfig *impairment = nullptr,
+                          uint64_t proxy_seed = 1) {
+  int server_fd = server->StartServer(0);
+  struct sockaddr_in address;
+  socklen_t address_length = sizeof(address);
+  getsockname(server_fd, (struct sockaddr *)&address, &address_length);
+  int port = ntohs(address.sin_port);
+
+  std::unique_ptr<ImpairmentProxy> proxy;
+  std::thread proxy_thread;
+  if (impairment != nullptr) {
+    proxy = std::make_unique<ImpairmentProxy>("127.0.0.1", port, proxy_seed);
+    proxy->to_server_ = *impairment;
+    proxy->to_client_ = *impairment;
+    port = proxy->Start(0);
+    ImpairmentProxy *running = proxy.get();
+    proxy_thread = std::thread([running]() { running->Run(); });
+  }
+
+  std::thread server_thread([server, server_fd, server_dir]() {
+    char *request = server->GetRequest(server_fd);
+    bool opened = server->is_bundle_request() ? server->OpenBundle(server_dir)
+                                              : server->OpenFile(server_dir + request);
+    free(request);
+    if (opened) {
+      server->StartFileTransfer();
+    } else {
+      server->SendError();
+    }
+  });
+
+  client->CreateSocketAndServerConnection("127.0.0.1", std::to_string(port));
+  int64_t start = NowMicros();
+  client->SendFileRequest(name);
+  int64_t elapsed = NowMicros() - start;
+  server_thread.join();
+  if (proxy) {
+    proxy->Stop();
+    proxy_thread.join();
+  }
+  return client->status() == DownloadStatus::COMPLETED ? elapsed : -1;
+}
+}  // namespace bench
+}  // namespace safe_udp
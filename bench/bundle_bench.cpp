@@ -0,0 +1,170 @@
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "bench_util.h"
+
+// 小文件打包基准：同一进程内经回环传输一批小文件，对比逐个请求（每个文件一次
+// 请求/握手/慢启动）、打包传输（一次请求一个归档流）与传输一个同样总大小的大文件的吞吐。
+// 用法: bundle_bench [--files 1000] [--file-size 4096] [--window 64] [--json]
+namespace {
+struct BenchConfig {
+  int files = 1000;
+  int file_size = 4096;
+  int window = 64;
+  bool json = false;
+};
+
+// 一次请求，返回客户端从发出请求到下载完成的时间（微秒）。下载失败、摘要校验未通过，
+// 或打包请求解出的文件数与服务端目录中的不一致时返回 -1
+int64_t run_request(const BenchConfig &config, const std::string &server_dir,
+                    const std::string &client_dir, const std::string &name,
+                    bool bundle) {
+  std::unique_ptr<safe_udp::UdpServer> server = std::make_unique<safe_udp::UdpServer>();
+  server->rwnd_ = config.window;
+
+  std::unique_ptr<safe_udp::UdpClient> client = std::make_unique<safe_udp::UdpClient>();
+  client->receiver_window_ = config.window;
+  client->output_dir_ = client_dir;
+  client->bundle_ = bundle;
+
+  int64_t elapsed =
+      safe_udp::bench::RunRequest(server.get(), client.get(), server_dir, name);
+  if (elapsed < 0 || !client->digest_verified() ||
+      (bundle && client->bundle_files() != config.files)) {
+    return -1;
+  }
+  return elapsed;
+}
+
+// 目录中的普通文件数，用于确认没有解出多余的文件
+int count_files(const std::string &directory) {
+  DIR *dir = opendir(directory.c_str());
+  if (dir == nullptr) {
+    return -1;
+  }
+  int count = 0;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != nullptr) {
+    if (entry->d_type == DT_REG) {
+      count++;
+    }
+  }
+  closedir(dir);
+  return count;
+}
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  FLAGS_minloglevel = google::GLOG_WARNING;
+
+  BenchConfig config;
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    bool has_value = i + 1 < argc;
+    if (arg == "--files" && has_value) {
+      config.files = atoi(argv[++i]);
+    } else if (arg == "--file-size" && has_value) {
+      config.file_size = atoi(argv[++i]);
+    } else if (arg == "--window" && has_value) {
+      config.window = atoi(argv[++i]);
+    } else if (arg == "--json") {
+      config.json = true;
+    } else {
+      fprintf(stderr, "Usage: %s [--files n] [--file-size n] [--window n] [--json]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  char dir_template[] = "/tmp/safe_udp_bundle.XXXXXX";
+  if (mkdtemp(dir_template) == nullptr) {
+    LOG(ERROR) << "Failed to create work directory";
+    return 1;
+  }
+  std::string work_dir(dir_template);
+  std::string server_dir = work_dir + "/server_files/";
+  mkdir(server_dir.c_str(), 0755);
+  mkdir((server_dir + "small").c_str(), 0755);
+
+  std::mt19937 generator(42);
+  std::vector<std::string> names;
+  std::vector<std::string> contents;
+  std::string all;
+  for (int i = 0; i < config.files; i++) {
+    std::string content = safe_udp::bench::RandomContent(config.file_size, &generator);
+    names.push_back("small/" + std::to_string(i) + ".bin");
+    safe_udp::bench::WriteFile(server_dir + names.back(), content);
+    contents.push_back(content);
+    all += content;
+  }
+  safe_udp::bench::WriteFile(server_dir + "large.bin", all);
+  int64_t total_bytes = all.size();
+
+  if (!config.json) {
+    printf("%-10s %7s %10s %9s %9s %6s\n", "mode", "files", "bytes", "time(s)",
+           "MB/s", "failed");
+  }
+  bool all_ok = true;
+  for (const std::string mode : {"per-file", "bundle", "single"}) {
+    std::string client_dir = work_dir + "/client_" + mode + "/";
+    mkdir(client_dir.c_str(), 0755);
+    mkdir((client_dir + "small").c_str(), 0755);
+
+    std::vector<std::pair<std::string, bool>> requests;
+    if (mode == "per-file") {
+      for (const std::string &name : names) {
+        requests.emplace_back(name, false);
+      }
+    } else if (mode == "bundle") {
+      requests.emplace_back("small/*", true);
+    } else {
+      requests.emplace_back("large.bin", false);
+    }
+    int failed = 0;
+    int64_t elapsed_us = 0;
+    for (const auto &request : requests) {
+      int64_t elapsed =
+          run_request(config, server_dir, client_dir, request.first, request.second);
+      if (elapsed < 0) {
+        failed++;
+      } else {
+        elapsed_us += elapsed;
+      }
+    }
+    double seconds = elapsed_us / 1e6;
+
+    // 逐个比对输出内容，并确认输出目录中没有多余的文件
+    if (mode == "single") {
+      failed += safe_udp::bench::ReadFile(client_dir + "large.bin") == all ? 0 : 1;
+    } else {
+      for (int i = 0; i < config.files; i++) {
+        failed += safe_udp::bench::ReadFile(client_dir + names[i]) == contents[i] ? 0 : 1;
+      }
+      failed += count_files(client_dir + "small") == config.files ? 0 : 1;
+    }
+    all_ok = all_ok && failed == 0;
+    double rate = seconds > 0 ? total_bytes / seconds / 1e6 : 0;
+    int files = mode == "single" ? 1 : config.files;
+    if (config.json) {
+      printf("{\"mode\":\"%s\",\"files\":%d,\"bytes\":%lld,\"seconds\":%.3f,"
+             "\"mb_per_s\":%.2f,\"failed\":%d}\n",
+             mode.c_str(), files, (long long)total_bytes, seconds, rate, failed);
+    } else {
+      printf("%-10s %7d %10lld %9.3f %9.2f %6d\n", mode.c_str(), files,
+             (long long)total_bytes, seconds, rate, failed);
+    }
+    fflush(stdout);
+  }
+  return all_ok ? 0 : 1;
+}
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "bench_util.h"
+#include "simulator.h"
+
+// 多租户公平性基准：在模拟的共享瓶颈上同时运行大小不同的多个下载，
+// 分别在不使用发送调度器与使用 DRR 调度器（出口速率等于瓶颈带宽）时，
+// 输出竞争期间按权重归一化份额的 Jain 公平性指数、聚合吞吐与大/小文件的平均完成时间。
+// 文件大小、权重与单客户端限速按流的序号轮流取值。
+// 用法: fairness_bench [--bandwidth-mbps 100] [--rtt-ms 10] [--queue 100]
+//                      [--flows 8] [--file-sizes 262144,4194304] [--weights 1]
+//                      [--rate-cap-mbps 0] [--window 256] [--loss 0] [--seed 1]
+//                      [--json]
+namespace {
+struct BenchConfig {
+  double bandwidth_mbps = 100;
+  double rtt_ms = 10;
+  int queue = 100;
+  int flows = 8;
+  std::vector<double> file_sizes = {256 * 1024, 4 * 1024 * 1024};
+  std::vector<double> weights = {1};
+  std::vector<double> rate_caps_mbps = {0};
+  int window = 256;
+  double loss_percent = 0;
+  uint64_t seed = 1;
+  bool json = false;
+};
+
+// 最小文件与其余文件各自的平均完成时间（毫秒）
+void completion_times(const safe_udp::ScenarioResult &result, double *small_ms,
+                      double *large_ms) {
+  int64_t smallest = 0;
+  for (const safe_udp::FlowResult &flow : result.flows) {
+    if (smallest == 0 || flow.file_bytes < smallest) {
+      smallest = flow.file_bytes;
+    }
+  }
+  double small_sum = 0, large_sum = 0;
+  int small_count = 0, large_count = 0;
+  for (const safe_udp::FlowResult &flow : result.flows) {
+    double elapsed = (flow.finish_us - flow.start_us) / 1000.0;
+    if (flow.file_bytes == smallest) {
+      small_sum += elapsed;
+      small_count++;
+    } else {
+      large_sum += elapsed;
+      large_count++;
+    }
+  }
+  *small_ms = small_count > 0 ? small_sum / small_count : 0;
+  *large_ms = large_count > 0 ? large_sum / large_count : 0;
+}
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  FLAGS_minloglevel = google::GLOG_WARNING;
+
+  BenchConfig config;
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    bool has_value = i + 1 < argc;
+    if (arg == "--bandwidth-mbps" && has_value) {
+      config.bandwidth_mbps = atof(argv[++i]);
+    } else if (arg == "--rtt-ms" && has_value) {
+      config.rtt_ms = atof(argv[++i]);
+    } else if (arg == "--queue" && has_value) {
+      config.queue = atoi(argv[++i]);
+    } else if (arg == "--flows" && has_value) {
+      config.flows = atoi(argv[++i]);
+    } else if (arg == "--file-sizes" && has_value) {
+      config.file_sizes = safe_udp::bench::ParseDoubleList(argv[++i]);
+    } else if (arg == "--weights" && has_value) {
+      config.weights = safe_udp::bench::ParseDoubleList(argv[++i]);
+    } else if (arg == "--rate-cap-mbps" && has_value) {
+      config.rate_caps_mbps = safe_udp::bench::ParseDoubleList(argv[++i]);
+    } else if (arg == "--window" && has_value) {
+      config.window = atoi(argv[++i]);
+    } else if (arg == "--loss" && has_value) {
+      config.loss_percent = atof(argv[++i]);
+    } else if (arg == "--seed" && has_value) {
+      config.seed = strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--json") {
+      config.json = true;
+    } else {
+      fprintf(stderr,
+              "Usage: %s [--bandwidth-mbps x] [--rtt-ms x] [--queue n] [--flows n] "
+              "[--file-sizes a,b] [--weights a,b] [--rate-cap-mbps a,b] [--window n] "
+              "[--loss x] [--seed n] [--json]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  if (config.file_sizes.empty() || config.weights.empty() ||
+      config.rate_caps_mbps.empty()) {
+    LOG(ERROR) << "Empty list argument";
+    return 1;
+  }
+
+  char dir_template[] = "/tmp/safe_udp_fairness.XXXXXX";
+  if (mkdtemp(dir_template) == nullptr) {
+    LOG(ERROR) << "Failed to create work directory";
+    return 1;
+  }
+
+  safe_udp::ScenarioConfig scenario;
+  scenario.forward.bandwidth_bps = static_cast<int64_t>(config.bandwidth_mbps * 1e6);
+  scenario.forward.delay_us = static_cast<int64_t>(config.rtt_ms * 1000 / 2);
+  scenario.forward.queue_packets = config.queue;
+  scenario.forward.loss_rate = config.loss_percent / 100;
+  scenario.reverse = scenario.forward;
+  scenario.reverse.queue_packets = std::max(config.queue, 1000);
+  scenario.flows = config.flows;
+  scenario.window = config.window;
+  scenario.seed = config.seed;
+  scenario.work_dir = dir_template;
+  size_t variants = std::max(config.file_sizes.size(),
+                             std::max(config.weights.size(), config.rate_caps_mbps.size()));
+  for (size_t i = 0; i < variants; i++) {
+    safe_udp::FlowConfig flow;
+    flow.file_bytes = static_cast<int64_t>(config.file_sizes[i % config.file_sizes.size()]);
+    flow.weight = static_cast<int>(config.weights[i % config.weights.size()]);
+    flow.rate_limit_bps = static_cast<int64_t>(
+        config.rate_caps_mbps[i % config.rate_caps_mbps.size()] * 1e6);
+    scenario.flow_configs.push_back(flow);
+  }
+
+  if (!config.json) {
+    printf("%-10s %7s %9s %10s %9s %9s %7s %8s %7s\n", "scheduler", "jain",
+           "jain(all)", "tput(Mbps)", "small(ms)", "large(ms)", "rexmit", "qdrops",
+           "wall(s)");
+  }
+  bool all_completed = true;
+  for (bool use_scheduler : {false, true}) {
+    scenario.transmit_scheduler = use_scheduler;
+    scenario.scheduler_rate_bps = scenario.forward.bandwidth_bps;
+
+    double wall_start = safe_udp::bench::NowSeconds();
+    safe_udp::ScenarioResult result = safe_udp::RunScenario(scenario);
+    double wall = safe_udp::bench::NowSeconds() - wall_start;
+
+    int64_t retransmits = 0;
+    bool completed = true;
+    for (const safe_udp::FlowResult &flow : result.flows) {
+      retransmits += flow.retransmits;
+      completed = completed && flow.completed && flow.verified;
+    }
+    all_completed = all_completed && completed;
+    double throughput =
+        result.utilization * scenario.forward.bandwidth_bps / 1e6;
+    double small_ms, large_ms;
+    completion_times(result, &small_ms, &large_ms);
+
+    const char *mode = use_scheduler ? "drr" : "none";
+    if (config.json) {
+      printf("{\"scheduler\":\"%s\",\"flows\":%d,\"contended_fairness\":%.4f,"
+             "\"fairness\":%.4f,\"throughput_mbps\":%.3f,\"small_ms\":%.1f,"
+             "\"large_ms\":%.1f,\"retransmits\":%lld,\"queue_drops\":%lld,"
+             "\"completed\":%s,\"wall_s\":%.3f}\n",
+             mode, scenario.flows, result.contended_fairness, result.fairness,
+             throughput, small_ms, large_ms, (long long)retransmits,
+             (long long)result.forward.dropped_queue, completed ? "true" : "false",
+             wall);
+    } else {
+      printf("%-10s %7.3f %9.3f %10.3f %9.1f %9.1f %7lld %8lld %7.2f%s\n", mode,
+             result.contended_fairness, result.fairness, throughput, small_ms,
+             large_ms, (long long)retransmits,
+             (long long)result.forward.dropped_queue, wall,
+             completed ? "" : "  INCOMPLETE");
+    }
+    fflush(stdout);
+  }
+  return all_completed ? 0 : 1;
+}
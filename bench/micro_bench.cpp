@@ -0,0 +1,181 @@
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "data_segment.h"
+#include "file_digest.h"
+#include "segment_cipher.h"
+#include "sliding_window.h"
+#include "udp_client.h"
+
+namespace safe_udp {
+// 访问 UdpClient 私有的重组逻辑
+class UdpClientBenchmarkAccess {
+ public:
+  static void Insert(UdpClient *client, int index, const DataSegment &segment) {
+    client->insert(index, segment);
+  }
+  static void Reset(UdpClient *client) {
+    client->data_segments_.clear();
+    client->last_packet_received_ = -1;
+    client->last_in_order_packet_ = -1;
+  }
+};
+}  // namespace safe_udp
+
+namespace {
+void BM_SerializeToCharArray(benchmark::State &state) {
+  std::vector<char> payload(state.range(0), 'x');
+  for (auto _ : state) {
+    safe_udp::DataSegment segment;
+    segment.seq_number_ = 67;
+    segment.ack_number_ = 0;
+    segment.ack_flag_ = false;
+    segment.fin_flag_ = false;
+    segment.length_ = payload.size();
+    segment.data_ = payload.data();
+    benchmark::DoNotOptimize(segment.SerializeToCharArray());
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SerializeToCharArray)
+    ->Arg(0)
+    ->Arg(safe_udp::MAX_DATA_SIZE)
+    ->Arg(safe_udp::MAX_NEGOTIABLE_PACKET_SIZE - safe_udp::HEADER_LENGTH);
+
+void BM_DeserializeToDataSegment(benchmark::State &state) {
+  std::vector<char> payload(state.range(0), 'x');
+  safe_udp::DataSegment source;
+  source.seq_number_ = 67;
+  source.ack_number_ = 0;
+  source.ack_flag_ = false;
+  source.fin_flag_ = false;
+  source.length_ = payload.size();
+  source.data_ = payload.data();
+  std::vector<unsigned char> datagram(source.PacketSize());
+  memcpy(datagram.data(), source.SerializeToCharArray(), datagram.size());
+
+  for (auto _ : state) {
+    safe_udp::DataSegment segment;
+    segment.DeserializeToDataSegment(datagram.data(), datagram.size());
+    benchmark::DoNotOptimize(segment.data_);
+    free(segment.data_);  // DataSegment 不负责释放 data_
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_DeserializeToDataSegment)
+    ->Arg(0)
+    ->Arg(safe_udp::MAX_DATA_SIZE)
+    ->Arg(safe_udp::MAX_NEGOTIABLE_PACKET_SIZE - safe_udp::HEADER_LENGTH);
+
+// 发送一个文件所需的窗口缓冲区追加
+void BM_SlidingWindowAddToBuffer(benchmark::State &state) {
+  for (auto _ : state) {
+    safe_udp::SlidingWindow window;
+    for (int i = 0; i < state.range(0); i++) {
+      safe_udp::SlidWinBuffer buffer;
+      buffer.first_byte_ = i * safe_udp::MAX_DATA_SIZE;
+      buffer.data_length_ = safe_udp::MAX_DATA_SIZE;
+      buffer.seq_num_ = 67 + buffer.first_byte_;
+      window.last_packet_sent_ = window.AddToBuffer(buffer);
+    }
+    benchmark::DoNotOptimize(window.last_packet_sent_);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SlidingWindowAddToBuffer)->Arg(1024)->Arg(16384);
+
+// 重组：range(1) 为 0 时按序到达，否则每 range(1) 个分段整体倒序到达
+void BM_ClientReassemblyInsert(benchmark::State &state) {
+  int segment_count = state.range(0);
+  int reorder_span = state.range(1);
+  std::vector<int> order(segment_count);
+  for (int i = 0; i < segment_count; i++) {
+    order[i] = i;
+  }
+  if (reorder_span > 1) {
+    for (int i = 0; i + reorder_span <= segment_count; i += reorder_span) {
+      std::reverse(order.begin() + i, order.begin() + i + reorder_span);
+    }
+  }
+
+  char payload[safe_udp::MAX_DATA_SIZE] = {0};
+  safe_udp::UdpClient client;
+  for (auto _ : state) {
+    safe_udp::UdpClientBenchmarkAccess::Reset(&client);
+    for (int index : order) {
+      safe_udp::DataSegment segment;
+      segment.seq_number_ = 67 + index * safe_udp::MAX_DATA_SIZE;
+      segment.length_ = safe_udp::MAX_DATA_SIZE;
+      segment.data_ = payload;
+      safe_udp::UdpClientBenchmarkAccess::Insert(&client, index, segment);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * segment_count);
+}
+BENCHMARK(BM_ClientReassemblyInsert)
+    ->Args({4096, 0})
+    ->Args({4096, 8})
+    ->Args({4096, 64});
+
+// 摘要按分段大小逐段输入，与发送端、接收端的调用方式一致
+void BM_FileDigestUpdate(benchmark::State &state) {
+  std::vector<char> data(1 << 20, 'x');
+  int chunk = state.range(0);
+  for (auto _ : state) {
+    safe_udp::FileDigest digest;
+    for (size_t offset = 0; offset < data.size(); offset += chunk) {
+      digest.Update(data.data() + offset, std::min<size_t>(chunk, data.size() - offset));
+    }
+    benchmark::DoNotOptimize(digest.Value());
+  }
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_FileDigestUpdate)
+    ->Arg(safe_udp::MAX_DATA_SIZE)
+    ->Arg(safe_udp::MAX_NEGOTIABLE_PACKET_SIZE - safe_udp::HEADER_LENGTH);
+
+// 单个数据段的加密与校验解密（含每段重设 nonce 的开销）
+void BM_SegmentCipher(benchmark::State &state) {
+  std::unique_ptr<safe_udp::SegmentCipher> cipher = safe_udp::SegmentCipher::Create(
+      std::string(safe_udp::PRE_SHARED_KEY_MIN_LENGTH, 'k'),
+      std::string(safe_udp::KEY_NONCE_LENGTH, 'c'), std::string(safe_udp::KEY_NONCE_LENGTH, 's'));
+  if (!cipher) {
+    state.SkipWithError("built without encryption support");
+    return;
+  }
+  int data_length = state.range(0);
+  bool open = state.range(1) != 0;
+  std::vector<char> packet(safe_udp::HEADER_LENGTH + data_length + safe_udp::GCM_TAG_LENGTH, 'x');
+  safe_udp::DataSegment header;
+  header.seq_number_ = 67;
+  header.ack_number_ = 0;
+  header.ack_flag_ = false;
+  header.fin_flag_ = false;
+  header.length_ = data_length;
+  header.SerializeHeader(packet.data());
+  std::vector<char> sealed = packet;
+  cipher->Seal(sealed.data(), data_length);
+  for (auto _ : state) {
+    if (open) {
+      memcpy(packet.data(), sealed.data(), packet.size());
+      benchmark::DoNotOptimize(cipher->Open(packet.data(), data_length));
+    } else {
+      benchmark::DoNotOptimize(cipher->Seal(packet.data(), data_length));
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * data_length);
+}
+BENCHMARK(BM_SegmentCipher)
+    ->Args({safe_udp::MAX_DATA_SIZE - safe_udp::GCM_TAG_LENGTH, 0})
+    ->Args({safe_udp::MAX_DATA_SIZE - safe_udp::GCM_TAG_LENGTH, 1})
+    ->Args({safe_udp::MAX_NEGOTIABLE_PACKET_SIZE - safe_udp::HEADER_LENGTH -
+                safe_udp::GCM_TAG_LENGTH, 0});
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,204 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "bench_util.h"
+#include "simulator.h"
+
+// 离散事件模拟扫描：在虚拟时间中运行真实的服务端/客户端状态机，
+// 遍历瓶颈带宽、RTT、队列长度、丢包率与并发流数，输出吞吐、链路利用率与 Jain 公平性。
+// 同时作为门禁使用：任一场景有流未完成或输出文件不一致、利用率低于可达上限
+// （带宽、窗口/RTT 与丢包下的稳态吞吐中的最小值）的 --min-utilization 倍、
+// 多流时 Jain 指数低于 --min-fairness，或多余重传（超出瓶颈上实际丢弃的数据包）
+// 多于 --max-spurious 个时，以非零状态退出。
+// --warm-cache 时每个场景先运行一次填充路径参数缓存，输出的是第二次运行的结果。
+// 用法: sim_bench [--bandwidth-mbps 10,100] [--rtt-ms 10,50] [--queue 50,200]
+//                 [--loss 0,1] [--flows 1,4] [--file-size 4194304] [--window 64]
+//                 [--packet-size 1472] [--initial-window 10] [--seed 1]
+//                 [--min-utilization 0.4] [--min-fairness 0.8] [--max-spurious 5]
+//                 [--warm-cache] [--json]
+namespace {
+struct BenchConfig {
+  std::vector<double> bandwidths_mbps = {10, 100};
+  std::vector<double> rtts_ms = {10, 50};
+  std::vector<double> queues = {50, 200};
+  std::vector<double> loss_percents = {0, 1};
+  std::vector<double> flow_counts = {1, 4};
+  int64_t file_bytes = 4 * 1024 * 1024;
+  int window = 64;
+  int packet_size = 0;
+  int initial_window = 0;
+  uint64_t seed = 1;
+  // 门禁阈值：利用率相对于场景可达上限的比例、多流时的 Jain 指数与允许的多余重传数
+  double min_utilization = 0.4;
+  double min_fairness = 0.8;
+  int max_spurious_retransmits = 5;
+  bool warm_cache = false;
+  bool json = false;
+};
+
+// 场景可达的链路利用率上限：瓶颈带宽、每流窗口每个 RTT 能发出的数据量
+// 与丢包下 AIMD 的稳态吞吐（Mathis: MSS/RTT * sqrt(3/2) / sqrt(p)）三者取最小
+double expected_utilization(const safe_udp::ScenarioConfig &scenario, int window) {
+  double packet_bits =
+      8.0 * (scenario.packet_size > 0 ? scenario.packet_size : safe_udp::MAX_PACKET_SIZE);
+  double rtt_s = 2 * scenario.forward.delay_us / 1e6;
+  double bandwidth = static_cast<double>(scenario.forward.bandwidth_bps);
+  double limit = bandwidth;
+  if (rtt_s > 0) {
+    limit = std::min(limit, scenario.flows * window * packet_bits / rtt_s);
+    if (scenario.forward.loss_rate > 0) {
+      limit = std::min(limit, scenario.flows * packet_bits / rtt_s * sqrt(1.5) /
+                                  sqrt(scenario.forward.loss_rate));
+    }
+  }
+  return limit / bandwidth;
+}
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  FLAGS_minloglevel = google::GLOG_WARNING;
+
+  BenchConfig config;
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    bool has_value = i + 1 < argc;
+    if (arg == "--bandwidth-mbps" && has_value) {
+      config.bandwidths_mbps = safe_udp::bench::ParseDoubleList(argv[++i]);
+    } else if (arg == "--rtt-ms" && has_value) {
+      config.rtts_ms = safe_udp::bench::ParseDoubleList(argv[++i]);
+    } else if (arg == "--queue" && has_value) {
+      config.queues = safe_udp::bench::ParseDoubleList(argv[++i]);
+    } else if (arg == "--loss" && has_value) {
+      config.loss_percents = safe_udp::bench::ParseDoubleList(argv[++i]);
+    } else if (arg == "--flows" && has_value) {
+      config.flow_counts = safe_udp::bench::ParseDoubleList(argv[++i]);
+    } else if (arg == "--file-size" && has_value) {
+      config.file_bytes = atoll(argv[++i]);
+    } else if (arg == "--window" && has_value) {
+      config.window = atoi(argv[++i]);
+    } else if (arg == "--packet-size" && has_value) {
+      config.packet_size = atoi(argv[++i]);
+    } else if (arg == "--initial-window" && has_value) {
+      config.initial_window = atoi(argv[++i]);
+    } else if (arg == "--seed" && has_value) {
+      config.seed = strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--min-utilization" && has_value) {
+      config.min_utilization = atof(argv[++i]);
+    } else if (arg == "--min-fairness" && has_value) {
+      config.min_fairness = atof(argv[++i]);
+    } else if (arg == "--max-spurious" && has_value) {
+      config.max_spurious_retransmits = atoi(argv[++i]);
+    } else if (arg == "--warm-cache") {
+      config.warm_cache = true;
+    } else if (arg == "--json") {
+      config.json = true;
+    } else {
+      fprintf(stderr,
+              "Usage: %s [--bandwidth-mbps a,b] [--rtt-ms a,b] [--queue a,b] "
+              "[--loss a,b] [--flows a,b] [--file-size n] [--window n] "
+              "[--packet-size n] [--initial-window n] [--seed n] [--min-utilization x] "
+              "[--min-fairness x] [--max-spurious n] [--warm-cache] [--json]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  char dir_template[] = "/tmp/safe_udp_sim.XXXXXX";
+  if (mkdtemp(dir_template) == nullptr) {
+    LOG(ERROR) << "Failed to create work directory";
+    return 1;
+  }
+
+  if (!config.json) {
+    printf("%6s %6s %6s %6s %5s %10s %10s %7s %7s %7s %8s %8s %7s %6s\n", "Mbps",
+           "rtt", "queue", "loss%", "flows", "sim(ms)", "tput(Mbps)", "util",
+           "jain", "rexmit", "qdrops", "spurious", "wall(s)", "gate");
+  }
+  bool all_ok = true;
+  for (double bandwidth : config.bandwidths_mbps) {
+    for (double rtt : config.rtts_ms) {
+      for (double queue : config.queues) {
+        for (double loss : config.loss_percents) {
+          for (double flow_count : config.flow_counts) {
+            safe_udp::ScenarioConfig scenario;
+            scenario.forward.bandwidth_bps = static_cast<int64_t>(bandwidth * 1e6);
+            scenario.forward.delay_us = static_cast<int64_t>(rtt * 1000 / 2);
+            scenario.forward.queue_packets = static_cast<int>(queue);
+            scenario.forward.loss_rate = loss / 100;
+            // ACK 方向同样的时延与丢包，带宽与队列不构成瓶颈
+            scenario.reverse = scenario.forward;
+            scenario.reverse.queue_packets = std::max(static_cast<int>(queue), 1000);
+            scenario.flows = static_cast<int>(flow_count);
+            scenario.file_bytes = config.file_bytes;
+            scenario.window = config.window;
+            scenario.packet_size = config.packet_size;
+            scenario.initial_window = config.initial_window;
+            scenario.seed = config.seed;
+            scenario.work_dir = dir_template;
+
+            // 模拟中所有流的客户端地址相同，缓存按场景新建
+            safe_udp::PathMetricsCache path_metrics("", safe_udp::DEFAULT_PATH_METRICS_TTL_S);
+            if (config.warm_cache) {
+              scenario.path_metrics = &path_metrics;
+              safe_udp::RunScenario(scenario);
+            }
+
+            double wall_start = safe_udp::bench::NowSeconds();
+            safe_udp::ScenarioResult result = safe_udp::RunScenario(scenario);
+            double wall = safe_udp::bench::NowSeconds() - wall_start;
+
+            int64_t retransmits = 0;
+            double throughput = 0;
+            bool completed = true;
+            for (const safe_udp::FlowResult &flow : result.flows) {
+              retransmits += flow.retransmits;
+              throughput += flow.throughput_bps;
+              completed = completed && flow.completed && flow.verified;
+            }
+            // 超出瓶颈上实际丢弃的数据包（排队溢出与模拟丢包）的重传视为多余
+            int64_t spurious = std::max<int64_t>(
+                retransmits - result.forward.dropped_queue - result.forward.dropped_loss, 0);
+            double expected = expected_utilization(scenario, config.window);
+            bool passed =
+                completed && result.utilization >= config.min_utilization * expected &&
+                (scenario.flows < 2 || result.fairness >= config.min_fairness) &&
+                spurious <= config.max_spurious_retransmits;
+            all_ok = all_ok && passed;
+
+            if (config.json) {
+              printf("{\"bandwidth_mbps\":%.1f,\"rtt_ms\":%.1f,\"queue\":%d,"
+                     "\"loss_percent\":%.2f,\"flows\":%d,\"sim_ms\":%.1f,"
+                     "\"throughput_mbps\":%.3f,\"utilization\":%.4f,"
+                     "\"fairness\":%.4f,\"retransmits\":%lld,\"queue_drops\":%lld,"
+                     "\"spurious_retransmits\":%lld,"
+                     "\"completed\":%s,\"passed\":%s,\"wall_s\":%.3f}\n",
+                     bandwidth, rtt, scenario.forward.queue_packets, loss,
+                     scenario.flows, result.duration_us / 1000.0, throughput / 1e6,
+                     result.utilization, result.fairness, (long long)retransmits,
+                     (long long)result.forward.dropped_queue, (long long)spurious,
+                     completed ? "true" : "false", passed ? "true" : "false", wall);
+            } else {
+              printf("%6.1f %6.1f %6d %6.2f %5d %10.1f %10.3f %7.3f %7.3f %7lld "
+                     "%8lld %8lld %7.2f %6s\n",
+                     bandwidth, rtt, scenario.forward.queue_packets, loss,
+                     scenario.flows, result.duration_us / 1000.0, throughput / 1e6,
+                     result.utilization, result.fairness, (long long)retransmits,
+                     (long long)result.forward.dropped_queue, (long long)spurious, wall,
+                     passed ? "ok" : "FAIL");
+            }
+            fflush(stdout);
+          }
+        }
+      }
+    }
+  }
+  return all_ok ? 0 : 1;
+}
@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "bench_util.h"
+#include "low_latency.h"
+
+// 小文件请求/应答基准：同一进程内反复下载小文件，统计从发出请求到收到最后一个字节
+// （time-to-last-byte）的 p50/p99，对比普通模式与低时延模式（自旋接收 + SO_BUSY_POLL）。
+// 用法: small_file_bench [--sizes 512,4096,65536] [--reps 200]
+//                        [--modes normal,low-latency] [--spin-us 200]
+//                        [--server-cpu n] [--client-cpu n] [--json]
+namespace {
+struct BenchConfig {
+  std::vector<int> file_sizes = {512, 4096, 65536};
+  std::vector<std::string> modes = {"normal", "low-latency"};
+  int repetitions = 200;
+  int64_t spin_budget_us = safe_udp::DEFAULT_SPIN_BUDGET_US;
+  int server_cpu = -1;
+  int client_cpu = -1;
+  bool json = false;
+};
+
+// 返回 time-to-last-byte（微秒），下载失败或内容不一致时返回 -1
+int64_t run_request(const BenchConfig &config, const std::string &work_dir,
+                    const std::string &file_name, const std::string &expected,
+                    bool low_latency) {
+  safe_udp::LowLatencyConfig latency;
+  latency.enabled = low_latency;
+  latency.spin_budget_us = config.spin_budget_us;
+
+  std::unique_ptr<safe_udp::UdpServer> server =
+      std::make_unique<safe_udp::UdpServer>();
+  server->rwnd_ = 64;
+  server->low_latency_ = latency;
+  server->low_latency_.cpu = config.server_cpu;
+
+  std::unique_ptr<safe_udp::UdpClient> client =
+      std::make_unique<safe_udp::UdpClient>();
+  client->receiver_window_ = 64;
+  client->output_dir_ = work_dir + "/client_files/";
+  client->low_latency_ = latency;
+  client->low_latency_.cpu = config.client_cpu;
+
+  int64_t elapsed = safe_udp::bench::RunRequest(
+      server.get(), client.get(), work_dir + "/server_files/", file_name);
+  if (elapsed < 0 ||
+      safe_udp::bench::ReadFile(client->output_dir_ + file_name) != expected) {
+    return -1;
+  }
+  return elapsed;
+}
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  FLAGS_minloglevel = google::GLOG_WARNING;
+
+  BenchConfig config;
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    bool has_value = i + 1 < argc;
+    if (arg == "--sizes" && has_value) {
+      config.file_sizes = safe_udp::bench::ParseIntList(argv[++i]);
+    } else if (arg == "--reps" && has_value) {
+      config.repetitions = atoi(argv[++i]);
+    } else if (arg == "--modes" && has_value) {
+      config.modes = safe_udp::bench::SplitList(argv[++i]);
+    } else if (arg == "--spin-us" && has_value) {
+      config.spin_budget_us = atoll(argv[++i]);
+    } else if (arg == "--server-cpu" && has_value) {
+      config.server_cpu = atoi(argv[++i]);
+    } else if (arg == "--client-cpu" && has_value) {
+      config.client_cpu = atoi(argv[++i]);
+    } else if (arg == "--json") {
+      config.json = true;
+    } else {
+      fprintf(stderr,
+              "Usage: %s [--sizes a,b] [--reps n] [--modes normal,low-latency] "
+              "[--spin-us n] [--server-cpu n] [--client-cpu n] [--json]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  char dir_template[] = "/tmp/safe_udp_small.XXXXXX";
+  if (mkdtemp(dir_template) == nullptr) {
+    LOG(ERROR) << "Failed to create work directory";
+    return 1;
+  }
+  std::string work_dir(dir_template);
+  mkdir((work_dir + "/server_files").c_str(), 0755);
+  mkdir((work_dir + "/client_files").c_str(), 0755);
+
+  std::mt19937 generator(42);
+  std::vector<std::string> contents;
+  for (int size : config.file_sizes) {
+    contents.push_back(safe_udp::bench::RandomContent(size, &generator));
+    safe_udp::bench::WriteFile(work_dir + "/server_files/" + std::to_string(size) + ".bin",
+                               contents.back());
+  }
+
+  if (!config.json) {
+    printf("%8s %12s %10s %10s %10s %6s\n", "size", "mode", "p50(us)",
+           "p99(us)", "mean(us)", "failed");
+  }
+  bool all_ok = true;
+  for (size_t s = 0; s < config.file_sizes.size(); s++) {
+    int size = config.file_sizes[s];
+    for (const std::string &mode : config.modes) {
+      bool low_latency = mode == "low-latency";
+      std::vector<double> samples;
+      int failed = 0;
+      for (int rep = 0; rep < config.repetitions; rep++) {
+        int64_t elapsed = run_request(config, work_dir,
+                                      std::to_string(size) + ".bin",
+                                      contents[s], low_latency);
+        if (elapsed < 0) {
+          failed++;
+        } else {
+          samples.push_back(static_cast<double>(elapsed));
+        }
+      }
+      all_ok = all_ok && failed == 0;
+      double mean = 0;
+      for (double sample : samples) {
+        mean += sample / samples.size();
+      }
+      double p50 = safe_udp::bench::Percentile(samples, 50);
+      double p99 = safe_udp::bench::Percentile(samples, 99);
+      if (config.json) {
+        printf("{\"file_size\":%d,\"mode\":\"%s\",\"p50_us\":%.1f,"
+               "\"p99_us\":%.1f,\"mean_us\":%.1f,\"failed\":%d}\n",
+               size, mode.c_str(), p50, p99, mean, failed);
+      } else {
+        printf("%8d %12s %10.1f %10.1f %10.1f %6d\n", size, mode.c_str(), p50,
+               p99, mean, failed);
+      }
+      fflush(stdout);
+    }
+  }
+  return all_ok ? 0 : 1;
+}
@@ -0,0 +1,57 @@
+#include <stdlib.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "download_task.h"
+#include "udp_client.h"
+
+// 单线程并发下载示例：每个文件对应一个服务端进程，第 i 个文件从 <first-port> + i 下载
+namespace {
+int g_remaining = 0;
+
+safe_udp::DetachedTask fetch(safe_udp::DownloadReactor *reactor,
+                             std::string server_ip, int port,
+                             std::string file_name, int64_t deadline_us) {
+  auto client = std::make_unique<safe_udp::UdpClient>();
+  client->deadline_us_ = deadline_us;
+  client->on_progress_ = [file_name](const safe_udp::DownloadProgress &progress) {
+    VLOG(1) << file_name << ": " << progress.bytes_received << "/"
+            << progress.file_length;
+  };
+  client->CreateSocketAndServerConnection(server_ip, std::to_string(port));
+
+  safe_udp::DownloadStatus status =
+      co_await safe_udp::Download(reactor, client.get(), file_name);
+  LOG(INFO) << file_name << " from port " << port << ": "
+            << safe_udp::DownloadStatusName(status);
+  g_remaining--;
+}
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  FLAGS_minloglevel = google::GLOG_INFO;
+
+  if (argc < 4) {
+    LOG(ERROR) << "Please provide format: <server-ip> <first-port> "
+                  "<file-name>... [deadline-ms via SAFE_UDP_DEADLINE_MS]";
+    exit(1);
+  }
+
+  const char *deadline = getenv("SAFE_UDP_DEADLINE_MS");
+  int64_t deadline_us = deadline != nullptr ? atoll(deadline) * 1000 : 0;
+
+  safe_udp::DownloadReactor reactor;
+  std::string server_ip(argv[1]);
+  int first_port = atoi(argv[2]);
+  for (int i = 3; i < argc; i++) {
+    g_remaining++;
+    fetch(&reactor, server_ip, first_port + i - 3, argv[i], deadline_us);
+  }
+  reactor.Run();
+  return g_remaining == 0 ? 0 : 1;
+}
@@ -5,8 +5,12 @@
 #include <stdlib.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 
+#include "metrics_exporter.h"
+#include "trace.h"
 #include "udp_client.h"
 
 #include <glog/logging.h>
@@ -17,9 +21,10 @@ int main(int argc, char *argv[]) {
   FLAGS_minloglevel = google::GLOG_INFO;
 
   LOG(INFO) << "Starting the client !!!";
-  if (argc != 7) {
+  if (argc != 7 && argc != 8) {
     LOG(ERROR) << "Please provide format: <server-ip> <server-port> "
-                  "<file-name> <receiver-window> <control-param> <drop/delay%>";
+                  "<file-name> <receiver-window> <control-param> <drop/delay%> "
+                  "[max-packet-size]";
     exit(1);
   }
 
@@ -51,10 +56,55 @@ int main(int argc, char *argv[]) {
 
   int drop_percentage = atoi(argv[6]);
   udp_client->prob_value_ = drop_percentage;
+  if (argc == 8) {
+    // 大于 1472 时先进行路径 MTU 探测，再与服务端协商分段大小
+    udp_client->max_packet_size_ = atoi(argv[7]);
+  }
 
+  // 设置 SAFE_UDP_ZERO_COPY=0 时关闭映射文件的零拷贝接收
+  const char *zero_copy = getenv("SAFE_UDP_ZERO_COPY");
+  udp_client->zero_copy_receive_ = zero_copy == NULL || atoi(zero_copy) != 0;
+  // SAFE_UDP_LOW_LATENCY=1 开启低时延模式，参数见 low_latency.h
+  udp_client->low_latency_ = safe_udp::LowLatencyConfig::FromEnvironment();
+  // SAFE_UDP_RESUME=1 时从已有的部分文件续传，SAFE_UDP_RTT_HINT_US 告知服务端已知的 RTT
+  const char *resume = getenv("SAFE_UDP_RESUME");
+  udp_client->resume_ = resume != NULL && atoi(resume) != 0;
+  const char *rtt_hint = getenv("SAFE_UDP_RTT_HINT_US");
+  if (rtt_hint != NULL) {
+    udp_client->rtt_hint_us_ = atoll(rtt_hint);
+  }
+  // SAFE_UDP_VERIFY_DIGEST=0 时不请求服务端附加摘要，也不校验下载内容
+  const char *verify_digest = getenv("SAFE_UDP_VERIFY_DIGEST");
+  udp_client->verify_digest_ = verify_digest == NULL || atoi(verify_digest) != 0;
+  // SAFE_UDP_BUNDLE=1 时 file-name 为通配符，以 @ 开头时为本地文件清单的路径，
+  // 匹配的文件打包传输并解包到 CLIENT_FILE_PATH
+  const char *bundle = getenv("SAFE_UDP_BUNDLE");
+  udp_client->bundle_ = bundle != NULL && atoi(bundle) != 0;
+  if (udp_client->bundle_ && !file_name.empty() && file_name[0] == '@') {
+    std::ifstream manifest(file_name.substr(1));
+    std::stringstream names;
+    names << manifest.rdbuf();
+    file_name = names.str();
+    if (file_name.find('\n') == std::string::npos) {
+      file_name += "\n";  // 只有一行的清单也按清单处理
+    }
+  }
+  // SAFE_UDP_KEY 为十六进制的预共享密钥，设置时请求加密传输
+  if (!safe_udp::PreSharedKeyFromEnvironment(&udp_client->pre_shared_key_)) {
+    exit(1);
+  }
   udp_client->CreateSocketAndServerConnection(server_ip, port_num);
+  auto metrics_exporter =
+      safe_udp::MetricsExporter::FromEnvironment(udp_client->packet_statistics());
+  if (metrics_exporter) {
+    metrics_exporter->Start();
+  }
   udp_client->SendFileRequest(file_name);
+  if (metrics_exporter) {
+    metrics_exporter->Stop();
+  }
 
   free(udp_client);
+  SAFE_UDP_TRACE_DUMP();
   return 0;
 }
\ No newline at end of file
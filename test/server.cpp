@@ -1,9 +1,12 @@
 #include <cstdlib>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <glog/logging.h>
 // glog 是 Google 开发的一个高性能的 C++ 日志库
 
+#include "metrics_exporter.h"
+#include "trace.h"
 #include "udp_server.h"
 
 constexpr char SERVER_FILE_PATH[] = "/work/files/server_files/";
@@ -22,7 +25,8 @@ int main(int argc, char *argv[]) {
   char *message_recv;
   if (argc < 3) {
     LOG(INFO) << "Please provide a port number and receive window";
-    LOG(ERROR) << "Please provide format: <server-port> <receiver-window>";
+    LOG(ERROR) << "Please provide format: <server-port> <receiver-window> "
+                  "[max-packet-size]";
     exit(1);
   }
   if (argv[1] != NULL) {
@@ -34,6 +38,33 @@ int main(int argc, char *argv[]) {
 
   safe_udp::UdpServer *udp_server = new safe_udp::UdpServer();
   udp_server->rwnd_ = recv_window;
+  if (argc > 3 && argv[3] != NULL) {
+    // 允许协商的最大分段大小，回环或巨帧网络可设置为 65507
+    udp_server->max_packet_size_ = atoi(argv[3]);
+  }
+  // 设置 SAFE_UDP_IO_URING=1 时使用 io_uring 后端
+  const char *io_uring = getenv("SAFE_UDP_IO_URING");
+  udp_server->use_io_uring_ = io_uring != NULL && atoi(io_uring) != 0;
+  // SAFE_UDP_LOW_LATENCY=1 开启低时延模式，参数见 low_latency.h
+  udp_server->low_latency_ = safe_udp::LowLatencyConfig::FromEnvironment();
+  // SAFE_UDP_INITIAL_WINDOW 修改初始拥塞窗口（默认 10 个分段）
+  const char *initial_window = getenv("SAFE_UDP_INITIAL_WINDOW");
+  if (initial_window != NULL) {
+    udp_server->initial_window_ = atoi(initial_window);
+  }
+  // SAFE_UDP_RATE_LIMIT_MBPS 限制发送速率，经发送调度器按令牌桶发出
+  const char *rate_limit = getenv("SAFE_UDP_RATE_LIMIT_MBPS");
+  std::unique_ptr<safe_udp::TransmitScheduler> scheduler;
+  if (rate_limit != NULL && atof(rate_limit) > 0) {
+    scheduler = std::make_unique<safe_udp::TransmitScheduler>(0, safe_udp::MAX_PACKET_SIZE);
+    udp_server->scheduler_ = scheduler.get();
+    udp_server->transmit_options_.rate_limit_bps =
+        static_cast<int64_t>(atof(rate_limit) * 1e6);
+  }
+  // SAFE_UDP_KEY 为十六进制的预共享密钥，设置时只接受加密传输
+  if (!safe_udp::PreSharedKeyFromEnvironment(&udp_server->pre_shared_key_)) {
+    exit(1);
+  }
   sfd = udp_server->StartServer(port_num);
   message_recv = udp_server->GetRequest(sfd);
   // char cwd[1024];
@@ -47,12 +78,26 @@ int main(int argc, char *argv[]) {
   std::string file_name =
       std::string(SERVER_FILE_PATH) + std::string(message_recv);
       
-  if (udp_server->OpenFile(file_name)) {
+  // 设置 SAFE_UDP_METRICS_TARGET 时定期导出传输指标
+  auto metrics_exporter =
+      safe_udp::MetricsExporter::FromEnvironment(udp_server->packet_statistics());
+  // SAFE_UDP_BUNDLE=1 的客户端请求的是通配符或文件清单
+  bool opened = udp_server->is_bundle_request()
+                    ? udp_server->OpenBundle(SERVER_FILE_PATH)
+                    : udp_server->OpenFile(file_name);
+  if (opened) {
+    if (metrics_exporter) {
+      metrics_exporter->Start();
+    }
     udp_server->StartFileTransfer();
+    if (metrics_exporter) {
+      metrics_exporter->Stop();
+    }
   } else {
     udp_server->SendError();
   }
 
   free(udp_server);
+  SAFE_UDP_TRACE_DUMP();
   return 0;
 }
@@ -0,0 +1,115 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include <glog/logging.h>
+
+#include "impairment_proxy.h"
+
+// 独立运行的 UDP 损伤代理：
+//   impair_proxy <listen-port> <server-host> <server-port> [options]
+// 每个代理进程只服务一个客户端（第一个发来数据报的地址）。
+// 选项默认同时作用于两个方向，加 --to-server- / --to-client- 前缀只作用于单个方向：
+//   --seed N  --loss P  --ge p_gb,p_bg,loss_good,loss_bad  --dup P
+//   --reorder P,delay_us  --delay US  --jitter US  --rate BYTES_PER_SEC
+//   --burst BYTES  --queue BYTES
+namespace {
+safe_udp::ImpairmentProxy *g_proxy = nullptr;
+
+void handle_signal(int) {
+  if (g_proxy != nullptr) {
+    g_proxy->Stop();
+  }
+}
+
+bool apply_option(safe_udp::ImpairmentConfig *config, const std::string &name,
+                  const char *value) {
+  if (name == "loss") {
+    config->loss_rate = atof(value);
+  } else if (name == "ge") {
+    sscanf(value, "%lf,%lf,%lf,%lf", &config->ge_p_good_to_bad,
+           &config->ge_p_bad_to_good, &config->ge_loss_good,
+           &config->ge_loss_bad);
+  } else if (name == "dup") {
+    config->duplicate_rate = atof(value);
+  } else if (name == "reorder") {
+    sscanf(value, "%lf,%d", &config->reorder_rate, &config->reorder_delay_us);
+  } else if (name == "delay") {
+    config->delay_us = atoi(value);
+  } else if (name == "jitter") {
+    config->jitter_us = atoi(value);
+  } else if (name == "rate") {
+    config->rate_bytes_per_sec = atoll(value);
+  } else if (name == "burst") {
+    config->burst_bytes = atoi(value);
+  } else if (name == "queue") {
+    config->queue_limit_bytes = atoi(value);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void print_stats(const char *name, const safe_udp::ImpairmentStats &stats) {
+  LOG(INFO) << name << ": received " << stats.received << " forwarded "
+            << stats.forwarded << " lost " << stats.dropped_loss
+            << " queue-dropped " << stats.dropped_queue << " duplicated "
+            << stats.duplicated << " reordered " << stats.reordered;
+}
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  FLAGS_minloglevel = google::GLOG_INFO;
+
+  if (argc < 4 || (argc - 4) % 2 != 0) {
+    LOG(ERROR) << "Please provide format: <listen-port> <server-host> "
+                  "<server-port> [--option value]...";
+    return 1;
+  }
+
+  uint64_t seed = 1;
+  for (int i = 4; i < argc; i += 2) {
+    if (strcmp(argv[i], "--seed") == 0) {
+      seed = strtoull(argv[i + 1], NULL, 10);
+    }
+  }
+  safe_udp::ImpairmentProxy proxy(argv[2], atoi(argv[3]), seed);
+
+  for (int i = 4; i < argc; i += 2) {
+    std::string option(argv[i]);
+    if (option == "--seed") {
+      continue;
+    }
+    bool ok;
+    if (option.compare(0, 12, "--to-server-") == 0) {
+      ok = apply_option(&proxy.to_server_, option.substr(12), argv[i + 1]);
+    } else if (option.compare(0, 12, "--to-client-") == 0) {
+      ok = apply_option(&proxy.to_client_, option.substr(12), argv[i + 1]);
+    } else if (option.compare(0, 2, "--") == 0) {
+      ok = apply_option(&proxy.to_server_, option.substr(2), argv[i + 1]) &&
+           apply_option(&proxy.to_client_, option.substr(2), argv[i + 1]);
+    } else {
+      ok = false;
+    }
+    if (!ok) {
+      LOG(ERROR) << "Unknown option " << option;
+      return 1;
+    }
+  }
+
+  if (proxy.Start(atoi(argv[1])) < 0) {
+    return 1;
+  }
+  g_proxy = &proxy;
+  signal(SIGINT, handle_signal);
+  signal(SIGTERM, handle_signal);
+  proxy.Run();
+
+  print_stats("to server", proxy.to_server_stats_);
+  print_stats("to client", proxy.to_client_stats_);
+  return 0;
+}
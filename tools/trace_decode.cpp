@@ -0,0 +1,187 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "trace.h"
+
+// 离线解析 SAFE_UDP_TRACE_FILE 生成的二进制追踪文件
+// 用法: trace_decode <trace-file> [--json]
+namespace {
+struct DecodedEvent {
+  uint32_t thread_id;
+  safe_udp::TraceEvent event;
+};
+
+const char *event_name(uint16_t type) {
+  switch (static_cast<safe_udp::TraceEventType>(type)) {
+    case safe_udp::TraceEventType::PACKET_SENT:
+      return "packet_sent";
+    case safe_udp::TraceEventType::ACK_RECEIVED:
+      return "ack_received";
+    case safe_udp::TraceEventType::DUP_ACK:
+      return "dup_ack";
+    case safe_udp::TraceEventType::RETRANSMIT:
+      return "retransmit";
+    case safe_udp::TraceEventType::CWND_CHANGE:
+      return "cwnd_change";
+    case safe_udp::TraceEventType::RTT_SAMPLE:
+      return "rtt_sample";
+    case safe_udp::TraceEventType::PACKET_RECEIVED:
+      return "packet_received";
+    case safe_udp::TraceEventType::ACK_SENT:
+      return "ack_sent";
+    case safe_udp::TraceEventType::PACKET_DROPPED:
+      return "packet_dropped";
+    case safe_udp::TraceEventType::TIMEOUT:
+      return "timeout";
+  }
+  return "unknown";
+}
+
+// qlog 风格的分类:名称 以及两个参数的字段名
+void event_fields(uint16_t type, const char **qlog_name, const char **a_name,
+                  const char **b_name) {
+  switch (static_cast<safe_udp::TraceEventType>(type)) {
+    case safe_udp::TraceEventType::PACKET_SENT:
+      *qlog_name = "transport:packet_sent";
+      *a_name = "seq_number";
+      *b_name = "length";
+      return;
+    case safe_udp::TraceEventType::ACK_RECEIVED:
+      *qlog_name = "recovery:ack_received";
+      *a_name = "ack_number";
+      *b_name = "cwnd";
+      return;
+    case safe_udp::TraceEventType::DUP_ACK:
+      *qlog_name = "recovery:dup_ack";
+      *a_name = "ack_number";
+      *b_name = "dup_count";
+      return;
+    case safe_udp::TraceEventType::RETRANSMIT:
+      *qlog_name = "recovery:packet_retransmitted";
+      *a_name = "seq_number";
+      *b_name = "fast";
+      return;
+    case safe_udp::TraceEventType::CWND_CHANGE:
+      *qlog_name = "recovery:metrics_updated";
+      *a_name = "cwnd";
+      *b_name = "ssthresh";
+      return;
+    case safe_udp::TraceEventType::RTT_SAMPLE:
+      *qlog_name = "recovery:rtt_sample";
+      *a_name = "latest_rtt_us";
+      *b_name = "smoothed_rtt_us";
+      return;
+    case safe_udp::TraceEventType::PACKET_RECEIVED:
+      *qlog_name = "transport:packet_received";
+      *a_name = "seq_number";
+      *b_name = "length";
+      return;
+    case safe_udp::TraceEventType::ACK_SENT:
+      *qlog_name = "transport:ack_sent";
+      *a_name = "ack_number";
+      *b_name = "unused";
+      return;
+    case safe_udp::TraceEventType::PACKET_DROPPED:
+      *qlog_name = "transport:packet_dropped";
+      *a_name = "seq_number";
+      *b_name = "reason";
+      return;
+    case safe_udp::TraceEventType::TIMEOUT:
+      *qlog_name = "recovery:loss_timer_expired";
+      *a_name = "timeout_us";
+      *b_name = "cwnd";
+      return;
+  }
+  *qlog_name = "unknown";
+  *a_name = "a";
+  *b_name = "b";
+}
+
+template <typename T>
+bool read_value(FILE *file, T *value) {
+  return fread(value, sizeof(T), 1, file) == 1;
+}
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <trace-file> [--json]\n", argv[0]);
+    return 1;
+  }
+  bool json = argc > 2 && strcmp(argv[2], "--json") == 0;
+
+  FILE *file = fopen(argv[1], "rb");
+  if (file == nullptr) {
+    fprintf(stderr, "Failed to open %s\n", argv[1]);
+    return 1;
+  }
+
+  char magic[sizeof(safe_udp::TRACE_FILE_MAGIC)];
+  uint64_t tsc_hz = 0;
+  uint64_t tsc_base = 0;
+  uint32_t ring_count = 0;
+  if (fread(magic, sizeof(magic), 1, file) != 1 ||
+      memcmp(magic, safe_udp::TRACE_FILE_MAGIC, sizeof(magic)) != 0 ||
+      !read_value(file, &tsc_hz) || !read_value(file, &tsc_base) ||
+      !read_value(file, &ring_count) || tsc_hz == 0) {
+    fprintf(stderr, "Invalid trace file %s\n", argv[1]);
+    fclose(file);
+    return 1;
+  }
+
+  std::vector<DecodedEvent> events;
+  for (uint32_t i = 0; i < ring_count; i++) {
+    uint32_t thread_id = 0;
+    uint64_t event_count = 0;
+    if (!read_value(file, &thread_id) || !read_value(file, &event_count)) {
+      fprintf(stderr, "Truncated trace file %s\n", argv[1]);
+      break;
+    }
+    for (uint64_t j = 0; j < event_count; j++) {
+      DecodedEvent decoded;
+      decoded.thread_id = thread_id;
+      if (!read_value(file, &decoded.event)) {
+        break;
+      }
+      events.push_back(decoded);
+    }
+  }
+  fclose(file);
+
+  // 多个线程的事件按时间戳合并
+  std::stable_sort(events.begin(), events.end(),
+                   [](const DecodedEvent &x, const DecodedEvent &y) {
+                     return x.event.tsc < y.event.tsc;
+                   });
+
+  if (json) {
+    printf("{\"qlog_version\":\"0.3\",\"title\":\"safe-udp trace\",\"traces\":"
+           "[{\"common_fields\":{\"time_format\":\"relative\"},\"events\":[");
+  }
+  for (size_t i = 0; i < events.size(); i++) {
+    const safe_udp::TraceEvent &event = events[i].event;
+    double time_us =
+        static_cast<double>(event.tsc - tsc_base) * 1e6 / static_cast<double>(tsc_hz);
+    if (json) {
+      const char *qlog_name;
+      const char *a_name;
+      const char *b_name;
+      event_fields(event.type, &qlog_name, &a_name, &b_name);
+      printf("%s\n{\"time\":%.3f,\"name\":\"%s\",\"data\":{\"thread\":%u,"
+             "\"%s\":%" PRId64 ",\"%s\":%" PRId64 "}}",
+             i == 0 ? "" : ",", time_us / 1000.0, qlog_name,
+             events[i].thread_id, a_name, event.a, b_name, event.b);
+    } else {
+      printf("%14.3f us  T%-3u %-16s %" PRId64 " %" PRId64 "\n", time_us,
+             events[i].thread_id, event_name(event.type), event.a, event.b);
+    }
+  }
+  if (json) {
+    printf("\n]}]}\n");
+  }
+  return 0;
+}
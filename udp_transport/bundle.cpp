@@ -0,0 +1,313 @@
+#include "bundle.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <sstream>
+
+#include <glog/logging.h>
+
+namespace safe_udp {
+namespace {
+void append_uint32(std::string *out, uint32_t value) {
+  out->append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+uint32_t read_uint32(const char *buffer) {
+  uint32_t value;
+  memcpy(&value, buffer, sizeof(value));
+  return value;
+}
+
+bool write_all(int fd, const char *data, size_t length) {
+  while (length > 0) {
+    ssize_t n = write(fd, data, length);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    length -= n;
+  }
+  return true;
+}
+}  // namespace
+
+bool IsSafeRelativePath(const std::string &path) {
+  if (path.empty() || path[0] == '/') {
+    return false;
+  }
+  std::stringstream stream(path);
+  std::string component;
+  while (std::getline(stream, component, '/')) {
+    if (component.empty() || component == "." || component == "..") {
+      return false;
+    }
+  }
+  return path.back() != '/';
+}
+
+std::unique_ptr<Bundle> Bundle::Open(const std::string &directory,
+                                     const std::string &pattern) {
+  std::unique_ptr<Bundle> bundle(new Bundle());
+  if (pattern.find('\n') != std::string::npos) {
+    std::stringstream manifest(pattern);
+    std::string line;
+    while (std::getline(manifest, line)) {
+      if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+      }
+      if (!line.empty() && !bundle->add(directory, line)) {
+        return nullptr;
+      }
+    }
+  } else {
+    if (!IsSafeRelativePath(pattern)) {
+      LOG(WARNING) << "Rejecting bundle pattern " << pattern;
+      return nullptr;
+    }
+    glob_t matches;
+    int result = glob((directory + pattern).c_str(), 0, nullptr, &matches);
+    if (result != 0 && result != GLOB_NOMATCH) {
+      LOG(WARNING) << "glob failed for " << pattern;
+      return nullptr;
+    }
+    bool ok = true;
+    for (size_t i = 0; ok && result == 0 && i < matches.gl_pathc; i++) {
+      std::string name(matches.gl_pathv[i] + directory.size());
+      struct stat info;
+      // 通配符可能匹配到目录，跳过
+      if (stat(matches.gl_pathv[i], &info) == 0 && S_ISREG(info.st_mode)) {
+        ok = bundle->add(directory, name);
+      }
+    }
+    globfree(&matches);
+    if (!ok) {
+      return nullptr;
+    }
+  }
+  if (bundle->entries_.empty()) {
+    LOG(INFO) << "No files match bundle request";
+    return nullptr;
+  }
+  LOG(INFO) << "Bundle of " << bundle->entries_.size() << " files, "
+            << bundle->length_ << " bytes";
+  return bundle;
+}
+
+bool Bundle::add(const std::string &directory, const std::string &name) {
+  struct stat info;
+  std::string path = directory + name;
+  if (!IsSafeRelativePath(name) || name.size() > MAX_BUNDLE_NAME_LENGTH ||
+      stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+    LOG(WARNING) << "Cannot bundle " << name;
+    return false;
+  }
+  if (entries_.size() >= MAX_BUNDLE_FILES ||
+      length_ + BUNDLE_ENTRY_HEADER_LENGTH + static_cast<int64_t>(name.size()) +
+              info.st_size > MAX_BUNDLE_BYTES) {
+    LOG(WARNING) << "Bundle exceeds " << MAX_BUNDLE_FILES << " files or "
+                 << MAX_BUNDLE_BYTES << " bytes";
+    return false;
+  }
+  Entry entry;
+  entry.offset = length_;
+  append_uint32(&entry.header, name.size());
+  append_uint32(&entry.header, static_cast<uint32_t>(info.st_size));
+  entry.header.append(name);
+  entry.path = path;
+  entry.data_length = info.st_size;
+  length_ += entry.header.size() + entry.data_length;
+  entries_.push_back(std::move(entry));
+  return true;
+}
+
+Bundle::~Bundle() {
+  for (const auto &open_file : open_files_) {
+    close(open_file.second);
+  }
+}
+
+int Bundle::file_descriptor(size_t index) {
+  for (size_t i = 0; i < open_files_.size(); i++) {
+    if (open_files_[i].first == index) {
+      std::rotate(open_files_.begin(), open_files_.begin() + i,
+                  open_files_.begin() + i + 1);
+      return open_files_[0].second;
+    }
+  }
+  int fd = open(entries_[index].path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    LOG(WARNING) << "Failed to open " << entries_[index].path;
+    return -1;
+  }
+  if (open_files_.size() >= BUNDLE_OPEN_FILES) {
+    close(open_files_.back().second);
+    open_files_.pop_back();
+  }
+  open_files_.insert(open_files_.begin(), std::make_pair(index, fd));
+  return fd;
+}
+
+int Bundle::Read(int64_t offset, int length, char *buffer) {
+  length = static_cast<int>(std::max<int64_t>(std::min<int64_t>(length, length_ - offset), 0));
+  // 找到 offset 所在的条目
+  auto it = std::upper_bound(entries_.begin(), entries_.end(), offset,
+                             [](int64_t value, const Entry &entry) {
+                               return value < entry.offset;
+                             });
+  size_t index = it - entries_.begin() - 1;
+  int copied = 0;
+  while (copied < length && index < entries_.size()) {
+    const Entry &entry = entries_[index];
+    int64_t within = offset + copied - entry.offset;
+    int64_t header_length = entry.header.size();
+    if (within < header_length) {
+      int n = static_cast<int>(std::min<int64_t>(header_length - within, length - copied));
+      memcpy(buffer + copied, entry.header.data() + within, n);
+      copied += n;
+      continue;
+    }
+    int64_t data_offset = within - header_length;
+    int n = static_cast<int>(
+        std::min<int64_t>(entry.data_length - data_offset, length - copied));
+    int fd = n > 0 ? file_descriptor(index) : -1;
+    ssize_t got = fd >= 0 ? pread(fd, buffer + copied, n, data_offset) : 0;
+    if (got < n) {
+      memset(buffer + copied + std::max<ssize_t>(got, 0), 0, n - std::max<ssize_t>(got, 0));
+    }
+    copied += n;
+    index++;
+  }
+  return copied;
+}
+
+BundleWriter::BundleWriter(const std::string &directory)
+    : directory_(directory),
+      entry_fd_(-1),
+      entry_remaining_(0),
+      files_written_(0),
+      failed_(false) {
+  directory_fd_ = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (directory_fd_ < 0) {
+    LOG(ERROR) << "Failed to open output directory " << directory;
+    failed_ = true;
+  }
+}
+
+BundleWriter::~BundleWriter() {
+  if (entry_fd_ >= 0) {
+    close(entry_fd_);
+  }
+  if (directory_fd_ >= 0) {
+    close(directory_fd_);
+  }
+}
+
+bool BundleWriter::Append(const char *data, int length) {
+  if (failed_) {
+    return false;
+  }
+  buffer_.append(data, length);
+  if (buffer_.size() >= BUNDLE_WRITE_BATCH_BYTES) {
+    return flush();
+  }
+  return true;
+}
+
+bool BundleWriter::Finish() {
+  if (failed_ || !flush()) {
+    return false;
+  }
+  if (entry_fd_ >= 0 || !buffer_.empty()) {
+    LOG(ERROR) << "Bundle stream ended inside an entry";
+    return false;
+  }
+  LOG(INFO) << "Unpacked " << files_written_ << " files into " << directory_;
+  return true;
+}
+
+bool BundleWriter::flush() {
+  size_t position = 0;
+  while (!failed_) {
+    if (entry_fd_ >= 0) {
+      size_t n = std::min<int64_t>(entry_remaining_, buffer_.size() - position);
+      if (!write_all(entry_fd_, buffer_.data() + position, n)) {
+        LOG(ERROR) << "Failed to write bundle entry: " << strerror(errno);
+        failed_ = true;
+        break;
+      }
+      position += n;
+      entry_remaining_ -= n;
+      if (entry_remaining_ > 0) {
+        break;  // 等待更多数据
+      }
+      close_entry();
+      continue;
+    }
+    if (buffer_.size() - position < BUNDLE_ENTRY_HEADER_LENGTH) {
+      break;
+    }
+    uint32_t name_length = read_uint32(buffer_.data() + position);
+    uint32_t data_length = read_uint32(buffer_.data() + position + 4);
+    if (name_length == 0 || name_length > MAX_BUNDLE_NAME_LENGTH) {
+      LOG(ERROR) << "Malformed bundle entry header";
+      failed_ = true;
+      break;
+    }
+    if (buffer_.size() - position < BUNDLE_ENTRY_HEADER_LENGTH + name_length) {
+      break;
+    }
+    std::string name(buffer_.data() + position + BUNDLE_ENTRY_HEADER_LENGTH, name_length);
+    position += BUNDLE_ENTRY_HEADER_LENGTH + name_length;
+    if (!open_entry(name)) {
+      failed_ = true;
+      break;
+    }
+    entry_remaining_ = data_length;
+    if (entry_remaining_ == 0) {
+      close_entry();
+    }
+  }
+  buffer_.erase(0, position);
+  return !failed_;
+}
+
+bool BundleWriter::open_entry(const std::string &name) {
+  // 不信任服务端给出的路径：只允许写在输出目录之内
+  if (!IsSafeRelativePath(name)) {
+    LOG(ERROR) << "Unsafe path in bundle: " << name;
+    return false;
+  }
+  // 逐级创建子目录，每个目录只尝试一次
+  for (size_t slash = name.find('/'); slash != std::string::npos;
+       slash = name.find('/', slash + 1)) {
+    std::string parent = name.substr(0, slash);
+    if (created_directories_.insert(parent).second &&
+        mkdirat(directory_fd_, parent.c_str(), 0755) != 0 && errno != EEXIST) {
+      LOG(ERROR) << "Failed to create " << directory_ << parent;
+      return false;
+    }
+  }
+  entry_fd_ = openat(directory_fd_, name.c_str(),
+                     O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_NOFOLLOW, 0644);
+  if (entry_fd_ < 0) {
+    LOG(ERROR) << "Failed to create " << directory_ << name << ": " << strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+bool BundleWriter::close_entry() {
+  int result = close(entry_fd_);
+  entry_fd_ = -1;
+  files_written_++;
+  return result == 0;
+}
+}  // namespace safe_udp
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+// 小文件打包传输：客户端请求一个通配符或文件清单，服务端把匹配的文件依次拼成一个
+// 带长度前缀的归档流，在同一次握手、同一个窗口里连续发送，不再为每个文件
+// 重复一次请求/握手/慢启动。流中每个条目为
+//   name_length(4) | data_length(4) | name | data
+// 整数与握手报文一样按主机字节序（小端）。客户端按序收到的数据交给 BundleWriter 解包
+namespace safe_udp {
+constexpr int BUNDLE_ENTRY_HEADER_LENGTH = 8;
+constexpr int MAX_BUNDLE_NAME_LENGTH = 4096;
+// 一次打包的上限：防止通配符展开成整个目录树，流长度也要留出 int 序号的空间
+constexpr int MAX_BUNDLE_FILES = 100000;
+constexpr int64_t MAX_BUNDLE_BYTES = 1LL << 30;
+// 服务端同时保持打开的文件数，重传往往落在最近发送的几个文件上
+constexpr int BUNDLE_OPEN_FILES = 16;
+// 解包时攒够这么多数据才统一创建文件并写入，小文件一次 write 写完
+constexpr size_t BUNDLE_WRITE_BATCH_BYTES = 1 << 20;
+
+// 非空、不是绝对路径、不含 "." / ".." / 空的路径分量
+bool IsSafeRelativePath(const std::string &path);
+
+// 服务端：按打开时的文件列表与大小生成归档流，数据在发送时才读取
+class Bundle {
+ public:
+  // directory 以 / 结尾。pattern 含换行时为文件清单（每行一个相对路径），
+  // 否则为 glob 通配符；只打包普通文件。没有匹配、路径不安全或超过上限时返回 nullptr
+  static std::unique_ptr<Bundle> Open(const std::string &directory,
+                                      const std::string &pattern);
+  ~Bundle();
+
+  int64_t length() const { return length_; }
+  int file_count() const { return entries_.size(); }
+  // 读取流中 [offset, offset + length)，文件在打开之后变短时不足的部分补 0
+  int Read(int64_t offset, int length, char *buffer);
+
+ private:
+  struct Entry {
+    int64_t offset;  // 条目头在流中的位置
+    std::string header;
+    std::string path;
+    int64_t data_length;
+  };
+
+  Bundle() : length_(0) {}
+  bool add(const std::string &directory, const std::string &name);
+  int file_descriptor(size_t index);
+
+  std::vector<Entry> entries_;
+  int64_t length_;
+  // 最近使用的在前：(条目下标, fd)
+  std::vector<std::pair<size_t, int>> open_files_;
+};
+
+// 客户端：把按序到达的归档流解包到目录中
+class BundleWriter {
+ public:
+  explicit BundleWriter(const std::string &directory);
+  ~BundleWriter();
+
+  // 追加按序到达的数据；格式错误、路径不安全或写入失败时返回 false
+  bool Append(const char *data, int length);
+  // 写出剩余数据，流在条目中间结束时返回 false
+  bool Finish();
+  int files_written() const { return files_written_; }
+
+ private:
+  // 解析并写出缓冲区中的完整部分
+  bool flush();
+  bool open_entry(const std::string &name);
+  bool close_entry();
+
+  std::string directory_;
+  int directory_fd_;
+  std::string buffer_;
+  // 数据跨越多次 flush 的条目
+  int entry_fd_;
+  int64_t entry_remaining_;
+  std::set<std::string> created_directories_;
+  int files_written_;
+  bool failed_;
+};
+}  // namespace safe_udp
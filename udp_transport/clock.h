@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+
+namespace safe_udp {
+int64_t NowMicros();
+
+// 时间来源：真实运行时为系统时钟，离散事件模拟器中为虚拟时间
+class Clock {
+ public:
+  virtual ~Clock() = default;
+  virtual int64_t NowMicros() = 0;
+};
+
+class SystemClock : public Clock {
+ public:
+  static SystemClock *Instance() {
+    static SystemClock clock;
+    return &clock;
+  }
+  int64_t NowMicros() override { return safe_udp::NowMicros(); }
+};
+}  // namespace safe_udp
@@ -5,9 +5,15 @@
 
 namespace safe_udp {
   // 新特性 constexpr  常量表达式是指在编译时能够求值的表达式  而不是在运行时计算
+// MAX_PACKET_SIZE 是未协商时的默认分段大小（以太网 MTU 1500 - IP 头 20 - UDP 头 8），
+// 握手协商后的实际分段大小保存在各会话中，最大不超过 MAX_NEGOTIABLE_PACKET_SIZE
 constexpr int MAX_PACKET_SIZE = 1472;
 constexpr int MAX_DATA_SIZE = 1460;
 constexpr int HEADER_LENGTH = 12;
+// UDP 单个数据报的最大负载 65535 - 20 - 8，同时保证 length_ 能用 uint16_t 表示
+constexpr int MAX_NEGOTIABLE_PACKET_SIZE = 65507;
+// ACK 的数据部分可携带 4 字节的接收端通告窗口（分段数），旧版本的 ACK 不带数据
+constexpr int ACK_WINDOW_LENGTH = 4;
 
 class DataSegment {
  public:
@@ -19,7 +25,13 @@ class DataSegment {
   }
 
   char *SerializeToCharArray();
+  // 只写入 HEADER_LENGTH 字节的头部，数据部分由调用方直接放在其后
+  void SerializeHeader(char *buffer) const;
+  // 序列化后实际需要发送的字节数：头部 + 数据
+  int PacketSize() const { return HEADER_LENGTH + length_; }
   void DeserializeToDataSegment(unsigned char *data_segment, int length);
+  // 只解析 HEADER_LENGTH 字节的头部，不分配 data_（数据部分已由调用方放到别处）
+  void DeserializeHeader(const unsigned char *buffer);
 
   int seq_number_;
   int ack_number_;
@@ -29,9 +41,9 @@ class DataSegment {
   char *data_ = nullptr;
 
  private:
-  uint32_t convert_to_uint32(unsigned char *buffer, int start_index);
-  bool convert_to_bool(unsigned char *buffer, int index);
-  uint16_t convert_to_uint16(unsigned char *buffer, int start_index);
+  uint32_t convert_to_uint32(const unsigned char *buffer, int start_index);
+  bool convert_to_bool(const unsigned char *buffer, int index);
+  uint16_t convert_to_uint16(const unsigned char *buffer, int start_index);
   char *final_packet_ = nullptr;
 };
 }  // namespace safe_udp
\ No newline at end of file
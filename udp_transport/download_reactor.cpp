@@ -0,0 +1,125 @@
+#include "download_reactor.h"
+
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include <glog/logging.h>
+
+namespace safe_udp {
+namespace {
+constexpr int MAX_EPOLL_EVENTS = 256;
+}  // namespace
+
+DownloadReactor::DownloadReactor() {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ < 0) {
+    LOG(ERROR) << "Failed to epoll_create1 !!!";
+  }
+}
+
+DownloadReactor::~DownloadReactor() {
+  if (epoll_fd_ >= 0) {
+    close(epoll_fd_);
+  }
+}
+
+bool DownloadReactor::Add(UdpClient *client, const std::string &file_name,
+                          UdpClient::CompletionCallback on_complete) {
+  if (client->status() == DownloadStatus::HANDSHAKE ||
+      client->status() == DownloadStatus::TRANSFER) {
+    LOG(ERROR) << "Client already has a download in progress";
+    return false;
+  }
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.ptr = client;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, client->fd(), &event) < 0) {
+    LOG(ERROR) << "Failed to add download to epoll !!!";
+    return false;
+  }
+
+  // 完成通知先进入队列，等 client 从 epoll 移除后再回调用户
+  client->on_complete_ = [this, client](DownloadStatus status) {
+    completed_.emplace_back(client, status);
+  };
+  clients_.push_back(Entry{client, std::move(on_complete)});
+  if (!client->StartDownload(file_name, NowMicros())) {
+    // 启动失败时撤销注册，也不再回调
+    clients_.pop_back();
+    completed_.erase(std::remove_if(completed_.begin(), completed_.end(),
+                                    [client](const std::pair<UdpClient *, DownloadStatus> &item) {
+                                      return item.first == client;
+                                    }),
+                     completed_.end());
+    client->on_complete_ = nullptr;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, client->fd(), NULL);
+    return false;
+  }
+  return true;
+}
+
+int DownloadReactor::RunOnce(int64_t max_wait_us) {
+  dispatch_completed();
+  if (clients_.empty()) {
+    return 0;
+  }
+
+  int64_t now = NowMicros();
+  int64_t wakeup = now + max_wait_us;
+  for (const Entry &entry : clients_) {
+    wakeup = std::min(wakeup, entry.client->NextTimeoutUs());
+  }
+  int64_t wait_us = std::max<int64_t>(wakeup - now, 0);
+
+  struct epoll_event events[MAX_EPOLL_EVENTS];
+  int ready = epoll_wait(epoll_fd_, events, MAX_EPOLL_EVENTS,
+                         static_cast<int>((wait_us + 999) / 1000));
+  now = NowMicros();
+  for (int i = 0; i < ready; i++) {
+    step(static_cast<UdpClient *>(events[i].data.ptr), now);
+  }
+  // 到期的定时器（握手重传、截止时间、空闲超时）
+  for (size_t i = 0; i < clients_.size(); i++) {
+    if (now >= clients_[i].client->NextTimeoutUs()) {
+      step(clients_[i].client, now);
+    }
+  }
+
+  dispatch_completed();
+  return clients_.size();
+}
+
+void DownloadReactor::Run() {
+  while (RunOnce(DEFAULT_IDLE_TIMEOUT_US) > 0 || !completed_.empty()) {
+  }
+}
+
+void DownloadReactor::step(UdpClient *client, int64_t now_us) {
+  if (!client->IsFinished()) {
+    client->Step(now_us);
+  }
+}
+
+void DownloadReactor::dispatch_completed() {
+  while (!completed_.empty()) {
+    std::vector<std::pair<UdpClient *, DownloadStatus>> completed;
+    completed.swap(completed_);
+    for (const auto &item : completed) {
+      auto it = std::find_if(clients_.begin(), clients_.end(),
+                             [&item](const Entry &entry) {
+                               return entry.client == item.first;
+                             });
+      if (it == clients_.end()) {
+        continue;
+      }
+      UdpClient::CompletionCallback on_complete = std::move(it->on_complete);
+      epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, item.first->fd(), NULL);
+      clients_.erase(it);
+      if (on_complete) {
+        on_complete(item.second);
+      }
+    }
+  }
+}
+}  // namespace safe_udp
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "udp_client.h"
+
+namespace safe_udp {
+// 基于 epoll 的单线程下载调度：一个线程同时驱动任意多个 UdpClient。
+// 也可以不用它，直接把 UdpClient::fd() 注册到已有的事件循环中
+class DownloadReactor {
+ public:
+  DownloadReactor();
+  ~DownloadReactor();
+
+  // 开始下载并注册到 epoll。client 必须已经 CreateSocketAndServerConnection，
+  // 且在完成回调之前保持有效；回调在 client 从 reactor 移除之后才调用，
+  // 因此回调中可以安全地销毁 client 或继续添加新的下载。
+  // client 已有下载在进行或启动失败时返回 false，此时不注册也不会回调
+  bool Add(UdpClient *client, const std::string &file_name,
+           UdpClient::CompletionCallback on_complete);
+
+  // 处理一轮就绪事件和到期定时器，最多等待 max_wait_us，返回仍在进行的下载数
+  int RunOnce(int64_t max_wait_us);
+  // 运行直到所有下载结束
+  void Run();
+
+  int pending() const { return clients_.size(); }
+
+ private:
+  struct Entry {
+    UdpClient *client;
+    UdpClient::CompletionCallback on_complete;
+  };
+
+  void step(UdpClient *client, int64_t now_us);
+  void dispatch_completed();
+
+  int epoll_fd_;
+  std::vector<Entry> clients_;
+  std::vector<std::pair<UdpClient *, DownloadStatus>> completed_;
+};
+}  // namespace safe_udp
@@ -0,0 +1,65 @@
+#pragma once
+
+// C++20 协程封装，只在以 -std=c++20 编译的代码中可用：
+//   safe_udp::DetachedTask fetch(DownloadReactor *reactor, UdpClient *client) {
+//     DownloadStatus status = co_await safe_udp::Download(reactor, client, "a.txt");
+//   }
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#include <exception>
+#include <string>
+#include <utility>
+
+#include "download_reactor.h"
+
+namespace safe_udp {
+class DownloadAwaitable {
+ public:
+  DownloadAwaitable(DownloadReactor *reactor, UdpClient *client,
+                    std::string file_name)
+      : reactor_(reactor),
+        client_(client),
+        file_name_(std::move(file_name)),
+        status_(DownloadStatus::IDLE) {}
+
+  bool await_ready() const noexcept { return false; }
+
+  // 恢复协程总是在 reactor 的事件循环中进行，不会在 await_suspend 内部同步恢复；
+  // 无法开始下载时不挂起，直接得到 FAILED
+  bool await_suspend(std::coroutine_handle<> handle) {
+    bool added = reactor_->Add(client_, file_name_, [this, handle](DownloadStatus status) {
+      status_ = status;
+      handle.resume();
+    });
+    if (!added) {
+      status_ = DownloadStatus::FAILED;
+    }
+    return added;
+  }
+
+  DownloadStatus await_resume() const noexcept { return status_; }
+
+ private:
+  DownloadReactor *reactor_;
+  UdpClient *client_;
+  std::string file_name_;
+  DownloadStatus status_;
+};
+
+inline DownloadAwaitable Download(DownloadReactor *reactor, UdpClient *client,
+                                  std::string file_name) {
+  return DownloadAwaitable(reactor, client, std::move(file_name));
+}
+
+// 立即开始执行、结束后自行销毁的协程返回类型
+struct DetachedTask {
+  struct promise_type {
+    DetachedTask get_return_object() noexcept { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() noexcept {}
+    void unhandled_exception() noexcept { std::terminate(); }
+  };
+};
+}  // namespace safe_udp
+#endif
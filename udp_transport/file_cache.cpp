@@ -0,0 +1,300 @@
+#include "file_cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include <glog/logging.h>
+
+namespace safe_udp {
+namespace {
+int64_t mtime_ns(const struct stat &info) {
+  return static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 +
+         info.st_mtim.tv_nsec;
+}
+
+// 读满 length 字节，遇到 EOF 或错误时返回已读取的字节数
+int64_t pread_fully(int fd, char *buffer, int64_t length, int64_t offset) {
+  int64_t done = 0;
+  while (done < length) {
+    ssize_t n = pread(fd, buffer + done, length - done, offset + done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    done += n;
+  }
+  return done;
+}
+}  // namespace
+
+CachedFile::CachedFile(FileCache *cache, uint64_t id, int fd,
+                       const struct stat &info) {
+  cache_ = cache;
+  id_ = id;
+  fd_ = fd;
+  length_ = info.st_size;
+  device_ = info.st_dev;
+  inode_ = info.st_ino;
+  mtime_ns_ = mtime_ns(info);
+}
+
+CachedFile::~CachedFile() { close(fd_); }
+
+int CachedFile::Read(int64_t offset, int length, char *buffer) {
+  length = static_cast<int>(std::max<int64_t>(
+      std::min<int64_t>(length, length_ - offset), 0));
+  if (cache_->capacity() <= 0) {
+    return pread_fully(fd_, buffer, length, offset);
+  }
+
+  int copied = 0;
+  while (copied < length) {
+    int64_t position = offset + copied;
+    int64_t index = position / FILE_CACHE_CHUNK_SIZE;
+    std::shared_ptr<const FileChunk> chunk = load_chunk(index, false);
+    int64_t chunk_offset = position - index * FILE_CACHE_CHUNK_SIZE;
+    int64_t available =
+        static_cast<int64_t>(chunk->data.size()) - chunk_offset;
+    if (available <= 0) {
+      break;  // 文件在打开之后被截断
+    }
+    int n = static_cast<int>(std::min<int64_t>(available, length - copied));
+    memcpy(buffer + copied, chunk->data.data() + chunk_offset, n);
+    copied += n;
+  }
+  return copied;
+}
+
+void CachedFile::Prefetch(int64_t offset, int64_t length) {
+  if (cache_->capacity() <= 0 || offset >= length_) {
+    return;
+  }
+  int64_t end = std::min(offset + length, length_);
+  // 预读量不超过缓存容量的一半，避免把自己正要用的块挤出去
+  end = std::min(end, offset + cache_->capacity() / 2);
+  for (int64_t index = offset / FILE_CACHE_CHUNK_SIZE;
+       index * FILE_CACHE_CHUNK_SIZE < end; index++) {
+    cache_->enqueue_prefetch(shared_from_this(), index);
+  }
+}
+
+std::shared_ptr<const FileChunk> CachedFile::load_chunk(int64_t index, bool prefetch) {
+  FileCache::ChunkKey key{id_, index};
+  std::shared_ptr<const FileChunk> chunk = cache_->lookup(key, !prefetch);
+  if (chunk) {
+    return chunk;
+  }
+  // 在锁外读取；并发未命中时可能重复读取同一块，insert 保留先到者
+  auto loaded = std::make_shared<FileChunk>();
+  int64_t start = index * FILE_CACHE_CHUNK_SIZE;
+  loaded->data.resize(std::max<int64_t>(
+      std::min(FILE_CACHE_CHUNK_SIZE, length_ - start), 0));
+  loaded->data.resize(
+      pread_fully(fd_, loaded->data.data(), loaded->data.size(), start));
+  cache_->insert(key, loaded);
+  if (prefetch) {
+    cache_->prefetched_chunks_++;
+  }
+  return loaded;
+}
+
+FileCache &FileCache::Instance() {
+  static FileCache *cache = [] {
+    int64_t capacity = DEFAULT_FILE_CACHE_CAPACITY;
+    const char *value = getenv("SAFE_UDP_FILE_CACHE_MB");
+    if (value != nullptr) {
+      capacity = atoll(value) * 1024 * 1024;
+    }
+    return new FileCache(capacity);
+  }();
+  return *cache;
+}
+
+FileCache::FileCache(int64_t capacity_bytes) {
+  capacity_bytes_.store(capacity_bytes);
+  cached_bytes_ = 0;
+  next_file_id_ = 1;
+  stopped_ = false;
+}
+
+FileCache::~FileCache() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopped_ = true;
+  }
+  prefetch_cv_.notify_all();
+  if (prefetch_thread_.joinable()) {
+    prefetch_thread_.join();
+  }
+}
+
+std::shared_ptr<CachedFile> FileCache::Open(const std::string &path) {
+  struct stat info;
+  if (stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+    return nullptr;
+  }
+
+  auto unchanged = [](const FileEntry &entry, const struct stat &info) {
+    return entry.device == info.st_dev && entry.inode == info.st_ino &&
+           entry.mtime_ns == mtime_ns(info) && entry.length == info.st_size;
+  };
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  sweep_files_locked();
+  uint64_t id = 0;
+  auto it = files_.find(path);
+  if (it != files_.end()) {
+    if (unchanged(it->second, info)) {
+      std::shared_ptr<CachedFile> file = it->second.file.lock();
+      if (file) {
+        return file;
+      }
+      id = it->second.id;
+    } else {
+      // 文件已被修改：旧内容不再提供给新的会话，正在使用的会话仍持有旧句柄
+      LOG(INFO) << "File cache: " << path << " changed, dropping cached chunks";
+      drop_file_locked(it->second.id);
+      files_.erase(it);
+    }
+  }
+
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return nullptr;
+  }
+  // 以打开后的 fd 为准，避免 stat 与 open 之间文件被替换
+  fstat(fd, &info);
+  if (id != 0 && !unchanged(files_[path], info)) {
+    drop_file_locked(id);
+    id = 0;
+  }
+  if (id == 0) {
+    id = next_file_id_++;
+  }
+  auto file = std::make_shared<CachedFile>(this, id, fd, info);
+  files_[path] = FileEntry{file, id, info.st_dev, info.st_ino, mtime_ns(info),
+                           static_cast<int64_t>(info.st_size)};
+  return file;
+}
+
+void FileCache::sweep_files_locked() {
+  for (auto it = files_.begin(); it != files_.end();) {
+    if (it->second.file.expired() && file_chunks_.count(it->second.id) == 0) {
+      it = files_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void FileCache::SetCapacity(int64_t capacity_bytes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  capacity_bytes_.store(capacity_bytes);
+  evict_locked();
+}
+
+int64_t FileCache::cached_bytes() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return cached_bytes_;
+}
+
+std::shared_ptr<const FileChunk> FileCache::lookup(const ChunkKey &key, bool record) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = chunks_.find(key);
+  if (it == chunks_.end()) {
+    if (record) {
+      misses_++;
+    }
+    return nullptr;
+  }
+  if (record) {
+    hits_++;
+  }
+  lru_.splice(lru_.begin(), lru_, it->second.lru_position);
+  return it->second.chunk;
+}
+
+void FileCache::insert(const ChunkKey &key,
+                       std::shared_ptr<const FileChunk> chunk) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (chunks_.count(key) != 0 || capacity_bytes_ <= 0) {
+    return;
+  }
+  lru_.push_front(key);
+  cached_bytes_ += chunk->data.size();
+  file_chunks_[key.file_id]++;
+  chunks_[key] = Entry{std::move(chunk), lru_.begin()};
+  evict_locked();
+}
+
+void FileCache::remove_chunk_locked(
+    std::unordered_map<ChunkKey, Entry, ChunkKeyHash>::iterator it) {
+  cached_bytes_ -= it->second.chunk->data.size();
+  auto count = file_chunks_.find(it->first.file_id);
+  if (--count->second == 0) {
+    file_chunks_.erase(count);
+  }
+  lru_.erase(it->second.lru_position);
+  chunks_.erase(it);
+}
+
+void FileCache::evict_locked() {
+  while (cached_bytes_ > capacity_bytes_ && !lru_.empty()) {
+    remove_chunk_locked(chunks_.find(lru_.back()));
+    evictions_++;
+  }
+}
+
+void FileCache::drop_file_locked(uint64_t file_id) {
+  for (auto it = lru_.begin(); it != lru_.end();) {
+    ChunkKey key = *it++;
+    if (key.file_id == file_id) {
+      remove_chunk_locked(chunks_.find(key));
+    }
+  }
+}
+
+void FileCache::enqueue_prefetch(const std::shared_ptr<CachedFile> &file,
+                                 int64_t index) {
+  ChunkKey key{file->id_, index};
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopped_ || chunks_.count(key) != 0 ||
+        !prefetch_pending_.insert(key).second) {
+      return;
+    }
+    prefetch_queue_.emplace_back(file, index);
+    if (!prefetch_thread_.joinable()) {
+      prefetch_thread_ = std::thread(&FileCache::prefetch_loop, this);
+    }
+  }
+  prefetch_cv_.notify_one();
+}
+
+void FileCache::prefetch_loop() {
+  while (true) {
+    std::shared_ptr<CachedFile> file;
+    int64_t index;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      prefetch_cv_.wait(lock,
+                        [this] { return stopped_ || !prefetch_queue_.empty(); });
+      if (stopped_) {
+        return;
+      }
+      file = std::move(prefetch_queue_.front().first);
+      index = prefetch_queue_.front().second;
+      prefetch_queue_.pop_front();
+    }
+    file->load_chunk(index, true);
+    std::lock_guard<std::mutex> lock(mutex_);
+    prefetch_pending_.erase(ChunkKey{file->id_, index});
+  }
+}
+}  // namespace safe_udp
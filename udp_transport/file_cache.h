@@ -0,0 +1,145 @@
+#pragma once
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "metrics.h"
+
+// 进程内共享的热点文件缓存：文件按固定大小分块缓存在内存中，
+// 多个会话请求同一文件时直接从内存取数据，发送与重传不再逐包访问文件系统。
+namespace safe_udp {
+constexpr int64_t FILE_CACHE_CHUNK_SIZE = 256 * 1024;
+// 默认容量，可通过 SAFE_UDP_FILE_CACHE_MB 修改，0 表示关闭缓存（每次直接 pread）
+constexpr int64_t DEFAULT_FILE_CACHE_CAPACITY = 256LL * 1024 * 1024;
+
+// 分块数据由 shared_ptr 引用计数：被淘汰的块在最后一个持有者释放前仍然有效
+struct FileChunk {
+  std::vector<char> data;
+};
+
+class FileCache;
+
+// 打开的文件句柄，同一路径且 mtime/大小未变化时由所有会话共享，
+// 最后一个会话释放后关闭；缓存中的块按文件编号保留，再次打开时继续命中
+class CachedFile : public std::enable_shared_from_this<CachedFile> {
+ public:
+  CachedFile(FileCache *cache, uint64_t id, int fd, const struct stat &info);
+  ~CachedFile();
+
+  int64_t length() const { return length_; }
+  int fd() const { return fd_; }
+  // 读取 [offset, offset + length)，返回实际读取的字节数
+  int Read(int64_t offset, int length, char *buffer);
+  // 异步预读 [offset, offset + length) 覆盖的分块
+  void Prefetch(int64_t offset, int64_t length);
+
+ private:
+  friend class FileCache;
+
+  // prefetch 为 true 时是预读线程在加载，不计入命中/未命中
+  std::shared_ptr<const FileChunk> load_chunk(int64_t index, bool prefetch);
+
+  FileCache *cache_;
+  uint64_t id_;
+  int fd_;
+  int64_t length_;
+  dev_t device_;
+  ino_t inode_;
+  int64_t mtime_ns_;
+};
+
+class FileCache {
+ public:
+  static FileCache &Instance();
+
+  explicit FileCache(int64_t capacity_bytes);
+  ~FileCache();
+
+  // 文件不存在或无法读取时返回 nullptr
+  std::shared_ptr<CachedFile> Open(const std::string &path);
+  void SetCapacity(int64_t capacity_bytes);
+  int64_t capacity() const { return capacity_bytes_.load(std::memory_order_relaxed); }
+  int64_t cached_bytes();
+
+  // 命中/未命中只统计会话的读取；预读实际加载的块计入 prefetched_chunks_
+  Counter hits_;
+  Counter misses_;
+  Counter evictions_;
+  Counter prefetched_chunks_;
+
+ private:
+  friend class CachedFile;
+
+  struct ChunkKey {
+    uint64_t file_id;
+    int64_t index;
+    bool operator==(const ChunkKey &other) const {
+      return file_id == other.file_id && index == other.index;
+    }
+    bool operator<(const ChunkKey &other) const {
+      return file_id != other.file_id ? file_id < other.file_id
+                                      : index < other.index;
+    }
+  };
+  struct ChunkKeyHash {
+    size_t operator()(const ChunkKey &key) const {
+      return std::hash<uint64_t>()(key.file_id * 1000003 + key.index);
+    }
+  };
+  struct Entry {
+    std::shared_ptr<const FileChunk> chunk;
+    std::list<ChunkKey>::iterator lru_position;
+  };
+  // 不持有文件句柄，没有会话使用时 fd 随 CachedFile 关闭；
+  // 文件未变化时再次打开沿用同一编号，已缓存的块仍然有效
+  struct FileEntry {
+    std::weak_ptr<CachedFile> file;
+    uint64_t id;
+    dev_t device;
+    ino_t inode;
+    int64_t mtime_ns;
+    int64_t length;
+  };
+
+  std::shared_ptr<const FileChunk> lookup(const ChunkKey &key, bool record);
+  void insert(const ChunkKey &key, std::shared_ptr<const FileChunk> chunk);
+  void remove_chunk_locked(std::unordered_map<ChunkKey, Entry, ChunkKeyHash>::iterator it);
+  void evict_locked();
+  void drop_file_locked(uint64_t file_id);
+  // 清除既没有会话也没有缓存块的文件记录
+  void sweep_files_locked();
+  void enqueue_prefetch(const std::shared_ptr<CachedFile> &file, int64_t index);
+  void prefetch_loop();
+
+  std::mutex mutex_;
+  std::atomic<int64_t> capacity_bytes_;
+  int64_t cached_bytes_;
+  uint64_t next_file_id_;
+  // 最近使用的块在链表头部
+  std::list<ChunkKey> lru_;
+  std::unordered_map<ChunkKey, Entry, ChunkKeyHash> chunks_;
+  std::unordered_map<std::string, FileEntry> files_;
+  // 每个文件编号当前缓存的块数
+  std::unordered_map<uint64_t, int64_t> file_chunks_;
+
+  std::thread prefetch_thread_;
+  std::condition_variable prefetch_cv_;
+  std::deque<std::pair<std::shared_ptr<CachedFile>, int64_t>> prefetch_queue_;
+  std::set<ChunkKey> prefetch_pending_;
+  bool stopped_;
+};
+}  // namespace safe_udp
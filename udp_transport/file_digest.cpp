@@ -0,0 +1,128 @@
+#include "file_digest.h"
+
+#include <string.h>
+#include <algorithm>
+
+namespace safe_udp {
+namespace {
+constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t rotate_left(uint64_t value, int bits) {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+inline uint64_t read_uint64(const char *buffer) {
+  uint64_t value;
+  memcpy(&value, buffer, sizeof(value));
+  return value;
+}
+
+inline uint32_t read_uint32(const char *buffer) {
+  uint32_t value;
+  memcpy(&value, buffer, sizeof(value));
+  return value;
+}
+
+inline uint64_t mix_lane(uint64_t lane, uint64_t input) {
+  lane += input * PRIME2;
+  lane = rotate_left(lane, 31);
+  return lane * PRIME1;
+}
+
+inline uint64_t merge_round(uint64_t hash, uint64_t lane) {
+  hash ^= mix_lane(0, lane);
+  return hash * PRIME1 + PRIME4;
+}
+
+// 处理尽可能多的 32 字节条带，返回消耗的字节数。四条链互不依赖，乘法可以并行发射
+size_t consume_stripes(uint64_t *lanes, const char *data, size_t length) {
+  uint64_t v1 = lanes[0], v2 = lanes[1], v3 = lanes[2], v4 = lanes[3];
+  const char *p = data;
+  const char *end = data + (length & ~static_cast<size_t>(31));
+  while (p < end) {
+    v1 = mix_lane(v1, read_uint64(p));
+    v2 = mix_lane(v2, read_uint64(p + 8));
+    v3 = mix_lane(v3, read_uint64(p + 16));
+    v4 = mix_lane(v4, read_uint64(p + 24));
+    p += 32;
+  }
+  lanes[0] = v1;
+  lanes[1] = v2;
+  lanes[2] = v3;
+  lanes[3] = v4;
+  return p - data;
+}
+}  // namespace
+
+FileDigest::FileDigest() : total_length_(0), buffered_(0) {
+  lanes_[0] = PRIME1 + PRIME2;
+  lanes_[1] = PRIME2;
+  lanes_[2] = 0;
+  lanes_[3] = 0 - PRIME1;
+}
+
+void FileDigest::Update(const char *data, size_t length) {
+  total_length_ += length;
+  if (buffered_ > 0) {
+    size_t n = std::min<size_t>(sizeof(buffer_) - buffered_, length);
+    memcpy(buffer_ + buffered_, data, n);
+    buffered_ += n;
+    data += n;
+    length -= n;
+    if (buffered_ < sizeof(buffer_)) {
+      return;
+    }
+    consume_stripes(lanes_, buffer_, sizeof(buffer_));
+    buffered_ = 0;
+  }
+  size_t consumed = consume_stripes(lanes_, data, length);
+  memcpy(buffer_, data + consumed, length - consumed);
+  buffered_ = length - consumed;
+}
+
+uint64_t FileDigest::Value() const {
+  uint64_t hash;
+  if (total_length_ >= 32) {
+    hash = rotate_left(lanes_[0], 1) + rotate_left(lanes_[1], 7) +
+           rotate_left(lanes_[2], 12) + rotate_left(lanes_[3], 18);
+    for (uint64_t lane : lanes_) {
+      hash = merge_round(hash, lane);
+    }
+  } else {
+    hash = lanes_[2] + PRIME5;
+  }
+  hash += total_length_;
+
+  const char *p = buffer_;
+  const char *end = buffer_ + buffered_;
+  for (; p + 8 <= end; p += 8) {
+    hash ^= mix_lane(0, read_uint64(p));
+    hash = rotate_left(hash, 27) * PRIME1 + PRIME4;
+  }
+  if (p + 4 <= end) {
+    hash ^= static_cast<uint64_t>(read_uint32(p)) * PRIME1;
+    hash = rotate_left(hash, 23) * PRIME2 + PRIME3;
+    p += 4;
+  }
+  for (; p < end; p++) {
+    hash ^= static_cast<uint64_t>(static_cast<unsigned char>(*p)) * PRIME5;
+    hash = rotate_left(hash, 11) * PRIME1;
+  }
+
+  hash ^= hash >> 33;
+  hash *= PRIME2;
+  hash ^= hash >> 29;
+  hash *= PRIME3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+void FileDigest::Serialize(char *out) const {
+  uint64_t value = Value();
+  memcpy(out, &value, sizeof(value));
+}
+}  // namespace safe_udp
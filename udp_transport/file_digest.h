@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// 传输内容的摘要：服务端在发送新数据时顺带计算，摘要作为数据流最后 DIGEST_LENGTH
+// 字节随 FIN 分段发出；客户端在按序写出数据时计算，结束时比较，不需要再读一遍文件。
+// 算法为 XXH64（种子 0），输出与 xxhash 库的 XXH64() 一致
+namespace safe_udp {
+constexpr int DIGEST_LENGTH = 8;
+
+class FileDigest {
+ public:
+  FileDigest();
+
+  void Update(const char *data, size_t length);
+  // 到目前为止输入数据的摘要，不影响继续 Update
+  uint64_t Value() const;
+  // 按主机字节序（小端）写出 DIGEST_LENGTH 字节，与握手报文一致
+  void Serialize(char *out) const;
+
+ private:
+  // 4 条独立的累加链，每次消耗 32 字节
+  uint64_t lanes_[4];
+  uint64_t total_length_;
+  char buffer_[32];
+  size_t buffered_;
+};
+}  // namespace safe_udp
@@ -0,0 +1,187 @@
+#include "handshake.h"
+
+#include <string.h>
+
+#include "segment_cipher.h"
+
+namespace safe_udp {
+namespace {
+// 与 DataSegment 一致，按主机字节序（小端）直接拷贝
+void append_uint32(std::string *out, uint32_t value) {
+  out->append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+uint32_t read_uint32(const char *buffer, int start_index) {
+  uint32_t value;
+  memcpy(&value, buffer + start_index, sizeof(value));
+  return value;
+}
+}  // namespace
+
+uint32_t PeekMagic(const char *buffer, int length) {
+  if (length < static_cast<int>(sizeof(uint32_t))) {
+    return 0;
+  }
+  return read_uint32(buffer, 0);
+}
+
+HandshakeRequest::HandshakeRequest() {
+  packet_size_ = 0;
+  receive_window_ = 0;
+  resume_offset_ = 0;
+  rtt_hint_us_ = 0;
+  congestion_control_ = CONGESTION_CONTROL_NEWRENO;
+  bundle_ = false;
+  digest_ = false;
+  encrypt_ = false;
+}
+
+// magic(4) | packet_size(4) | name_length(4) | file_name |
+// receive_window(4) | resume_offset(4) | rtt_hint_us(4) | congestion_control(1) |
+// bundle(1) | digest(1) | encrypt(1) | key_nonce(16，仅 encrypt 为 1 时)
+std::string HandshakeRequest::Serialize() const {
+  std::string out;
+  append_uint32(&out, HANDSHAKE_REQUEST_MAGIC);
+  append_uint32(&out, packet_size_);
+  append_uint32(&out, file_name_.size());
+  out.append(file_name_);
+  append_uint32(&out, receive_window_);
+  append_uint32(&out, resume_offset_);
+  append_uint32(&out, rtt_hint_us_);
+  out.push_back(static_cast<char>(congestion_control_));
+  out.push_back(bundle_ ? 1 : 0);
+  out.push_back(digest_ ? 1 : 0);
+  out.push_back(encrypt_ ? 1 : 0);
+  if (encrypt_) {
+    out.append(key_nonce_);
+  }
+  return out;
+}
+
+bool HandshakeRequest::Deserialize(const char *buffer, int length) {
+  if (length < 12 || PeekMagic(buffer, length) != HANDSHAKE_REQUEST_MAGIC) {
+    return false;
+  }
+  packet_size_ = read_uint32(buffer, 4);
+  uint32_t name_length = read_uint32(buffer, 8);
+  if (name_length > static_cast<uint32_t>(length - 12)) {
+    return false;
+  }
+  file_name_.assign(buffer + 12, name_length);
+  int extension = 12 + name_length;
+  if (length >= extension + 13) {
+    receive_window_ = read_uint32(buffer, extension);
+    resume_offset_ = read_uint32(buffer, extension + 4);
+    rtt_hint_us_ = read_uint32(buffer, extension + 8);
+    congestion_control_ = static_cast<uint8_t>(buffer[extension + 12]);
+  }
+  if (length >= extension + 14) {
+    bundle_ = buffer[extension + 13] != 0;
+  }
+  if (length >= extension + 15) {
+    digest_ = buffer[extension + 14] != 0;
+  }
+  if (length >= extension + 16) {
+    encrypt_ = buffer[extension + 15] != 0;
+    if (encrypt_ && length < extension + 16 + KEY_NONCE_LENGTH) {
+      return false;
+    }
+    if (encrypt_) {
+      key_nonce_.assign(buffer + extension + 16, KEY_NONCE_LENGTH);
+    }
+  }
+  return true;
+}
+
+HandshakeResponse::HandshakeResponse() {
+  packet_size_ = 0;
+  file_length_ = 0;
+  file_found_ = false;
+  initial_seq_number_ = 0;
+  resume_offset_ = 0;
+  initial_window_ = 0;
+  congestion_control_ = CONGESTION_CONTROL_NEWRENO;
+  bundle_ = false;
+  digest_ = false;
+  encrypted_ = false;
+  has_transfer_parameters_ = false;
+}
+
+// magic(4) | packet_size(4) | file_length(4) | file_found(1) |
+// initial_seq_number(4) | resume_offset(4) | initial_window(4) | congestion_control(1) |
+// bundle(1) | digest(1) | encrypted(1) | key_nonce(16，仅 encrypted 为 1 时)
+std::string HandshakeResponse::Serialize() const {
+  std::string out;
+  append_uint32(&out, HANDSHAKE_RESPONSE_MAGIC);
+  append_uint32(&out, packet_size_);
+  append_uint32(&out, static_cast<uint32_t>(file_length_));
+  out.push_back(file_found_ ? 1 : 0);
+  append_uint32(&out, initial_seq_number_);
+  append_uint32(&out, resume_offset_);
+  append_uint32(&out, initial_window_);
+  out.push_back(static_cast<char>(congestion_control_));
+  out.push_back(bundle_ ? 1 : 0);
+  out.push_back(digest_ ? 1 : 0);
+  out.push_back(encrypted_ ? 1 : 0);
+  if (encrypted_) {
+    out.append(key_nonce_);
+  }
+  return out;
+}
+
+bool HandshakeResponse::Deserialize(const char *buffer, int length) {
+  if (length < 13 || PeekMagic(buffer, length) != HANDSHAKE_RESPONSE_MAGIC) {
+    return false;
+  }
+  packet_size_ = read_uint32(buffer, 4);
+  file_length_ = static_cast<int32_t>(read_uint32(buffer, 8));
+  file_found_ = buffer[12] != 0;
+  has_transfer_parameters_ = length >= 26;
+  if (has_transfer_parameters_) {
+    initial_seq_number_ = read_uint32(buffer, 13);
+    resume_offset_ = read_uint32(buffer, 17);
+    initial_window_ = read_uint32(buffer, 21);
+    congestion_control_ = static_cast<uint8_t>(buffer[25]);
+  }
+  bundle_ = length >= 27 && buffer[26] != 0;
+  digest_ = length >= 28 && buffer[27] != 0;
+  encrypted_ = length >= 29 && buffer[28] != 0;
+  if (encrypted_ && length < 29 + KEY_NONCE_LENGTH) {
+    return false;
+  }
+  if (encrypted_) {
+    key_nonce_.assign(buffer + 29, KEY_NONCE_LENGTH);
+  }
+  return true;
+}
+
+MtuProbe::MtuProbe() {
+  is_ack_ = false;
+  probe_id_ = 0;
+  probe_size_ = 0;
+}
+
+// magic(4) | probe_id(4) | probe_size(4) | 填充到 probe_size 字节
+std::string MtuProbe::Serialize() const {
+  std::string out;
+  append_uint32(&out, is_ack_ ? MTU_PROBE_ACK_MAGIC : MTU_PROBE_MAGIC);
+  append_uint32(&out, probe_id_);
+  append_uint32(&out, probe_size_);
+  if (out.size() < probe_size_) {
+    out.resize(probe_size_, '\0');
+  }
+  return out;
+}
+
+bool MtuProbe::Deserialize(const char *buffer, int length) {
+  uint32_t magic = PeekMagic(buffer, length);
+  if (length < 12 || (magic != MTU_PROBE_MAGIC && magic != MTU_PROBE_ACK_MAGIC)) {
+    return false;
+  }
+  is_ack_ = magic == MTU_PROBE_ACK_MAGIC;
+  probe_id_ = read_uint32(buffer, 4);
+  probe_size_ = read_uint32(buffer, 8);
+  // 探测报文必须完整到达才算验证通过
+  return static_cast<uint32_t>(length) >= probe_size_;
+}
+}  // namespace safe_udp
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace safe_udp {
+// 握手报文都以 4 字节魔数开头，用于和旧版本的“裸文件名”请求以及 DataSegment 区分
+constexpr uint32_t HANDSHAKE_REQUEST_MAGIC = 0x53555251;   // "QRUS"
+constexpr uint32_t HANDSHAKE_RESPONSE_MAGIC = 0x53555253;  // "SRUS"
+constexpr uint32_t MTU_PROBE_MAGIC = 0x53555050;           // "PPUS"
+constexpr uint32_t MTU_PROBE_ACK_MAGIC = 0x53555041;       // "AUPS"
+
+// 旧版本双方约定的固定初始序号；握手应答携带服务端随机选取的初始序号
+constexpr int DEFAULT_INITIAL_SEQ_NUMBER = 67;
+// 拥塞控制算法编号，客户端在请求中指定，服务端在应答中给出实际采用的算法
+constexpr uint8_t CONGESTION_CONTROL_NEWRENO = 0;
+
+// 读取报文开头的魔数，长度不足时返回 0
+uint32_t PeekMagic(const char *buffer, int length);
+
+// 客户端请求：文件名 + 期望的分段大小（探测得到的路径最大负载）以及传输参数。
+// 传输参数附加在文件名之后，旧服务端会忽略，旧客户端的请求没有这部分时取默认值
+class HandshakeRequest {
+ public:
+  HandshakeRequest();
+
+  std::string Serialize() const;
+  bool Deserialize(const char *buffer, int length);
+
+  uint32_t packet_size_;
+  std::string file_name_;
+  uint32_t receive_window_;  // 客户端接收窗口（分段数），0 表示未指定
+  uint32_t resume_offset_;   // 从该字节开始续传，0 表示完整下载
+  uint32_t rtt_hint_us_;     // 客户端已知的路径 RTT，0 表示未知
+  uint8_t congestion_control_;
+  // 为 true 时 file_name_ 是通配符或文件清单，请求打包传输（见 bundle.h）
+  bool bundle_;
+  // 请求服务端在数据流末尾附加内容摘要（见 file_digest.h）
+  bool digest_;
+  // 请求加密传输，key_nonce_ 为客户端的 KEY_NONCE_LENGTH 字节随机数（见 segment_cipher.h）
+  bool encrypt_;
+  std::string key_nonce_;
+};
+
+// 服务端应答：最终采用的分段大小、文件信息以及本次传输的参数，
+// 与第一个窗口的数据一起发出。扩展字段同样附加在末尾
+class HandshakeResponse {
+ public:
+  HandshakeResponse();
+
+  std::string Serialize() const;
+  bool Deserialize(const char *buffer, int length);
+
+  uint32_t packet_size_;
+  int32_t file_length_;  // 完整文件的大小
+  bool file_found_;
+  uint32_t initial_seq_number_;  // 数据段序号 = initial_seq_number_ + 传输内的字节偏移
+  uint32_t resume_offset_;       // 服务端接受的续传起点，数据从文件的该偏移开始
+  uint32_t initial_window_;      // 服务端的初始拥塞窗口（分段数）
+  uint8_t congestion_control_;
+  // 数据是打包的归档流，file_length_ 为流的长度；旧服务端不支持打包，总为 false
+  bool bundle_;
+  // 数据流末尾附加了 DIGEST_LENGTH 字节的摘要，不计入 file_length_
+  bool digest_;
+  // 数据段经 AES-128-GCM 加密，key_nonce_ 为服务端的随机数
+  bool encrypted_;
+  std::string key_nonce_;
+  // 旧服务端的应答不含扩展字段
+  bool has_transfer_parameters_;
+};
+
+// 路径 MTU 探测报文，报文本身按 probe_size_ 填充到待验证的大小
+class MtuProbe {
+ public:
+  MtuProbe();
+
+  std::string Serialize() const;
+  bool Deserialize(const char *buffer, int length);
+
+  bool is_ack_;
+  uint32_t probe_id_;
+  uint32_t probe_size_;
+};
+}  // namespace safe_udp
@@ -0,0 +1,252 @@
+#include "impairment_proxy.h"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <limits>
+
+#include <glog/logging.h>
+
+#include "data_segment.h"
+#include "packet_statistics.h"
+
+namespace safe_udp {
+namespace {
+constexpr int64_t MAX_IDLE_WAIT_US = 50000;  // 空闲时也定期检查 Stop()
+}  // namespace
+
+ImpairmentProxy::ImpairmentProxy(const std::string &server_host,
+                                 int server_port, uint64_t seed) {
+  sockfd_ = -1;
+  has_client_ = false;
+  stopped_.store(false);
+  next_order_ = 0;
+  directions_[0].random.seed(seed);
+  directions_[1].random.seed(seed + 1);
+
+  memset(&server_address_, 0, sizeof(server_address_));
+  memset(&client_address_, 0, sizeof(client_address_));
+  server_address_.sin_family = AF_INET;
+  server_address_.sin_port = htons(server_port);
+  struct hostent *server = gethostbyname(server_host.c_str());
+  if (server == NULL) {
+    LOG(ERROR) << "No such host " << server_host;
+  } else {
+    memcpy(&server_address_.sin_addr.s_addr, server->h_addr, server->h_length);
+  }
+}
+
+ImpairmentProxy::~ImpairmentProxy() {
+  if (sockfd_ >= 0) {
+    close(sockfd_);
+  }
+}
+
+int ImpairmentProxy::Start(int listen_port) {
+  sockfd_ = socket(AF_INET, SOCK_DGRAM, 0);
+  if (sockfd_ < 0) {
+    LOG(ERROR) << "Failed to socket !!!";
+    return -1;
+  }
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = inet_addr("127.0.0.1");
+  address.sin_port = htons(listen_port);
+  if (bind(sockfd_, (struct sockaddr *)&address, sizeof(address)) < 0) {
+    LOG(ERROR) << "binding error !!!";
+    return -1;
+  }
+  socklen_t length = sizeof(address);
+  getsockname(sockfd_, (struct sockaddr *)&address, &length);
+  LOG(INFO) << "Impairment proxy listening on port " << ntohs(address.sin_port);
+  return ntohs(address.sin_port);
+}
+
+void ImpairmentProxy::Run() {
+  std::vector<char> buffer(MAX_NEGOTIABLE_PACKET_SIZE);
+  while (!stopped_.load()) {
+    int64_t now = NowMicros();
+    release_from_shaper(true, now);
+    release_from_shaper(false, now);
+    deliver_due(now);
+
+    int64_t wait_us = std::max<int64_t>(next_wakeup_us(now) - now, 0);
+    struct timespec timeout;
+    timeout.tv_sec = wait_us / 1000000;
+    timeout.tv_nsec = (wait_us % 1000000) * 1000;
+    struct pollfd pfd;
+    pfd.fd = sockfd_;
+    pfd.events = POLLIN;
+    if (ppoll(&pfd, 1, &timeout, NULL) <= 0) {
+      continue;
+    }
+
+    struct sockaddr_in source;
+    socklen_t source_length = sizeof(source);
+    int n;
+    while ((n = recvfrom(sockfd_, buffer.data(), buffer.size(), MSG_DONTWAIT,
+                         (struct sockaddr *)&source, &source_length)) >= 0) {
+      bool from_server =
+          source.sin_addr.s_addr == server_address_.sin_addr.s_addr &&
+          source.sin_port == server_address_.sin_port;
+      if (!from_server && !has_client_) {
+        client_address_ = source;
+        has_client_ = true;
+        LOG(INFO) << "Impairment proxy serving client port " << ntohs(source.sin_port);
+      } else if (!from_server &&
+                 (source.sin_addr.s_addr != client_address_.sin_addr.s_addr ||
+                  source.sin_port != client_address_.sin_port)) {
+        // 只服务第一个客户端，其他来源的数据报直接丢弃，不能抢占回程方向
+        source_length = sizeof(source);
+        continue;
+      }
+      on_datagram(!from_server, std::string(buffer.data(), n), NowMicros());
+      source_length = sizeof(source);
+    }
+  }
+}
+
+double ImpairmentProxy::uniform(Direction *direction) {
+  return std::uniform_real_distribution<double>(0, 1)(direction->random);
+}
+
+void ImpairmentProxy::on_datagram(bool to_server, std::string data,
+                                  int64_t now) {
+  const ImpairmentConfig &config = to_server ? to_server_ : to_client_;
+  ImpairmentStats &stats = to_server ? to_server_stats_ : to_client_stats_;
+  Direction &direction = directions_[to_server ? 0 : 1];
+  stats.received++;
+
+  double loss = config.loss_rate;
+  if (config.ge_p_good_to_bad > 0) {
+    // 先做状态转移，再按当前状态的丢包率判定
+    if (!direction.ge_bad && uniform(&direction) < config.ge_p_good_to_bad) {
+      direction.ge_bad = true;
+    } else if (direction.ge_bad &&
+               uniform(&direction) < config.ge_p_bad_to_good) {
+      direction.ge_bad = false;
+    }
+    double ge_loss = direction.ge_bad ? config.ge_loss_bad : config.ge_loss_good;
+    loss = 1 - (1 - loss) * (1 - ge_loss);
+  }
+  if (uniform(&direction) < loss) {
+    stats.dropped_loss++;
+    return;
+  }
+
+  int copies = 1;
+  if (uniform(&direction) < config.duplicate_rate) {
+    copies = 2;
+    stats.duplicated++;
+  }
+  for (int i = 0; i < copies; i++) {
+    if (config.rate_bytes_per_sec <= 0) {
+      schedule(to_server, data, now);
+      continue;
+    }
+    if (config.queue_limit_bytes > 0 &&
+        direction.shaper_queue_bytes + static_cast<int64_t>(data.size()) >
+            config.queue_limit_bytes) {
+      stats.dropped_queue++;
+      continue;
+    }
+    direction.shaper_queue_bytes += data.size();
+    direction.shaper_queue.push_back(data);
+  }
+  release_from_shaper(to_server, now);
+}
+
+void ImpairmentProxy::release_from_shaper(bool to_server, int64_t now) {
+  const ImpairmentConfig &config = to_server ? to_server_ : to_client_;
+  Direction &direction = directions_[to_server ? 0 : 1];
+  if (config.rate_bytes_per_sec <= 0) {
+    return;
+  }
+  // 队列为空时不补充令牌，空闲期间的令牌在下一个数据报到达时一并补上并按桶深截断
+  if (direction.shaper_queue.empty()) {
+    return;
+  }
+  if (direction.last_refill_us == 0) {
+    direction.tokens = std::numeric_limits<double>::max();
+  } else {
+    direction.tokens += (now - direction.last_refill_us) *
+                        static_cast<double>(config.rate_bytes_per_sec) / 1e6;
+  }
+  direction.last_refill_us = now;
+
+  while (!direction.shaper_queue.empty()) {
+    double size = direction.shaper_queue.front().size();
+    // 桶深为 burst_bytes（0 时为一个数据报），比队首数据报小时放大到其大小，否则它永远发不出去
+    double burst = std::max<double>(config.burst_bytes > 0 ? config.burst_bytes : size, size);
+    direction.tokens = std::min(direction.tokens, burst);
+    if (direction.tokens < size) {
+      break;
+    }
+    std::string data = std::move(direction.shaper_queue.front());
+    direction.shaper_queue.pop_front();
+    direction.shaper_queue_bytes -= data.size();
+    direction.tokens -= data.size();
+    schedule(to_server, std::move(data), now);
+  }
+}
+
+void ImpairmentProxy::schedule(bool to_server, std::string data, int64_t now) {
+  const ImpairmentConfig &config = to_server ? to_server_ : to_client_;
+  ImpairmentStats &stats = to_server ? to_server_stats_ : to_client_stats_;
+  Direction &direction = directions_[to_server ? 0 : 1];
+
+  int64_t delay = config.delay_us;
+  if (config.jitter_us > 0) {
+    delay += static_cast<int64_t>(uniform(&direction) * config.jitter_us);
+  }
+  if (config.reorder_rate > 0 && uniform(&direction) < config.reorder_rate) {
+    delay += config.reorder_delay_us;
+    stats.reordered++;
+  }
+
+  Packet packet;
+  packet.due_us = now + delay;
+  packet.order = next_order_++;
+  packet.to_server = to_server;
+  packet.data = std::move(data);
+  in_flight_.push(std::move(packet));
+}
+
+void ImpairmentProxy::deliver_due(int64_t now) {
+  while (!in_flight_.empty() && in_flight_.top().due_us <= now) {
+    const Packet &packet = in_flight_.top();
+    if (packet.to_server) {
+      sendto(sockfd_, packet.data.data(), packet.data.size(), 0,
+             (struct sockaddr *)&server_address_, sizeof(server_address_));
+      to_server_stats_.forwarded++;
+    } else if (has_client_) {
+      sendto(sockfd_, packet.data.data(), packet.data.size(), 0,
+             (struct sockaddr *)&client_address_, sizeof(client_address_));
+      to_client_stats_.forwarded++;
+    }
+    in_flight_.pop();
+  }
+}
+
+int64_t ImpairmentProxy::next_wakeup_us(int64_t now) {
+  int64_t wakeup = now + MAX_IDLE_WAIT_US;
+  if (!in_flight_.empty()) {
+    wakeup = std::min(wakeup, in_flight_.top().due_us);
+  }
+  for (int i = 0; i < 2; i++) {
+    const ImpairmentConfig &config = i == 0 ? to_server_ : to_client_;
+    const Direction &direction = directions_[i];
+    if (config.rate_bytes_per_sec > 0 && !direction.shaper_queue.empty()) {
+      double missing = direction.shaper_queue.front().size() - direction.tokens;
+      wakeup = std::min(wakeup, now + static_cast<int64_t>(
+                                          missing * 1e6 / config.rate_bytes_per_sec) + 1);
+    }
+  }
+  return wakeup;
+}
+}  // namespace safe_udp
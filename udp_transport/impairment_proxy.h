@@ -0,0 +1,100 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace safe_udp {
+// 单个方向的网络损伤参数，概率均为 0-1
+struct ImpairmentConfig {
+  double loss_rate = 0;  // 独立随机丢包
+  // Gilbert-Elliott 突发丢包：good/bad 两状态马尔可夫链，p_good_to_bad 为 0 时关闭
+  double ge_p_good_to_bad = 0;
+  double ge_p_bad_to_good = 0;
+  double ge_loss_good = 0;
+  double ge_loss_bad = 1;
+  double duplicate_rate = 0;
+  double reorder_rate = 0;    // 被选中的包额外延迟 reorder_delay_us，从而落到后续包之后
+  int reorder_delay_us = 0;
+  int delay_us = 0;           // 基础单向时延
+  int jitter_us = 0;          // 在 [0, jitter_us] 内均匀分布的额外时延
+  int64_t rate_bytes_per_sec = 0;  // 令牌桶速率，0 表示不限速
+  int burst_bytes = 0;             // 令牌桶深度，0 时取一个数据报大小
+  int queue_limit_bytes = 0;       // 等待令牌的队列上限，超出尾部丢弃；0 表示不限
+};
+
+struct ImpairmentStats {
+  int64_t received = 0;
+  int64_t forwarded = 0;
+  int64_t dropped_loss = 0;
+  int64_t dropped_queue = 0;
+  int64_t duplicated = 0;
+  int64_t reordered = 0;
+};
+
+// 位于客户端与服务端之间的 UDP 损伤代理：客户端把代理当作服务端，
+// 代理对两个方向分别施加可复现（固定随机种子）的丢包、突发丢包、乱序、重复、
+// 抖动以及令牌桶带宽/队列限制，接收端本身不受影响。
+// 只服务一个客户端：第一个非服务端来源的地址，之后其他来源的数据报被丢弃
+class ImpairmentProxy {
+ public:
+  ImpairmentProxy(const std::string &server_host, int server_port,
+                  uint64_t seed);
+  ~ImpairmentProxy();
+
+  // 绑定 127.0.0.1:listen_port（0 表示由内核分配），返回实际端口，失败返回 -1
+  int Start(int listen_port);
+  // 事件循环，直到 Stop() 被调用
+  void Run();
+  void Stop() { stopped_.store(true); }
+
+  ImpairmentConfig to_server_;
+  ImpairmentConfig to_client_;
+  ImpairmentStats to_server_stats_;
+  ImpairmentStats to_client_stats_;
+
+ private:
+  struct Packet {
+    int64_t due_us;
+    uint64_t order;  // 同一时刻按到达顺序发出
+    bool to_server;
+    std::string data;
+    bool operator>(const Packet &other) const {
+      return due_us != other.due_us ? due_us > other.due_us
+                                    : order > other.order;
+    }
+  };
+
+  // 每个方向的独立状态：随机数、Gilbert-Elliott 状态、令牌桶
+  struct Direction {
+    std::mt19937_64 random;
+    bool ge_bad = false;
+    double tokens = 0;
+    int64_t last_refill_us = 0;
+    std::deque<std::string> shaper_queue;
+    int64_t shaper_queue_bytes = 0;
+  };
+
+  void on_datagram(bool to_server, std::string data, int64_t now);
+  void release_from_shaper(bool to_server, int64_t now);
+  void schedule(bool to_server, std::string data, int64_t now);
+  void deliver_due(int64_t now);
+  int64_t next_wakeup_us(int64_t now);
+  double uniform(Direction *direction);
+
+  int sockfd_;
+  struct sockaddr_in server_address_;
+  struct sockaddr_in client_address_;
+  bool has_client_;
+  std::atomic<bool> stopped_;
+  uint64_t next_order_;
+  Direction directions_[2];  // 0: 发往服务端，1: 发往客户端
+  std::priority_queue<Packet, std::vector<Packet>, std::greater<Packet>>
+      in_flight_;
+};
+}  // namespace safe_udp
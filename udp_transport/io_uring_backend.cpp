@@ -0,0 +1,482 @@
+#include "io_uring_backend.h"
+
+#if defined(SAFE_UDP_IO_URING)
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include <glog/logging.h>
+
+#include "packet_statistics.h"
+#include "socket_buffer.h"
+
+namespace safe_udp {
+namespace {
+constexpr unsigned RING_ENTRIES = 512;
+constexpr int RECEIVE_BUFFER_COUNT = 64;  // 必须是 2 的幂
+constexpr int RECEIVE_BUFFER_SIZE = 2048;
+constexpr uint16_t RECEIVE_BUFFER_GROUP = 1;
+constexpr int REGISTERED_SOCKET_INDEX = 0;
+
+int io_uring_setup(unsigned entries, struct io_uring_params *params) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int io_uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete,
+                   unsigned flags, const void *arg, size_t arg_size) {
+  return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit,
+                                  min_complete, flags, arg, arg_size));
+}
+
+int io_uring_register(int ring_fd, unsigned opcode, const void *arg,
+                      unsigned count) {
+  return static_cast<int>(
+      syscall(__NR_io_uring_register, ring_fd, opcode, arg, count));
+}
+
+uint64_t make_user_data(uint32_t kind, uint32_t index) {
+  return (static_cast<uint64_t>(kind) << 32) | index;
+}
+
+unsigned load_acquire(const unsigned *value) {
+  return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
+
+void store_release(unsigned *value, unsigned new_value) {
+  __atomic_store_n(value, new_value, __ATOMIC_RELEASE);
+}
+}  // namespace
+
+std::unique_ptr<IoUringBackend> IoUringBackend::Create(int sockfd,
+                                                       int slot_size,
+                                                       int slot_count) {
+  std::unique_ptr<IoUringBackend> backend(new IoUringBackend());
+  if (!backend->setup(sockfd, slot_size, slot_count)) {
+    return nullptr;
+  }
+  return backend;
+}
+
+IoUringBackend::IoUringBackend() {
+  ring_fd_ = -1;
+  sq_entries_ = 0;
+  sq_ring_ = MAP_FAILED;
+  cq_ring_ = MAP_FAILED;
+  sq_ring_size_ = 0;
+  cq_ring_size_ = 0;
+  sqes_ = reinterpret_cast<struct io_uring_sqe *>(MAP_FAILED);
+  sqe_tail_ = 0;
+  to_submit_ = 0;
+  slot_size_ = 0;
+  send_pool_ = nullptr;
+  receive_ring_ = reinterpret_cast<struct io_uring_buf_ring *>(MAP_FAILED);
+  receive_ring_size_ = 0;
+  receive_pool_ = nullptr;
+  memset(&receive_message_, 0, sizeof(receive_message_));
+  receive_armed_ = false;
+  failed_ = false;
+  kernel_drop_count_ = 0;
+  enter_calls_ = 0;
+  submitted_ops_ = 0;
+}
+
+IoUringBackend::~IoUringBackend() {
+  // 等待在途的发送完成，避免内核仍在引用即将释放的缓冲区
+  int64_t waited = 0;
+  while (!failed_ && ring_fd_ >= 0 &&
+         free_slots_.size() < send_messages_.size() && waited < 1000000) {
+    enter(1, 10000);
+    reap();
+    waited += 10000;
+  }
+  if (ring_fd_ >= 0) {
+    close(ring_fd_);
+  }
+  if (sqes_ != MAP_FAILED) {
+    munmap(sqes_, sq_entries_ * sizeof(struct io_uring_sqe));
+  }
+  if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+    munmap(cq_ring_, cq_ring_size_);
+  }
+  if (sq_ring_ != MAP_FAILED) {
+    munmap(sq_ring_, sq_ring_size_);
+  }
+  if (receive_ring_ != MAP_FAILED) {
+    munmap(receive_ring_, receive_ring_size_);
+  }
+  free(send_pool_);
+  free(receive_pool_);
+}
+
+bool IoUringBackend::setup(int sockfd, int slot_size, int slot_count) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ring_fd_ = io_uring_setup(RING_ENTRIES, &params);
+  if (ring_fd_ < 0) {
+    LOG(WARNING) << "io_uring unavailable (" << strerror(errno)
+                 << "), falling back to select/sendto";
+    return false;
+  }
+  // 需要：单次 mmap、无丢失 CQ、带超时的 io_uring_enter
+  unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP |
+                      IORING_FEAT_EXT_ARG;
+  if ((params.features & required) != required) {
+    LOG(WARNING) << "io_uring lacks required features, falling back";
+    return false;
+  }
+
+  std::vector<char> probe_buffer(sizeof(struct io_uring_probe) +
+                                 256 * sizeof(struct io_uring_probe_op));
+  auto *probe = reinterpret_cast<struct io_uring_probe *>(probe_buffer.data());
+  if (io_uring_register(ring_fd_, IORING_REGISTER_PROBE, probe, 256) < 0) {
+    LOG(WARNING) << "io_uring probe failed, falling back";
+    return false;
+  }
+  for (int opcode : {IORING_OP_SENDMSG, IORING_OP_RECVMSG, IORING_OP_READ_FIXED}) {
+    if (opcode > probe->last_op ||
+        !(probe->ops[opcode].flags & IO_URING_OP_SUPPORTED)) {
+      LOG(WARNING) << "io_uring opcode " << opcode
+                   << " not supported, falling back";
+      return false;
+    }
+  }
+
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  sq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+  sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+  if (sq_ring_ == MAP_FAILED) {
+    LOG(WARNING) << "io_uring ring mmap failed, falling back";
+    return false;
+  }
+  cq_ring_ = sq_ring_;
+  sqes_ = reinterpret_cast<struct io_uring_sqe *>(
+      mmap(nullptr, params.sq_entries * sizeof(struct io_uring_sqe),
+           PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+           IORING_OFF_SQES));
+  if (sqes_ == MAP_FAILED) {
+    LOG(WARNING) << "io_uring sqe mmap failed, falling back";
+    return false;
+  }
+  sq_entries_ = params.sq_entries;
+  char *sq = reinterpret_cast<char *>(sq_ring_);
+  sq_head_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+  sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  sq_mask_ = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  char *cq = reinterpret_cast<char *>(cq_ring_);
+  cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  cq_mask_ = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+  sqe_tail_ = *sq_tail_;
+
+  // 注册套接字，之后的 sendmsg/recvmsg 通过下标引用，免去每次查找 fd
+  if (io_uring_register(ring_fd_, IORING_REGISTER_FILES, &sockfd, 1) < 0) {
+    LOG(WARNING) << "io_uring file registration failed, falling back";
+    return false;
+  }
+
+  // 注册发送缓冲区：内核一次性固定这些页，READ_FIXED 直接读入
+  slot_size_ = slot_size;
+  send_pool_ = reinterpret_cast<char *>(
+      aligned_alloc(4096, ((static_cast<size_t>(slot_size) * slot_count + 4095) /
+                           4096) * 4096));
+  if (send_pool_ == nullptr) {
+    return false;
+  }
+  send_iovecs_.resize(slot_count);
+  send_messages_.resize(slot_count);
+  send_destinations_.resize(slot_count);
+  for (int i = 0; i < slot_count; i++) {
+    send_iovecs_[i].iov_base = send_pool_ + static_cast<size_t>(i) * slot_size;
+    send_iovecs_[i].iov_len = slot_size;
+    free_slots_.push_back(slot_count - 1 - i);
+  }
+  if (io_uring_register(ring_fd_, IORING_REGISTER_BUFFERS, send_iovecs_.data(),
+                        slot_count) < 0) {
+    LOG(WARNING) << "io_uring buffer registration failed (" << strerror(errno)
+                 << "), falling back";
+    return false;
+  }
+
+  if (!setup_receive_ring() || !arm_receive()) {
+    return false;
+  }
+  LOG(INFO) << "Using io_uring backend (" << slot_count << " send slots of "
+            << slot_size << " bytes)";
+  return true;
+}
+
+bool IoUringBackend::setup_receive_ring() {
+  receive_ring_size_ = RECEIVE_BUFFER_COUNT * sizeof(struct io_uring_buf);
+  receive_ring_ = reinterpret_cast<struct io_uring_buf_ring *>(
+      mmap(nullptr, receive_ring_size_, PROT_READ | PROT_WRITE,
+           MAP_ANONYMOUS | MAP_PRIVATE, -1, 0));
+  receive_pool_ = reinterpret_cast<char *>(
+      malloc(static_cast<size_t>(RECEIVE_BUFFER_COUNT) * RECEIVE_BUFFER_SIZE));
+  if (receive_ring_ == MAP_FAILED || receive_pool_ == nullptr) {
+    return false;
+  }
+
+  struct io_uring_buf_reg registration;
+  memset(&registration, 0, sizeof(registration));
+  registration.ring_addr = reinterpret_cast<uint64_t>(receive_ring_);
+  registration.ring_entries = RECEIVE_BUFFER_COUNT;
+  registration.bgid = RECEIVE_BUFFER_GROUP;
+  if (io_uring_register(ring_fd_, IORING_REGISTER_PBUF_RING, &registration,
+                        1) < 0) {
+    LOG(WARNING) << "io_uring provided buffer ring unsupported, falling back";
+    return false;
+  }
+  receive_ring_->tail = 0;
+  for (int i = 0; i < RECEIVE_BUFFER_COUNT; i++) {
+    recycle_receive_buffer(i);
+  }
+
+  // 内核按 io_uring_recvmsg_out | 地址 | 控制信息 | 数据 的布局写入每个提供的缓冲区，
+  // 控制信息预留 SO_RXQ_OVFL 丢包计数的空间
+  receive_message_.msg_namelen = sizeof(struct sockaddr_in);
+  receive_message_.msg_controllen = DROP_COUNT_CONTROL_SIZE;
+  return true;
+}
+
+void IoUringBackend::recycle_receive_buffer(int buffer_id) {
+  // 不能使用 receive_ring_->bufs：C++ 下 uapi 头文件的柔性数组成员会被放到偏移 8 处，
+  // 与内核看到的布局不一致。尾指针与第 0 项的 resv 字段重叠，只写 addr/len/bid 不会覆盖它
+  unsigned short tail = receive_ring_->tail;
+  struct io_uring_buf &buffer = reinterpret_cast<struct io_uring_buf *>(
+      receive_ring_)[tail & (RECEIVE_BUFFER_COUNT - 1)];
+  buffer.addr = reinterpret_cast<uint64_t>(
+      receive_pool_ + static_cast<size_t>(buffer_id) * RECEIVE_BUFFER_SIZE);
+  buffer.len = RECEIVE_BUFFER_SIZE;
+  buffer.bid = buffer_id;
+  __atomic_store_n(&receive_ring_->tail, static_cast<unsigned short>(tail + 1),
+                   __ATOMIC_RELEASE);
+}
+
+struct io_uring_sqe *IoUringBackend::get_sqe() {
+  if (sqe_tail_ - load_acquire(sq_head_) >= sq_entries_) {
+    // SQ 已满，先把已排队的提交给内核
+    Submit();
+  }
+  unsigned index = sqe_tail_ & *sq_mask_;
+  struct io_uring_sqe *sqe = &sqes_[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sq_array_[index] = index;
+  sqe_tail_++;
+  to_submit_++;
+  return sqe;
+}
+
+bool IoUringBackend::arm_receive() {
+  struct io_uring_sqe *sqe = get_sqe();
+  sqe->opcode = IORING_OP_RECVMSG;
+  sqe->fd = REGISTERED_SOCKET_INDEX;
+  sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+  sqe->addr = reinterpret_cast<uint64_t>(&receive_message_);
+  sqe->len = 1;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->buf_group = RECEIVE_BUFFER_GROUP;
+  sqe->user_data = make_user_data(RECEIVE, 0);
+  receive_armed_ = true;
+  return true;
+}
+
+int IoUringBackend::slot_of(const char *buffer) const {
+  return static_cast<int>((buffer - send_pool_) / slot_size_);
+}
+
+char *IoUringBackend::AcquireSendBuffer() {
+  while (free_slots_.empty() && !failed_) {
+    enter(1, 1000000);
+    reap();
+  }
+  if (free_slots_.empty()) {
+    return nullptr;
+  }
+  int slot = free_slots_.back();
+  free_slots_.pop_back();
+  return reinterpret_cast<char *>(send_iovecs_[slot].iov_base);
+}
+
+void IoUringBackend::QueueSend(char *buffer, int length,
+                               const struct sockaddr_in &destination) {
+  int slot = slot_of(buffer);
+  send_destinations_[slot] = destination;
+  struct iovec &iov = send_iovecs_[slot];
+  iov.iov_len = length;
+  struct msghdr &message = send_messages_[slot];
+  memset(&message, 0, sizeof(message));
+  message.msg_name = &send_destinations_[slot];
+  message.msg_namelen = sizeof(struct sockaddr_in);
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+
+  struct io_uring_sqe *sqe = get_sqe();
+  sqe->opcode = IORING_OP_SENDMSG;
+  sqe->fd = REGISTERED_SOCKET_INDEX;
+  sqe->flags = IOSQE_FIXED_FILE;
+  sqe->addr = reinterpret_cast<uint64_t>(&message);
+  sqe->len = 1;
+  sqe->user_data = make_user_data(SEND, slot);
+}
+
+void IoUringBackend::QueueFileReadAndSend(char *buffer, int header_length,
+                                          int file_fd, int64_t offset,
+                                          int data_length,
+                                          const struct sockaddr_in &destination) {
+  int slot = slot_of(buffer);
+  struct io_uring_sqe *sqe = get_sqe();
+  sqe->opcode = IORING_OP_READ_FIXED;
+  sqe->fd = file_fd;
+  sqe->flags = IOSQE_IO_LINK;  // 读取成功后才执行紧随其后的 sendmsg
+  sqe->addr = reinterpret_cast<uint64_t>(buffer + header_length);
+  sqe->len = data_length;
+  sqe->off = offset;
+  sqe->buf_index = slot;
+  sqe->user_data = make_user_data(READ, slot);
+  QueueSend(buffer, header_length + data_length, destination);
+}
+
+int IoUringBackend::enter(unsigned min_complete, int64_t timeout_us) {
+  store_release(sq_tail_, sqe_tail_);
+  unsigned to_submit = to_submit_;
+  to_submit_ = 0;
+
+  struct __kernel_timespec timeout;
+  timeout.tv_sec = timeout_us / 1000000;
+  timeout.tv_nsec = (timeout_us % 1000000) * 1000;
+  struct io_uring_getevents_arg arg;
+  memset(&arg, 0, sizeof(arg));
+  arg.ts = reinterpret_cast<uint64_t>(&timeout);
+
+  unsigned flags = IORING_ENTER_EXT_ARG;
+  if (min_complete > 0) {
+    flags |= IORING_ENTER_GETEVENTS;
+  }
+  enter_calls_++;
+  submitted_ops_ += to_submit;
+  int res = io_uring_enter(ring_fd_, to_submit, min_complete, flags, &arg,
+                           sizeof(arg));
+  if (res < 0 && errno != ETIME && errno != EINTR && errno != EBUSY) {
+    LOG(ERROR) << "io_uring_enter failed: " << strerror(errno);
+    failed_ = true;
+  }
+  return res;
+}
+
+void IoUringBackend::Submit() {
+  if (to_submit_ > 0) {
+    enter(0, 0);
+  }
+}
+
+void IoUringBackend::reap() {
+  unsigned head = *cq_head_;
+  unsigned tail = load_acquire(cq_tail_);
+  for (; head != tail; head++) {
+    const struct io_uring_cqe &cqe = cqes_[head & *cq_mask_];
+    uint32_t kind = static_cast<uint32_t>(cqe.user_data >> 32);
+    uint32_t index = static_cast<uint32_t>(cqe.user_data);
+    if (kind == SEND) {
+      if (cqe.res < 0 && cqe.res != -ECANCELED) {
+        LOG(WARNING) << "io_uring sendmsg failed: " << strerror(-cqe.res);
+      }
+      free_slots_.push_back(index);
+    } else if (kind == READ) {
+      if (cqe.res < 0) {
+        LOG(WARNING) << "io_uring file read failed: " << strerror(-cqe.res);
+      }
+    } else if (kind == RECEIVE) {
+      if (cqe.flags & IORING_CQE_F_BUFFER) {
+        int buffer_id = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+        char *data = receive_pool_ +
+                     static_cast<size_t>(buffer_id) * RECEIVE_BUFFER_SIZE;
+        if (cqe.res > 0) {
+          auto *out = reinterpret_cast<struct io_uring_recvmsg_out *>(data);
+          struct msghdr control;
+          memset(&control, 0, sizeof(control));
+          control.msg_control = data + sizeof(*out) + receive_message_.msg_namelen;
+          control.msg_controllen = out->controllen;
+          SocketBufferManager::ReadDropCount(&control, &kernel_drop_count_);
+          int offset = sizeof(*out) + receive_message_.msg_namelen +
+                       receive_message_.msg_controllen;
+          int length = std::min<int>(out->payloadlen, cqe.res - offset);
+          received_.emplace_back(data + offset, std::max(length, 0));
+        }
+        recycle_receive_buffer(buffer_id);
+      }
+      if (!(cqe.flags & IORING_CQE_F_MORE)) {
+        // 缓冲区耗尽等原因会结束多次触发，需要重新投递
+        receive_armed_ = false;
+        if (cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP) {
+          LOG(WARNING) << "io_uring multishot recvmsg unsupported";
+          failed_ = true;
+        }
+      }
+    }
+  }
+  store_release(cq_head_, head);
+}
+
+int IoUringBackend::Receive(unsigned char *buffer, int capacity,
+                            int64_t timeout_us) {
+  reap();
+  // 发送完成也会唤醒等待，因此循环到收到数据报或超时为止
+  int64_t deadline = NowMicros() + std::max<int64_t>(timeout_us, 0);
+  while (received_.empty() && !failed_) {
+    if (!receive_armed_) {
+      arm_receive();
+    }
+    int64_t remaining = deadline - NowMicros();
+    if (remaining <= 0) {
+      Submit();
+      break;
+    }
+    enter(1, remaining);
+    reap();
+  }
+  if (failed_) {
+    return -1;
+  }
+  if (received_.empty()) {
+    return 0;
+  }
+  int length = std::min<int>(received_.front().size(), capacity);
+  memcpy(buffer, received_.front().data(), length);
+  received_.pop_front();
+  return length;
+}
+}  // namespace safe_udp
+#else
+#include <glog/logging.h>
+
+// 构建环境的内核头文件缺少所需的 io_uring 特性，只提供接口，调用方始终走 socket 路径
+namespace safe_udp {
+std::unique_ptr<IoUringBackend> IoUringBackend::Create(int, int, int) {
+  LOG(INFO) << "Built without io_uring support, using sockets";
+  return nullptr;
+}
+
+IoUringBackend::~IoUringBackend() {}
+
+char *IoUringBackend::AcquireSendBuffer() { return nullptr; }
+
+void IoUringBackend::QueueSend(char *, int, const struct sockaddr_in &) {}
+
+void IoUringBackend::QueueFileReadAndSend(char *, int, int, int64_t, int,
+                                          const struct sockaddr_in &) {}
+
+void IoUringBackend::Submit() {}
+
+int IoUringBackend::Receive(unsigned char *, int, int64_t) { return -1; }
+}  // namespace safe_udp
+#endif
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+// 服务端发送循环的 io_uring 后端：直接使用 io_uring_setup/io_uring_enter 系统调用，不依赖 liburing。
+// 一个窗口内的文件读取与 sendmsg 先在 SQ 中排队，等待 ACK 时与等待本身合并为一次 io_uring_enter；
+// ACK 通过一个常驻的多次触发（multishot）recvmsg 接收，数据落在内核提供的缓冲区环中。
+// 内核不支持或被禁用时 Create() 返回 nullptr，服务端继续使用 select/sendto 路径；
+// 构建时内核头文件不支持所需的特性（SAFE_UDP_IO_URING 未定义）时 Create() 总是返回 nullptr。
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+namespace safe_udp {
+constexpr int IO_URING_SEND_SLOTS = 256;
+
+class IoUringBackend {
+ public:
+  // 发送缓冲区共 slot_count 个，每个 slot_size 字节，全部注册为固定缓冲区
+  static std::unique_ptr<IoUringBackend> Create(int sockfd, int slot_size,
+                                                int slot_count);
+  ~IoUringBackend();
+
+  // 取一个空闲发送缓冲区；全部在途时先提交并等待发送完成
+  char *AcquireSendBuffer();
+  // buffer 必须来自 AcquireSendBuffer()，排队后由后端负责回收
+  void QueueSend(char *buffer, int length, const struct sockaddr_in &destination);
+  // 头部已写入 buffer，数据由 READ_FIXED 从 file_fd 读到头部之后，再链式执行 sendmsg
+  void QueueFileReadAndSend(char *buffer, int header_length, int file_fd,
+                            int64_t offset, int data_length,
+                            const struct sockaddr_in &destination);
+  // 提交所有排队的操作，不等待
+  void Submit();
+  // 提交排队的操作并等待一个数据报；返回其长度，超时返回 0，后端失效返回 -1
+  int Receive(unsigned char *buffer, int capacity, int64_t timeout_us);
+
+  // 接收到的最后一个 SO_RXQ_OVFL 控制信息中的累计丢包数
+  uint32_t kernel_drop_count() const { return kernel_drop_count_; }
+  int64_t enter_calls() const { return enter_calls_; }
+  int64_t submitted_ops() const { return submitted_ops_; }
+
+ private:
+  enum OperationKind : uint32_t { SEND = 1, READ = 2, RECEIVE = 3 };
+
+  IoUringBackend();
+  bool setup(int sockfd, int slot_size, int slot_count);
+  bool setup_receive_ring();
+  struct io_uring_sqe *get_sqe();
+  bool arm_receive();
+  int enter(unsigned min_complete, int64_t timeout_us);
+  void reap();
+  void recycle_receive_buffer(int buffer_id);
+  int slot_of(const char *buffer) const;
+
+  int ring_fd_;
+  unsigned sq_entries_;
+  void *sq_ring_;
+  void *cq_ring_;
+  size_t sq_ring_size_;
+  size_t cq_ring_size_;
+  struct io_uring_sqe *sqes_;
+  unsigned *sq_head_;
+  unsigned *sq_tail_;
+  unsigned *sq_mask_;
+  unsigned *sq_array_;
+  unsigned *cq_head_;
+  unsigned *cq_tail_;
+  unsigned *cq_mask_;
+  struct io_uring_cqe *cqes_;
+  unsigned sqe_tail_;  // 已填写但尚未对内核可见的 SQ 尾部
+  unsigned to_submit_;
+
+  // 发送缓冲区池
+  int slot_size_;
+  char *send_pool_;
+  std::vector<struct iovec> send_iovecs_;
+  std::vector<struct msghdr> send_messages_;
+  std::vector<struct sockaddr_in> send_destinations_;
+  std::vector<int> free_slots_;
+
+  // 接收：多次触发 recvmsg 与提供缓冲区环
+  struct io_uring_buf_ring *receive_ring_;
+  size_t receive_ring_size_;
+  char *receive_pool_;
+  struct msghdr receive_message_;
+  bool receive_armed_;
+  bool failed_;
+  std::deque<std::string> received_;
+
+  uint32_t kernel_drop_count_;
+  int64_t enter_calls_;
+  int64_t submitted_ops_;
+};
+}  // namespace safe_udp
@@ -0,0 +1,90 @@
+#include "low_latency.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <algorithm>
+
+#include <glog/logging.h>
+
+#include "packet_statistics.h"
+
+namespace safe_udp {
+LowLatencyConfig LowLatencyConfig::FromEnvironment() {
+  LowLatencyConfig config;
+  const char *enabled = getenv("SAFE_UDP_LOW_LATENCY");
+  config.enabled = enabled != nullptr && atoi(enabled) != 0;
+  const char *spin = getenv("SAFE_UDP_SPIN_US");
+  if (spin != nullptr) {
+    config.spin_budget_us = atoll(spin);
+  }
+  const char *busy_poll = getenv("SAFE_UDP_BUSY_POLL_US");
+  if (busy_poll != nullptr) {
+    config.busy_poll_us = atoi(busy_poll);
+  }
+  const char *cpu = getenv("SAFE_UDP_CPU");
+  if (cpu != nullptr) {
+    config.cpu = atoi(cpu);
+  }
+  return config;
+}
+
+bool EnableBusyPoll(int sockfd, int busy_poll_us) {
+  if (busy_poll_us <= 0) {
+    return false;
+  }
+  if (setsockopt(sockfd, SOL_SOCKET, SO_BUSY_POLL, &busy_poll_us,
+                 sizeof(busy_poll_us)) < 0) {
+    LOG(WARNING) << "SO_BUSY_POLL not set: " << strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+bool PinCurrentThread(int cpu) {
+  if (cpu < 0) {
+    return false;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (rc != 0) {
+    LOG(WARNING) << "Failed to pin thread to CPU " << cpu << ": " << strerror(rc);
+    return false;
+  }
+  return true;
+}
+
+int WaitReadable(int fd, int64_t timeout_us) {
+  struct pollfd pfd;
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  timeout_us = std::max<int64_t>(timeout_us, 0);
+  struct timespec timeout;
+  timeout.tv_sec = timeout_us / 1000000;
+  timeout.tv_nsec = (timeout_us % 1000000) * 1000;
+  return ppoll(&pfd, 1, &timeout, nullptr);
+}
+
+bool SpinUntilReadable(int fd, int64_t spin_budget_us) {
+  struct pollfd pfd;
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  int64_t spin_until = NowMicros() + spin_budget_us;
+  do {
+    if (poll(&pfd, 1, 0) > 0) {
+      return true;
+    }
+    // 对端与本线程共用 CPU 时让出时间片，否则自旋只会推迟对端发出数据；
+    // 没有其他可运行线程时 sched_yield 立即返回
+    sched_yield();
+  } while (NowMicros() < spin_until);
+  return false;
+}
+}  // namespace safe_udp
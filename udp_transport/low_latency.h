@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+
+// 小文件请求/应答的低时延模式：等待数据前先在有上限的时间内自旋接收，
+// 套接字开启 SO_BUSY_POLL，并可把收发线程绑定到指定 CPU，省去睡眠/唤醒与线程迁移的开销。
+namespace safe_udp {
+constexpr int64_t DEFAULT_SPIN_BUDGET_US = 200;
+constexpr int DEFAULT_BUSY_POLL_US = 50;
+
+struct LowLatencyConfig {
+  bool enabled = false;
+  // 每次进入阻塞等待之前自旋检查的最长时间（微秒）
+  int64_t spin_budget_us = DEFAULT_SPIN_BUDGET_US;
+  // SO_BUSY_POLL 的值（微秒），0 表示不设置
+  int busy_poll_us = DEFAULT_BUSY_POLL_US;
+  // 大于等于 0 时把执行收发的线程绑定到该 CPU
+  int cpu = -1;
+
+  // SAFE_UDP_LOW_LATENCY=1 开启，SAFE_UDP_SPIN_US、SAFE_UDP_BUSY_POLL_US、SAFE_UDP_CPU 调整参数
+  static LowLatencyConfig FromEnvironment();
+};
+
+// 设置 SO_BUSY_POLL；超过 net.core.busy_read 上限需要 CAP_NET_ADMIN，失败时只打印警告
+bool EnableBusyPoll(int sockfd, int busy_poll_us);
+// 把调用线程绑定到 cpu
+bool PinCurrentThread(int cpu);
+// 以微秒精度等待 fd 可读（ppoll），返回 poll 的结果
+int WaitReadable(int fd, int64_t timeout_us);
+// 在 spin_budget_us 内用非阻塞 poll 自旋等待 fd 可读，可读时返回 true
+bool SpinUntilReadable(int fd, int64_t spin_budget_us);
+}  // namespace safe_udp
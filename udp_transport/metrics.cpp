@@ -0,0 +1,96 @@
+#include "metrics.h"
+
+namespace safe_udp {
+int MetricShardIndex() {
+  static std::atomic<int> next_shard{0};
+  thread_local int shard =
+      next_shard.fetch_add(1, std::memory_order_relaxed) % METRIC_SHARDS;
+  return shard;
+}
+
+int64_t Counter::Value() const {
+  int64_t total = 0;
+  for (const Shard &shard : shards_) {
+    total += shard.value.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+Histogram::Histogram() {
+  for (auto &bucket : buckets_) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+  max_.store(0, std::memory_order_relaxed);
+}
+
+int Histogram::BucketIndex(int64_t value) {
+  if (value < 2 * SUB_BUCKETS) {
+    return value < 0 ? 0 : static_cast<int>(value);
+  }
+  int msb = 63 - __builtin_clzll(static_cast<uint64_t>(value));
+  int shift = msb - 4;  // value >> shift 落在 [16, 31]
+  return 2 * SUB_BUCKETS + (shift - 1) * SUB_BUCKETS +
+         static_cast<int>((value >> shift) - SUB_BUCKETS);
+}
+
+int64_t Histogram::BucketUpperBound(int index) {
+  if (index < 2 * SUB_BUCKETS) {
+    return index;
+  }
+  int shift = (index - 2 * SUB_BUCKETS) / SUB_BUCKETS + 1;
+  int64_t sub = (index - 2 * SUB_BUCKETS) % SUB_BUCKETS + SUB_BUCKETS;
+  return ((sub + 1) << shift) - 1;
+}
+
+void Histogram::Record(int64_t value) {
+  if (value < 0) {
+    value = 0;
+  }
+  buckets_[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+  count_.Add(1);
+  sum_.Add(value);
+  int64_t current_max = max_.load(std::memory_order_relaxed);
+  while (value > current_max &&
+         !max_.compare_exchange_weak(current_max, value,
+                                     std::memory_order_relaxed)) {
+  }
+}
+
+int64_t Histogram::Count() const { return count_.Value(); }
+
+int64_t Histogram::Sum() const { return sum_.Value(); }
+
+int64_t Histogram::Max() const { return max_.load(std::memory_order_relaxed); }
+
+double Histogram::Mean() const {
+  int64_t count = Count();
+  return count == 0 ? 0 : static_cast<double>(Sum()) / count;
+}
+
+int64_t Histogram::Percentile(double percentile) const {
+  // 先取一份桶计数的快照，避免并发写入导致总数与累加不一致
+  std::vector<uint64_t> counts(BUCKET_COUNT);
+  uint64_t total = 0;
+  for (int i = 0; i < BUCKET_COUNT; i++) {
+    counts[i] = buckets_[i].load(std::memory_order_relaxed);
+    total += counts[i];
+  }
+  if (total == 0) {
+    return 0;
+  }
+  uint64_t target = static_cast<uint64_t>(total * percentile / 100.0 + 0.5);
+  if (target == 0) {
+    target = 1;
+  }
+  uint64_t seen = 0;
+  for (int i = 0; i < BUCKET_COUNT; i++) {
+    seen += counts[i];
+    if (seen >= target) {
+      int64_t upper = BucketUpperBound(i);
+      int64_t max = Max();
+      return upper < max ? upper : max;
+    }
+  }
+  return Max();
+}
+}  // namespace safe_udp
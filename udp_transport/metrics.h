@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace safe_udp {
+constexpr int METRIC_SHARDS = 16;
+constexpr int CACHE_LINE_SIZE = 64;
+
+// 当前线程对应的分片下标，线程首次使用时按轮转分配
+int MetricShardIndex();
+
+// 按线程分片的计数器：写入只修改本线程所在分片（relaxed 原子操作，无锁、无伪共享），
+// 读取时把所有分片累加
+class Counter {
+ public:
+  Counter() {}
+  Counter(const Counter &) = delete;
+  Counter &operator=(const Counter &) = delete;
+
+  void Add(int64_t value) {
+    shards_[MetricShardIndex()].value.fetch_add(value,
+                                                std::memory_order_relaxed);
+  }
+  void operator++(int) { Add(1); }
+
+  int64_t Value() const;
+
+ private:
+  struct alignas(CACHE_LINE_SIZE) Shard {
+    std::atomic<int64_t> value{0};
+  };
+  Shard shards_[METRIC_SHARDS];
+};
+
+// HDR 风格的对数-线性直方图：每个 2 的幂区间再均分为 16 个子桶，
+// 相对误差不超过 1/16。小于 32 的值精确记录
+class Histogram {
+ public:
+  static constexpr int SUB_BUCKETS = 16;
+  static constexpr int BUCKET_COUNT = 32 + 59 * SUB_BUCKETS;
+
+  Histogram();
+  Histogram(const Histogram &) = delete;
+  Histogram &operator=(const Histogram &) = delete;
+
+  void Record(int64_t value);
+
+  int64_t Count() const;
+  int64_t Sum() const;
+  int64_t Max() const;
+  double Mean() const;
+  // percentile 取值 0-100，返回所在桶的上界
+  int64_t Percentile(double percentile) const;
+
+  static int BucketIndex(int64_t value);
+  static int64_t BucketUpperBound(int index);
+
+ private:
+  std::atomic<uint64_t> buckets_[BUCKET_COUNT];
+  Counter count_;
+  Counter sum_;
+  std::atomic<int64_t> max_;
+};
+}  // namespace safe_udp
@@ -0,0 +1,169 @@
+#include "metrics_exporter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <chrono>
+
+#include <glog/logging.h>
+
+namespace safe_udp {
+namespace {
+constexpr char UNIX_SOCKET_PREFIX[] = "unix:";
+}  // namespace
+
+MetricsExporter::MetricsExporter(PacketStatistics *statistics,
+                                 const std::string &target,
+                                 MetricsFormat format, int interval_ms) {
+  statistics_ = statistics;
+  target_ = target;
+  format_ = format;
+  interval_ms_ = interval_ms > 0 ? interval_ms : 1000;
+  socket_fd_ = -1;
+  stopped_ = true;
+  last_sample_us_ = statistics_->start_time_us_;
+  last_delivered_bytes_ = 0;
+}
+
+MetricsExporter::~MetricsExporter() {
+  Stop();
+  if (socket_fd_ >= 0) {
+    close(socket_fd_);
+  }
+}
+
+std::unique_ptr<MetricsExporter> MetricsExporter::FromEnvironment(
+    PacketStatistics *statistics) {
+  const char *target = getenv("SAFE_UDP_METRICS_TARGET");
+  if (target == nullptr || *target == '\0') {
+    return nullptr;
+  }
+  const char *format = getenv("SAFE_UDP_METRICS_FORMAT");
+  const char *interval = getenv("SAFE_UDP_METRICS_INTERVAL_MS");
+  MetricsFormat metrics_format = MetricsFormat::JSON_LINES;
+  if (format != nullptr && strcmp(format, "prometheus") == 0) {
+    metrics_format = MetricsFormat::PROMETHEUS;
+  }
+  return std::make_unique<MetricsExporter>(
+      statistics, target, metrics_format,
+      interval != nullptr ? atoi(interval) : 1000);
+}
+
+void MetricsExporter::Start() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!stopped_) {
+    return;
+  }
+  stopped_ = false;
+  thread_ = std::thread(&MetricsExporter::run, this);
+}
+
+void MetricsExporter::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopped_) {
+      return;
+    }
+    stopped_ = true;
+  }
+  stop_cv_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  export_once();
+}
+
+void MetricsExporter::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopped_) {
+    stop_cv_.wait_for(lock, std::chrono::milliseconds(interval_ms_));
+    if (stopped_) {
+      break;
+    }
+    lock.unlock();
+    export_once();
+    lock.lock();
+  }
+}
+
+void MetricsExporter::export_once() {
+  // goodput = 本周期内新增的已交付字节 / 周期时长
+  int64_t now = NowMicros();
+  int64_t delivered = statistics_->delivered_bytes_.Value();
+  if (now > last_sample_us_) {
+    double goodput = static_cast<double>(delivered - last_delivered_bytes_) *
+                     1e6 / (now - last_sample_us_);
+    statistics_->RecordGoodput(now, goodput);
+  }
+  last_sample_us_ = now;
+  last_delivered_bytes_ = delivered;
+
+  std::string snapshot = format_ == MetricsFormat::JSON_LINES
+                             ? statistics_->ToJson() + "\n"
+                             : statistics_->ToPrometheus();
+  bool ok = target_.compare(0, strlen(UNIX_SOCKET_PREFIX), UNIX_SOCKET_PREFIX) == 0
+                ? write_to_socket(snapshot)
+                : write_to_file(snapshot);
+  if (!ok) {
+    LOG(WARNING) << "Failed to export metrics to " << target_;
+  }
+}
+
+bool MetricsExporter::write_to_file(const std::string &snapshot) {
+  if (format_ == MetricsFormat::JSON_LINES) {
+    FILE *file = fopen(target_.c_str(), "a");
+    if (file == nullptr) {
+      return false;
+    }
+    fwrite(snapshot.data(), 1, snapshot.size(), file);
+    fclose(file);
+    return true;
+  }
+
+  // 先写临时文件再 rename，读取方不会看到写了一半的内容
+  std::string temp_path = target_ + ".tmp";
+  FILE *file = fopen(temp_path.c_str(), "w");
+  if (file == nullptr) {
+    return false;
+  }
+  fwrite(snapshot.data(), 1, snapshot.size(), file);
+  fclose(file);
+  return rename(temp_path.c_str(), target_.c_str()) == 0;
+}
+
+bool MetricsExporter::write_to_socket(const std::string &snapshot) {
+  if (socket_fd_ < 0) {
+    std::string path = target_.substr(strlen(UNIX_SOCKET_PREFIX));
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    socket_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socket_fd_ < 0) {
+      return false;
+    }
+    if (connect(socket_fd_, (struct sockaddr *)&address, sizeof(address)) < 0) {
+      close(socket_fd_);
+      socket_fd_ = -1;
+      return false;
+    }
+  }
+
+  size_t written = 0;
+  while (written < snapshot.size()) {
+    ssize_t n = ::send(socket_fd_, snapshot.data() + written,
+                       snapshot.size() - written, MSG_NOSIGNAL);
+    if (n <= 0) {
+      // 对端关闭后下次导出时重连
+      close(socket_fd_);
+      socket_fd_ = -1;
+      return false;
+    }
+    written += n;
+  }
+  return true;
+}
+}  // namespace safe_udp
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "packet_statistics.h"
+
+namespace safe_udp {
+enum class MetricsFormat { JSON_LINES, PROMETHEUS };
+
+// 后台线程定期导出 PacketStatistics，并计算 goodput 时间序列。
+// target 为普通文件路径，或 "unix:<path>" 表示连接本地 unix socket（SOCK_STREAM）。
+// JSON 每次追加一行；Prometheus 文本写到文件时整体替换（textfile collector 方式）
+class MetricsExporter {
+ public:
+  MetricsExporter(PacketStatistics *statistics, const std::string &target,
+                  MetricsFormat format, int interval_ms);
+  ~MetricsExporter();
+
+  void Start();
+  // 停止后台线程并做最后一次导出
+  void Stop();
+
+  // 根据 SAFE_UDP_METRICS_TARGET、SAFE_UDP_METRICS_FORMAT(json|prometheus)、
+  // SAFE_UDP_METRICS_INTERVAL_MS 创建导出器，未设置目标时返回 nullptr
+  static std::unique_ptr<MetricsExporter> FromEnvironment(
+      PacketStatistics *statistics);
+
+ private:
+  void run();
+  void export_once();
+  bool write_to_file(const std::string &snapshot);
+  bool write_to_socket(const std::string &snapshot);
+
+  PacketStatistics *statistics_;
+  std::string target_;
+  MetricsFormat format_;
+  int interval_ms_;
+  int socket_fd_;
+
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable stop_cv_;
+  bool stopped_;
+
+  int64_t last_sample_us_;
+  int64_t last_delivered_bytes_;
+};
+}  // namespace safe_udp
@@ -1,13 +1,187 @@
 #include "packet_statistics.h"
 
+#include <sys/time.h>
+#include <sstream>
+
 namespace safe_udp {
+namespace {
+constexpr size_t MAX_GOODPUT_SAMPLES = 3600;
+
+void append_histogram_json(std::ostringstream &out, const char *name,
+                           const Histogram &histogram) {
+  out << ",\"" << name << "\":{\"count\":" << histogram.Count()
+      << ",\"mean\":" << histogram.Mean()
+      << ",\"p50\":" << histogram.Percentile(50)
+      << ",\"p90\":" << histogram.Percentile(90)
+      << ",\"p99\":" << histogram.Percentile(99)
+      << ",\"max\":" << histogram.Max() << "}";
+}
+
+void append_histogram_prometheus(std::ostringstream &out, const char *name,
+                                 const Histogram &histogram) {
+  out << "# TYPE safe_udp_" << name << " summary\n";
+  const double quantiles[] = {50, 90, 99};
+  for (double quantile : quantiles) {
+    out << "safe_udp_" << name << "{quantile=\"" << quantile / 100 << "\"} "
+        << histogram.Percentile(quantile) << "\n";
+  }
+  out << "safe_udp_" << name << "_sum " << histogram.Sum() << "\n";
+  out << "safe_udp_" << name << "_count " << histogram.Count() << "\n";
+}
+}  // namespace
+
+int64_t NowMicros() {
+  struct timeval time;
+  gettimeofday(&time, NULL);
+  return static_cast<int64_t>(time.tv_sec) * 1000000 + time.tv_usec;
+}
+
 PacketStatistics::PacketStatistics() {
-  slow_start_packet_sent_count_ = 0;
-  cong_avd_packet_sent_count_ = 0;
-  slow_start_packet_rx_count_ = 0;
-  cong_avd_packet_rx_count_ = 0;
-  retransmit_count_ = 0;
+  clock_ = SystemClock::Instance();
+  start_time_us_ = clock_->NowMicros();
+  state_ = CongestionState::SLOW_START;
+  state_since_us_ = start_time_us_;
+  last_ack_us_.store(0, std::memory_order_relaxed);
 }
 
 PacketStatistics::~PacketStatistics() {}
-}  // namespace safe_udp
\ No newline at end of file
+
+void PacketStatistics::SetClock(Clock *clock) {
+  std::lock_guard<std::mutex> lock(state_mutex_);
+  clock_ = clock;
+  start_time_us_ = clock_->NowMicros();
+  state_since_us_ = start_time_us_;
+  last_ack_us_.store(0, std::memory_order_relaxed);
+}
+
+void PacketStatistics::EnterState(CongestionState state) {
+  std::lock_guard<std::mutex> lock(state_mutex_);
+  if (state == state_) {
+    return;
+  }
+  int64_t now = clock_->NowMicros();
+  int64_t elapsed = now - state_since_us_;
+  switch (state_) {
+    case CongestionState::SLOW_START:
+      slow_start_time_us_.Add(elapsed);
+      break;
+    case CongestionState::CONG_AVOIDANCE:
+      cong_avd_time_us_.Add(elapsed);
+      break;
+    case CongestionState::FAST_RECOVERY:
+      fast_recovery_time_us_.Add(elapsed);
+      break;
+  }
+  state_ = state;
+  state_since_us_ = now;
+}
+
+void PacketStatistics::OnAckArrival() {
+  acks_received_++;
+  int64_t now = clock_->NowMicros();
+  int64_t last = last_ack_us_.exchange(now, std::memory_order_relaxed);
+  if (last != 0) {
+    inter_ack_gap_us_.Record(now - last);
+  }
+}
+
+void PacketStatistics::RecordGoodput(int64_t time_us, double bytes_per_sec) {
+  std::lock_guard<std::mutex> lock(state_mutex_);
+  if (goodput_series_.size() == MAX_GOODPUT_SAMPLES) {
+    goodput_series_.erase(goodput_series_.begin());
+  }
+  goodput_series_.emplace_back(time_us, bytes_per_sec);
+}
+
+std::vector<std::pair<int64_t, double>> PacketStatistics::GoodputSeries() {
+  std::lock_guard<std::mutex> lock(state_mutex_);
+  return goodput_series_;
+}
+
+std::string PacketStatistics::ToJson() {
+  int64_t now = clock_->NowMicros();
+  int64_t state_time[3] = {slow_start_time_us_.Value(), cong_avd_time_us_.Value(),
+                           fast_recovery_time_us_.Value()};
+  double goodput = 0;
+  {
+    // 当前状态尚未结束的时间也计入
+    std::lock_guard<std::mutex> lock(state_mutex_);
+    state_time[static_cast<int>(state_)] += now - state_since_us_;
+    if (!goodput_series_.empty()) {
+      goodput = goodput_series_.back().second;
+    }
+  }
+
+  std::ostringstream out;
+  out << "{\"ts_us\":" << now << ",\"elapsed_us\":" << now - start_time_us_
+      << ",\"slow_start_packet_sent\":" << slow_start_packet_sent_count_.Value()
+      << ",\"cong_avd_packet_sent\":" << cong_avd_packet_sent_count_.Value()
+      << ",\"retransmits\":" << retransmit_count_.Value()
+      << ",\"bytes_sent\":" << bytes_sent_.Value()
+      << ",\"retransmit_bytes\":" << retransmit_bytes_.Value()
+      << ",\"delivered_bytes\":" << delivered_bytes_.Value()
+      << ",\"acks_received\":" << acks_received_.Value()
+      << ",\"dup_acks\":" << dup_acks_.Value()
+      << ",\"timeouts\":" << timeouts_.Value()
+      << ",\"spurious_timeouts\":" << spurious_timeouts_.Value()
+      << ",\"packets_received\":" << packets_received_.Value()
+      << ",\"kernel_drops\":" << kernel_drops_.Value()
+      << ",\"goodput_bytes_per_sec\":" << goodput
+      << ",\"state_time_us\":{\"slow_start\":" << state_time[0]
+      << ",\"cong_avoidance\":" << state_time[1]
+      << ",\"fast_recovery\":" << state_time[2] << "}";
+  append_histogram_json(out, "rtt_us", rtt_us_);
+  append_histogram_json(out, "inter_ack_gap_us", inter_ack_gap_us_);
+  append_histogram_json(out, "out_of_order_depth", out_of_order_depth_);
+  out << "}";
+  return out.str();
+}
+
+std::string PacketStatistics::ToPrometheus() {
+  int64_t now = clock_->NowMicros();
+  int64_t state_time[3] = {slow_start_time_us_.Value(), cong_avd_time_us_.Value(),
+                           fast_recovery_time_us_.Value()};
+  double goodput = 0;
+  {
+    std::lock_guard<std::mutex> lock(state_mutex_);
+    state_time[static_cast<int>(state_)] += now - state_since_us_;
+    if (!goodput_series_.empty()) {
+      goodput = goodput_series_.back().second;
+    }
+  }
+
+  std::ostringstream out;
+  const std::pair<const char *, const Counter *> counters[] = {
+      {"slow_start_packets_sent_total", &slow_start_packet_sent_count_},
+      {"cong_avd_packets_sent_total", &cong_avd_packet_sent_count_},
+      {"retransmits_total", &retransmit_count_},
+      {"bytes_sent_total", &bytes_sent_},
+      {"retransmit_bytes_total", &retransmit_bytes_},
+      {"delivered_bytes_total", &delivered_bytes_},
+      {"acks_received_total", &acks_received_},
+      {"dup_acks_total", &dup_acks_},
+      {"timeouts_total", &timeouts_},
+      {"spurious_timeouts_total", &spurious_timeouts_},
+      {"packets_received_total", &packets_received_},
+      {"kernel_drops_total", &kernel_drops_},
+  };
+  for (const auto &counter : counters) {
+    out << "# TYPE safe_udp_" << counter.first << " counter\n";
+    out << "safe_udp_" << counter.first << " " << counter.second->Value()
+        << "\n";
+  }
+  out << "# TYPE safe_udp_goodput_bytes_per_second gauge\n";
+  out << "safe_udp_goodput_bytes_per_second " << goodput << "\n";
+  out << "# TYPE safe_udp_congestion_state_seconds_total counter\n";
+  const char *state_names[] = {"slow_start", "cong_avoidance", "fast_recovery"};
+  for (int i = 0; i < 3; i++) {
+    out << "safe_udp_congestion_state_seconds_total{state=\"" << state_names[i]
+        << "\"} " << state_time[i] / 1e6 << "\n";
+  }
+  append_histogram_prometheus(out, "rtt_microseconds", rtt_us_);
+  append_histogram_prometheus(out, "inter_ack_gap_microseconds",
+                              inter_ack_gap_us_);
+  append_histogram_prometheus(out, "out_of_order_depth", out_of_order_depth_);
+  return out.str();
+}
+}  // namespace safe_udp
@@ -1,15 +1,70 @@
 #pragma once
 
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "clock.h"
+#include "metrics.h"
+
 namespace safe_udp {
+enum class CongestionState { SLOW_START = 0, CONG_AVOIDANCE = 1, FAST_RECOVERY = 2 };
+
 class PacketStatistics {
  public:
   PacketStatistics();
   virtual ~PacketStatistics();
 
-  int slow_start_packet_sent_count_;
-  int cong_avd_packet_sent_count_;
-  int slow_start_packet_rx_count_;
-  int cong_avd_packet_rx_count_;
-  int retransmit_count_;
+  // 改用给定的时间来源（模拟器的虚拟时间），并从该时间重新开始计时
+  void SetClock(Clock *clock);
+  // 切换拥塞控制状态，把上一个状态持续的时间计入对应计数器
+  void EnterState(CongestionState state);
+  // 记录一次 ACK 到达，并统计与上一次 ACK 的间隔
+  void OnAckArrival();
+  // 追加一个 goodput 采样点（微秒时间戳，字节/秒）
+  void RecordGoodput(int64_t time_us, double bytes_per_sec);
+  std::vector<std::pair<int64_t, double>> GoodputSeries();
+
+  // 导出格式：单行 JSON 与 Prometheus 文本格式
+  std::string ToJson();
+  std::string ToPrometheus();
+
+  // 拥塞控制各阶段的发送/接收计数
+  Counter slow_start_packet_sent_count_;
+  Counter cong_avd_packet_sent_count_;
+  Counter slow_start_packet_rx_count_;
+  Counter cong_avd_packet_rx_count_;
+  Counter retransmit_count_;
+
+  Counter bytes_sent_;
+  Counter retransmit_bytes_;
+  Counter delivered_bytes_;  // 服务端为已确认字节，客户端为按序写入的字节
+  Counter acks_received_;
+  Counter dup_acks_;
+  Counter timeouts_;
+  Counter spurious_timeouts_;  // 首个新 ACK 表明原始分段并未丢失、窗口已撤销收缩的超时
+  Counter packets_received_;
+  Counter kernel_drops_;  // 内核因套接字接收缓冲区满丢弃的数据报（SO_RXQ_OVFL）
+
+  // 各拥塞控制状态累计时间（微秒）
+  Counter slow_start_time_us_;
+  Counter cong_avd_time_us_;
+  Counter fast_recovery_time_us_;
+
+  Histogram rtt_us_;
+  Histogram inter_ack_gap_us_;
+  Histogram out_of_order_depth_;  // 客户端：已接收但尚未按序写入的分段数
+
+  int64_t start_time_us_;
+
+ private:
+  Clock *clock_;
+  std::mutex state_mutex_;  // 只在状态切换与 goodput 采样时使用，不在每包路径上
+  CongestionState state_;
+  int64_t state_since_us_;
+  std::atomic<int64_t> last_ack_us_;
+  std::vector<std::pair<int64_t, double>> goodput_series_;
 };
 }  // namespace safe_udp
@@ -0,0 +1,146 @@
+#include "path_metrics.h"
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
+
+#include <glog/logging.h>
+
+namespace safe_udp {
+PathMetricsCache &PathMetricsCache::Instance() {
+  static PathMetricsCache *cache = [] {
+    const char *path = getenv("SAFE_UDP_PATH_CACHE");
+    int64_t ttl_s = DEFAULT_PATH_METRICS_TTL_S;
+    const char *ttl = getenv("SAFE_UDP_PATH_CACHE_TTL_S");
+    if (ttl != nullptr) {
+      ttl_s = atoll(ttl);
+    }
+    return new PathMetricsCache(path != nullptr ? path : "", ttl_s);
+  }();
+  return *cache;
+}
+
+PathMetricsCache::PathMetricsCache(const std::string &path, int64_t ttl_s)
+    : path_(path), ttl_s_(ttl_s) {
+  load();
+}
+
+bool PathMetricsCache::expired(const PathMetrics &metrics, int64_t now_s) const {
+  return now_s - metrics.updated_at_s > ttl_s_;
+}
+
+bool PathMetricsCache::Lookup(const struct in_addr &peer, PathMetrics *metrics) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(peer.s_addr);
+  if (it == entries_.end() || expired(it->second, time(nullptr))) {
+    if (it != entries_.end()) {
+      entries_.erase(it);
+    }
+    misses_++;
+    return false;
+  }
+  hits_++;
+  *metrics = it->second;
+  return true;
+}
+
+void PathMetricsCache::Update(const struct in_addr &peer, const PathMetrics &metrics) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  int64_t now_s = time(nullptr);
+  // 顺带清理过期条目，不再出现的对端不会一直占用内存
+  for (auto it = entries_.begin(); it != entries_.end();) {
+    if (expired(it->second, now_s)) {
+      it = entries_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  PathMetrics &entry = entries_[peer.s_addr];
+  entry = metrics;
+  entry.updated_at_s = now_s;
+  save_locked();
+}
+
+void PathMetricsCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_.clear();
+  save_locked();
+}
+
+// 每行一个对端: 地址 srtt_us rtt_variance_us ssthresh bandwidth_bps updated_at_s
+void PathMetricsCache::load() {
+  if (path_.empty()) {
+    return;
+  }
+  std::ifstream file(path_);
+  std::string line;
+  int64_t now_s = time(nullptr);
+  while (std::getline(file, line)) {
+    std::istringstream fields(line);
+    std::string address;
+    PathMetrics metrics;
+    struct in_addr peer;
+    if (!(fields >> address >> metrics.smoothed_rtt_us >> metrics.rtt_variance_us >>
+          metrics.ssthresh >> metrics.bandwidth_bps >> metrics.updated_at_s) ||
+        inet_pton(AF_INET, address.c_str(), &peer) != 1 || expired(metrics, now_s)) {
+      continue;
+    }
+    entries_[peer.s_addr] = metrics;
+  }
+  LOG(INFO) << "Loaded " << entries_.size() << " path metrics from " << path_;
+}
+
+void PathMetricsCache::save_locked() {
+  if (path_.empty()) {
+    return;
+  }
+  std::ostringstream content;
+  int64_t now_s = time(nullptr);
+  for (const auto &entry : entries_) {
+    if (expired(entry.second, now_s)) {
+      continue;
+    }
+    char address[INET_ADDRSTRLEN];
+    struct in_addr peer;
+    peer.s_addr = entry.first;
+    inet_ntop(AF_INET, &peer, address, sizeof(address));
+    const PathMetrics &metrics = entry.second;
+    content << address << " " << metrics.smoothed_rtt_us << " "
+            << metrics.rtt_variance_us << " " << metrics.ssthresh << " "
+            << metrics.bandwidth_bps << " " << metrics.updated_at_s << "\n";
+  }
+
+  // 临时文件名唯一且与目标在同一目录，rename 才是原子的，并发写入的进程也不会互相覆盖
+  std::string temporary = path_ + ".XXXXXX";
+  int fd = mkstemp(&temporary[0]);
+  if (fd < 0) {
+    LOG(WARNING) << "Failed to create temporary file for " << path_;
+    return;
+  }
+  std::string data = content.str();
+  bool written = fchmod(fd, 0644) == 0;
+  for (size_t offset = 0; written && offset < data.size();) {
+    ssize_t n = write(fd, data.data() + offset, data.size() - offset);
+    if (n < 0) {
+      written = false;
+    } else {
+      offset += n;
+    }
+  }
+  written = close(fd) == 0 && written;
+  if (!written) {
+    LOG(WARNING) << "Failed to write path metrics to " << temporary;
+    unlink(temporary.c_str());
+    return;
+  }
+  if (rename(temporary.c_str(), path_.c_str()) != 0) {
+    LOG(WARNING) << "Failed to replace " << path_;
+    unlink(temporary.c_str());
+  }
+}
+}  // namespace safe_udp
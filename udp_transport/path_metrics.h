@@ -0,0 +1,53 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "metrics.h"
+
+// 按对端地址缓存的路径参数（与 Linux tcp_metrics 类似）：会话结束时记录平滑 RTT、
+// RTT 偏差、慢启动阈值与实际达到的带宽，同一对端的新会话直接从这些值开始，
+// 不再用固定的初始 RTO 和 IW 重新摸索路径。
+// 条目在 ttl 之后过期；设置了持久化文件时每次更新都写回，服务端进程重启后仍然有效。
+namespace safe_udp {
+// 默认有效期，可通过 SAFE_UDP_PATH_CACHE_TTL_S 修改
+constexpr int64_t DEFAULT_PATH_METRICS_TTL_S = 3600;
+
+struct PathMetrics {
+  int64_t smoothed_rtt_us = 0;
+  int64_t rtt_variance_us = 0;
+  int ssthresh = 0;            // 分段数
+  int64_t bandwidth_bps = 0;   // 上次传输的有效吞吐
+  int64_t updated_at_s = 0;    // 写入时间（Unix 时间，秒）
+};
+
+class PathMetricsCache {
+ public:
+  // 进程内共享的缓存；SAFE_UDP_PATH_CACHE 为持久化文件路径（不设置时只在内存中）
+  static PathMetricsCache &Instance();
+
+  PathMetricsCache(const std::string &path, int64_t ttl_s);
+
+  // 未知或已过期的对端返回 false，过期条目同时被删除
+  bool Lookup(const struct in_addr &peer, PathMetrics *metrics);
+  void Update(const struct in_addr &peer, const PathMetrics &metrics);
+  void Clear();
+
+  Counter hits_;
+  Counter misses_;
+
+ private:
+  void load();
+  // 写入同一目录下 mkstemp 创建的临时文件后 rename，多个服务端进程同时写入时以最后一次为准
+  void save_locked();
+  bool expired(const PathMetrics &metrics, int64_t now_s) const;
+
+  std::mutex mutex_;
+  std::string path_;
+  int64_t ttl_s_;
+  std::unordered_map<uint32_t, PathMetrics> entries_;
+};
+}  // namespace safe_udp
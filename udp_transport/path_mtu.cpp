@@ -0,0 +1,119 @@
+#include "path_mtu.h"
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <string>
+
+#include <glog/logging.h>
+
+#include "data_segment.h"
+#include "handshake.h"
+
+namespace safe_udp {
+PathMtuDiscovery::PathMtuDiscovery(int sockfd,
+                                   const struct sockaddr_in &peer_address) {
+  sockfd_ = sockfd;
+  peer_address_ = peer_address;
+  next_probe_id_ = 1;
+  done_ = true;
+  low_ = 0;
+  high_ = 0;
+  max_size_ = 0;
+  probe_size_ = 0;
+  first_probe_id_ = 1;
+  attempts_ = 0;
+  probe_deadline_us_ = 0;
+  probe_timeout_us_ = 20000;  // 与服务端初始 RTT 估计一致
+  max_probes_ = 3;
+}
+
+bool PathMtuDiscovery::EnableProbeMode(int sockfd) {
+  int mode = IP_PMTUDISC_PROBE;
+  if (setsockopt(sockfd, IPPROTO_IP, IP_MTU_DISCOVER, &mode, sizeof(mode)) <
+      0) {
+    LOG(ERROR) << "Failed to set IP_PMTUDISC_PROBE !!!";
+    return false;
+  }
+  return true;
+}
+
+void PathMtuDiscovery::Start(int base_size, int max_size, int64_t now_us) {
+  max_size_ = std::min(max_size, MAX_NEGOTIABLE_PACKET_SIZE);
+  low_ = base_size;
+  done_ = false;
+  if (max_size_ <= base_size || !EnableProbeMode(sockfd_)) {
+    done_ = true;
+    return;
+  }
+  // 先直接尝试上限（回环和巨帧网络上一次即可命中），失败后再二分
+  high_ = max_size_;
+  probe_size_ = max_size_;
+  attempts_ = 0;
+  first_probe_id_ = next_probe_id_;
+  send_probe(now_us);
+}
+
+void PathMtuDiscovery::send_probe(int64_t now_us) {
+  MtuProbe probe;
+  probe.probe_size_ = probe_size_;
+  probe.probe_id_ = next_probe_id_++;
+  attempts_++;
+  probe_deadline_us_ = now_us + probe_timeout_us_;
+  std::string datagram = probe.Serialize();
+  int n = sendto(sockfd_, datagram.data(), datagram.size(), 0,
+                 (struct sockaddr *)&peer_address_, sizeof(peer_address_));
+  if (n < 0 && errno == EMSGSIZE) {  // 超过本地接口 MTU，无需等待
+    on_probe_result(false, now_us);
+  }
+}
+
+bool PathMtuDiscovery::OnDatagram(const char *buffer, int length, int64_t now_us) {
+  MtuProbe ack;
+  if (done_ || !ack.Deserialize(buffer, length) || !ack.is_ack_) {
+    return false;
+  }
+  // 同一大小的任何一次探测得到应答都说明该大小可用
+  if (ack.probe_id_ >= first_probe_id_ && ack.probe_id_ < next_probe_id_) {
+    on_probe_result(true, now_us);
+  }
+  return true;
+}
+
+void PathMtuDiscovery::OnTimeout(int64_t now_us) {
+  if (done_ || now_us < probe_deadline_us_) {
+    return;
+  }
+  if (attempts_ < max_probes_) {
+    send_probe(now_us);
+  } else {
+    on_probe_result(false, now_us);
+  }
+}
+
+void PathMtuDiscovery::on_probe_result(bool accepted, int64_t now_us) {
+  if (accepted) {
+    low_ = probe_size_;
+  } else {
+    high_ = probe_size_ - 1;
+  }
+  if (accepted && probe_size_ == max_size_) {
+    LOG(INFO) << "PMTU probe accepted max size " << max_size_;
+    done_ = true;
+    return;
+  }
+  next_size(now_us);
+}
+
+void PathMtuDiscovery::next_size(int64_t now_us) {
+  if (low_ >= high_) {
+    LOG(INFO) << "PMTU probe result " << low_;
+    done_ = true;
+    return;
+  }
+  probe_size_ = low_ + (high_ - low_ + 1) / 2;
+  attempts_ = 0;
+  first_probe_id_ = next_probe_id_;
+  send_probe(now_us);
+}
+}  // namespace safe_udp
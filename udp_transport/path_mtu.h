@@ -0,0 +1,54 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <cstdint>
+
+namespace safe_udp {
+// DPLPMTUD（RFC 8899）风格的路径 MTU 探测：
+// 关闭内核分片（IP_PMTUDISC_PROBE，只设置 DF 而不使用内核缓存的 PMTU），
+// 由应用层发送指定大小的探测报文，对端原样大小回显即认为该大小可用，
+// 在 [base_size, max_size] 内二分查找最大可用的 UDP 负载。
+// 探测是非阻塞的状态机：调用者接收数据报并交给 OnDatagram()，
+// 到达 NextTimeoutUs() 时调用 OnTimeout()，IsDone() 之后读取 result()
+class PathMtuDiscovery {
+ public:
+  PathMtuDiscovery(int sockfd, const struct sockaddr_in &peer_address);
+  ~PathMtuDiscovery() {}
+
+  // 设置 socket 为探测模式，失败时返回 false
+  static bool EnableProbeMode(int sockfd);
+
+  // 开始在 [base_size, max_size] 内探测；无需探测时直接完成，结果为 base_size
+  void Start(int base_size, int max_size, int64_t now_us);
+  // 处理一个收到的数据报，是当前探测的应答时返回 true（其他数据报由调用者处理）
+  bool OnDatagram(const char *buffer, int length, int64_t now_us);
+  // 当前探测超时则重发，重发次数用完判定该大小不可用
+  void OnTimeout(int64_t now_us);
+  int64_t NextTimeoutUs() const { return probe_deadline_us_; }
+  bool IsDone() const { return done_; }
+  // 验证通过的最大数据报大小，至少为 base_size
+  int result() const { return low_; }
+
+  int probe_timeout_us_;  // 单个探测报文的等待时间
+  int max_probes_;        // 同一大小的最大探测次数，全部超时才判定为不可用
+
+ private:
+  // 发送当前大小的下一个探测报文
+  void send_probe(int64_t now_us);
+  void on_probe_result(bool accepted, int64_t now_us);
+  // 选择下一个探测大小，区间收敛时结束
+  void next_size(int64_t now_us);
+
+  int sockfd_;
+  struct sockaddr_in peer_address_;
+  unsigned int next_probe_id_;
+  bool done_;
+  int low_;   // 已验证可用
+  int high_;  // 尚未验证的上界
+  int max_size_;
+  int probe_size_;             // 正在探测的大小
+  unsigned int first_probe_id_;  // 当前大小第一个探测报文的编号，之前的应答已过期
+  int attempts_;
+  int64_t probe_deadline_us_;
+};
+}  // namespace safe_udp
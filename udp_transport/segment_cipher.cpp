@@ -0,0 +1,197 @@
+#include "segment_cipher.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(SAFE_UDP_ENCRYPTION)
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#endif
+
+#include <glog/logging.h>
+
+#include "data_segment.h"
+
+namespace safe_udp {
+namespace {
+constexpr char KEY_DERIVATION_LABEL[] = "safe-udp aes-128-gcm";
+
+int hex_value(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+}  // namespace
+
+bool PreSharedKeyFromEnvironment(std::string *key) {
+  key->clear();
+  const char *hex = getenv("SAFE_UDP_KEY");
+  if (hex == NULL) {
+    return true;
+  }
+  if (!EncryptionAvailable()) {
+    LOG(ERROR) << "SAFE_UDP_KEY is set but this build has no encryption support";
+    return false;
+  }
+  size_t length = strlen(hex);
+  if (length % 2 != 0 || length / 2 < PRE_SHARED_KEY_MIN_LENGTH) {
+    LOG(ERROR) << "SAFE_UDP_KEY must be at least " << PRE_SHARED_KEY_MIN_LENGTH
+               << " bytes of hex";
+    return false;
+  }
+  for (size_t i = 0; i < length; i += 2) {
+    int high = hex_value(hex[i]);
+    int low = hex_value(hex[i + 1]);
+    if (high < 0 || low < 0) {
+      LOG(ERROR) << "SAFE_UDP_KEY is not valid hex";
+      key->clear();
+      return false;
+    }
+    key->push_back(static_cast<char>(high << 4 | low));
+  }
+  return true;
+}
+
+#if defined(SAFE_UDP_ENCRYPTION)
+bool EncryptionAvailable() { return true; }
+
+std::string NewKeyNonce() {
+  std::string nonce(KEY_NONCE_LENGTH, '\0');
+  if (RAND_bytes(reinterpret_cast<unsigned char *>(&nonce[0]), nonce.size()) != 1) {
+    LOG(FATAL) << "RAND_bytes failed";
+  }
+  return nonce;
+}
+
+SegmentCipher::SegmentCipher() : encrypt_context_(nullptr), decrypt_context_(nullptr) {}
+
+SegmentCipher::~SegmentCipher() {
+  EVP_CIPHER_CTX_free(encrypt_context_);
+  EVP_CIPHER_CTX_free(decrypt_context_);
+}
+
+std::unique_ptr<SegmentCipher> SegmentCipher::Create(const std::string &pre_shared_key,
+                                                     const std::string &client_nonce,
+                                                     const std::string &server_nonce) {
+  if (pre_shared_key.size() < PRE_SHARED_KEY_MIN_LENGTH ||
+      client_nonce.size() != KEY_NONCE_LENGTH || server_nonce.size() != KEY_NONCE_LENGTH) {
+    LOG(ERROR) << "Invalid key material";
+    return nullptr;
+  }
+  std::string input(KEY_DERIVATION_LABEL);
+  input.append(client_nonce);
+  input.append(server_nonce);
+  unsigned char digest[EVP_MAX_MD_SIZE];
+  unsigned int digest_length = 0;
+  if (HMAC(EVP_sha256(), pre_shared_key.data(), pre_shared_key.size(),
+           reinterpret_cast<const unsigned char *>(input.data()), input.size(), digest,
+           &digest_length) == nullptr) {
+    LOG(ERROR) << "Session key derivation failed";
+    return nullptr;
+  }
+
+  std::unique_ptr<SegmentCipher> cipher(new SegmentCipher());
+  cipher->encrypt_context_ = EVP_CIPHER_CTX_new();
+  cipher->decrypt_context_ = EVP_CIPHER_CTX_new();
+  bool ok = cipher->encrypt_context_ != nullptr && cipher->decrypt_context_ != nullptr &&
+            EVP_EncryptInit_ex(cipher->encrypt_context_, EVP_aes_128_gcm(), nullptr,
+                               digest, nullptr) == 1 &&
+            EVP_DecryptInit_ex(cipher->decrypt_context_, EVP_aes_128_gcm(), nullptr,
+                               digest, nullptr) == 1;
+  OPENSSL_cleanse(digest, sizeof(digest));
+  if (!ok) {
+    LOG(ERROR) << "Failed to initialize AES-128-GCM";
+    return nullptr;
+  }
+  return cipher;
+}
+
+bool SegmentCipher::begin(EVP_CIPHER_CTX *context, const char *header, bool encrypt) {
+  // nonce = seq_number(4) | ack_number(4) | 0(4)
+  unsigned char nonce[GCM_NONCE_LENGTH] = {0};
+  memcpy(nonce, header, 8);
+  int length = 0;
+  const unsigned char *aad = reinterpret_cast<const unsigned char *>(header);
+  if (encrypt) {
+    return EVP_EncryptInit_ex(context, nullptr, nullptr, nullptr, nonce) == 1 &&
+           EVP_EncryptUpdate(context, nullptr, &length, aad, HEADER_LENGTH) == 1;
+  }
+  return EVP_DecryptInit_ex(context, nullptr, nullptr, nullptr, nonce) == 1 &&
+         EVP_DecryptUpdate(context, nullptr, &length, aad, HEADER_LENGTH) == 1;
+}
+
+bool SegmentCipher::Seal(char *packet, int data_length) {
+  unsigned char *data = reinterpret_cast<unsigned char *>(packet + HEADER_LENGTH);
+  int length = 0;
+  bool ok = begin(encrypt_context_, packet, true) &&
+            (data_length == 0 ||
+             EVP_EncryptUpdate(encrypt_context_, data, &length, data, data_length) == 1) &&
+            EVP_EncryptFinal_ex(encrypt_context_, data + length, &length) == 1 &&
+            EVP_CIPHER_CTX_ctrl(encrypt_context_, EVP_CTRL_GCM_GET_TAG, GCM_TAG_LENGTH,
+                                data + data_length) == 1;
+  if (ok) {
+    sealed_segments_++;
+  }
+  return ok;
+}
+
+bool SegmentCipher::Open(char *packet, int data_length) {
+  struct iovec piece;
+  piece.iov_base = packet + HEADER_LENGTH;
+  piece.iov_len = data_length;
+  return Open(packet, &piece, 1, packet + HEADER_LENGTH + data_length);
+}
+
+bool SegmentCipher::Open(const char *header, const struct iovec *pieces, int count,
+                         const char *tag) {
+  bool ok = begin(decrypt_context_, header, false);
+  for (int i = 0; ok && i < count; i++) {
+    unsigned char *data = static_cast<unsigned char *>(pieces[i].iov_base);
+    int length = 0;
+    ok = pieces[i].iov_len == 0 ||
+         EVP_DecryptUpdate(decrypt_context_, data, &length, data, pieces[i].iov_len) == 1;
+  }
+  int length = 0;
+  unsigned char final_block[16];
+  ok = ok &&
+       EVP_CIPHER_CTX_ctrl(decrypt_context_, EVP_CTRL_GCM_SET_TAG, GCM_TAG_LENGTH,
+                           const_cast<char *>(tag)) == 1 &&
+       EVP_DecryptFinal_ex(decrypt_context_, final_block, &length) == 1;
+  if (!ok) {
+    rejected_segments_++;
+  }
+  return ok;
+}
+#else
+bool EncryptionAvailable() { return false; }
+
+std::string NewKeyNonce() { return std::string(KEY_NONCE_LENGTH, '\0'); }
+
+SegmentCipher::SegmentCipher() : encrypt_context_(nullptr), decrypt_context_(nullptr) {}
+
+SegmentCipher::~SegmentCipher() {}
+
+std::unique_ptr<SegmentCipher> SegmentCipher::Create(const std::string &,
+                                                     const std::string &,
+                                                     const std::string &) {
+  LOG(ERROR) << "Built without encryption support";
+  return nullptr;
+}
+
+bool SegmentCipher::Seal(char *, int) { return false; }
+
+bool SegmentCipher::Open(char *, int) { return false; }
+
+bool SegmentCipher::Open(const char *, const struct iovec *, int, const char *) {
+  return false;
+}
+#endif
+}  // namespace safe_udp
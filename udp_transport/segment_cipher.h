@@ -0,0 +1,64 @@
+#pragma once
+
+#include <sys/uio.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "metrics.h"
+
+typedef struct evp_cipher_ctx_st EVP_CIPHER_CTX;
+
+// 加密传输：双方配置相同的预共享密钥，握手时各自带上一个随机数，
+// 会话密钥 = HMAC-SHA256(预共享密钥, 标签 | 客户端随机数 | 服务端随机数) 的前 16 字节，
+// 每次会话的密钥都不同。每个数据段用 AES-128-GCM 加密：
+//   header(12, 关联数据) | 密文(length_) | tag(16)
+// nonce 取头部的 seq_number_ 与 ack_number_（数据段中为服务端的发送计数，重传也不同），
+// 在同一会话内不会重复。OpenSSL 的 EVP 接口自动使用 AES-NI 与 PCLMUL。
+// 不带 OpenSSL 构建（SAFE_UDP_ENCRYPTION 关闭）时 EncryptionAvailable() 为 false，
+// 配置了密钥的一端在握手前失败，Create() 总是返回 nullptr
+namespace safe_udp {
+constexpr int PRE_SHARED_KEY_MIN_LENGTH = 16;
+constexpr int KEY_NONCE_LENGTH = 16;
+constexpr int SESSION_KEY_LENGTH = 16;
+constexpr int GCM_TAG_LENGTH = 16;
+constexpr int GCM_NONCE_LENGTH = 12;
+
+// 本次构建是否支持加密传输
+bool EncryptionAvailable();
+
+// SAFE_UDP_KEY 为十六进制的预共享密钥（至少 16 字节）。未设置时 key 为空并返回 true，
+// 格式不对时返回 false
+bool PreSharedKeyFromEnvironment(std::string *key);
+// 生成握手用的随机数
+std::string NewKeyNonce();
+
+class SegmentCipher {
+ public:
+  // 由预共享密钥与双方的随机数派生会话密钥，失败时返回 nullptr
+  static std::unique_ptr<SegmentCipher> Create(const std::string &pre_shared_key,
+                                               const std::string &client_nonce,
+                                               const std::string &server_nonce);
+  ~SegmentCipher();
+  SegmentCipher(const SegmentCipher &) = delete;
+  SegmentCipher &operator=(const SegmentCipher &) = delete;
+
+  // packet 为已序列化的头部加 data_length 字节明文：原地加密并在其后写入 tag
+  bool Seal(char *packet, int data_length);
+  // 与 Seal 对应，校验通过后原地解密；密文与 tag 在 packet 中连续
+  bool Open(char *packet, int data_length);
+  // 密文分散在多段内存中（零拷贝接收），各段原地解密
+  bool Open(const char *header, const struct iovec *pieces, int count, const char *tag);
+
+  Counter sealed_segments_;
+  Counter rejected_segments_;  // 校验失败（伪造、损坏或密钥不一致）的数据段
+
+ private:
+  SegmentCipher();
+  // 每个数据段只重设 nonce，密钥扩展在创建时完成一次
+  bool begin(EVP_CIPHER_CTX *context, const char *header, bool encrypt);
+
+  EVP_CIPHER_CTX *encrypt_context_;
+  EVP_CIPHER_CTX *decrypt_context_;
+};
+}  // namespace safe_udp
@@ -0,0 +1,395 @@
+#include "simulator.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory>
+
+#include <glog/logging.h>
+
+#include "udp_client.h"
+#include "udp_server.h"
+
+namespace safe_udp {
+namespace {
+struct sockaddr_in make_address(uint32_t host, uint16_t port) {
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(host);
+  address.sin_port = htons(port);
+  return address;
+}
+
+std::string read_file(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(file),
+                     std::istreambuf_iterator<char>());
+}
+
+// 模拟中的一个收发方：数据到达或定时器到期时被唤醒，同一时刻的多次唤醒合并为一次。
+// 提前重新设置的定时器会留下过期事件，执行时按 wake_us 判断并忽略
+struct SimNode {
+  Simulator *simulator = nullptr;
+  int64_t wake_us = std::numeric_limits<int64_t>::max();
+  std::function<void()> step;
+
+  void Wake(int64_t at_us) {
+    at_us = std::max(at_us, simulator->NowMicros());
+    if (at_us >= wake_us) {
+      return;
+    }
+    wake_us = at_us;
+    simulator->Schedule(at_us, [this, at_us]() {
+      if (wake_us != at_us) {
+        return;
+      }
+      wake_us = std::numeric_limits<int64_t>::max();
+      step();
+    });
+  }
+};
+
+struct SimFlow {
+  FlowConfig config;
+  std::string file_name;
+  std::unique_ptr<UdpServer> server;
+  std::unique_ptr<UdpClient> client;
+  SimEndpoint *server_endpoint = nullptr;
+  SimEndpoint *client_endpoint = nullptr;
+  SimNode server_node;
+  SimNode client_node;
+  bool server_started = false;
+  bool server_done = false;
+  FlowResult result;
+};
+}  // namespace
+
+Simulator::Simulator(uint64_t seed) : now_us_(0), next_order_(0), random_(seed) {}
+
+void Simulator::Schedule(int64_t at_us, Callback callback) {
+  events_.push(Event{std::max(at_us, now_us_), next_order_++, std::move(callback)});
+}
+
+void Simulator::Run(int64_t until_us) {
+  while (!events_.empty() && events_.top().at_us <= until_us) {
+    // 回调可能加入新事件，先取出再执行
+    Event event = events_.top();
+    events_.pop();
+    now_us_ = event.at_us;
+    event.callback();
+  }
+}
+
+double Simulator::Uniform() {
+  return std::uniform_real_distribution<double>(0, 1)(random_);
+}
+
+SimLink::SimLink(Simulator *simulator, const LinkConfig &config)
+    : simulator_(simulator), config_(config), busy_until_us_(0) {}
+
+SimLink::AddressKey SimLink::key(const struct sockaddr_in &address) {
+  return AddressKey(address.sin_addr.s_addr, address.sin_port);
+}
+
+void SimLink::Attach(const struct sockaddr_in &address, SimEndpoint *endpoint) {
+  endpoints_[key(address)] = endpoint;
+}
+
+void SimLink::Transmit(const void *data, size_t length,
+                       const struct sockaddr_in &source,
+                       const struct sockaddr_in &destination) {
+  int64_t now = simulator_->NowMicros();
+  while (!departures_.empty() && departures_.front() <= now) {
+    departures_.pop_front();
+  }
+  if (config_.loss_rate > 0 && simulator_->Uniform() < config_.loss_rate) {
+    stats_.dropped_loss++;
+    return;
+  }
+  if (static_cast<int>(departures_.size()) >= config_.queue_packets) {
+    stats_.dropped_queue++;
+    return;
+  }
+
+  // 瓶颈逐个串行发送：排在前面的数据报发完之后才开始
+  int64_t start = std::max(now, busy_until_us_);
+  int64_t serialization_us = 0;
+  if (config_.bandwidth_bps > 0) {
+    serialization_us = (static_cast<int64_t>(length) + SIM_DATAGRAM_OVERHEAD) * 8 *
+                       1000000 / config_.bandwidth_bps;
+  }
+  busy_until_us_ = start + serialization_us;
+  departures_.push_back(busy_until_us_);
+  stats_.peak_queue = std::max(stats_.peak_queue, static_cast<int>(departures_.size()));
+
+  auto it = endpoints_.find(key(destination));
+  if (it == endpoints_.end()) {
+    return;
+  }
+  SimEndpoint *endpoint = it->second;
+  std::string datagram(static_cast<const char *>(data), length);
+  simulator_->Schedule(busy_until_us_ + config_.delay_us,
+                       [this, endpoint, datagram, source]() {
+                         stats_.delivered_packets++;
+                         stats_.delivered_bytes += datagram.size();
+                         endpoint->Deliver(datagram, source);
+                       });
+}
+
+ssize_t SimEndpoint::SendTo(const void *data, size_t length,
+                            const struct sockaddr_in &destination) {
+  outgoing_->Transmit(data, length, address_, destination);
+  return length;
+}
+
+ssize_t SimEndpoint::ReceiveMessage(struct msghdr *message, int flags) {
+  (void)flags;  // 虚拟时间中无法阻塞，总是按非阻塞处理
+  if (inbox_.empty()) {
+    errno = EAGAIN;
+    return -1;
+  }
+  const std::string &datagram = inbox_.front().first;
+  size_t copied = 0;
+  for (size_t i = 0; i < message->msg_iovlen && copied < datagram.size(); i++) {
+    size_t length = std::min(message->msg_iov[i].iov_len, datagram.size() - copied);
+    memcpy(message->msg_iov[i].iov_base, datagram.data() + copied, length);
+    copied += length;
+  }
+  message->msg_flags = copied < datagram.size() ? MSG_TRUNC : 0;
+  if (message->msg_name != nullptr) {
+    size_t length = std::min<size_t>(message->msg_namelen, sizeof(struct sockaddr_in));
+    memcpy(message->msg_name, &inbox_.front().second, length);
+    message->msg_namelen = sizeof(struct sockaddr_in);
+  }
+  message->msg_controllen = 0;
+  inbox_.pop_front();
+  return copied;
+}
+
+void SimEndpoint::Deliver(std::string datagram, const struct sockaddr_in &source) {
+  inbox_.emplace_back(std::move(datagram), source);
+  if (on_readable_) {
+    on_readable_();
+  }
+}
+
+ScenarioResult RunScenario(const ScenarioConfig &config) {
+  Simulator simulator(config.seed);
+  SimLink forward(&simulator, config.forward);
+  SimLink reverse(&simulator, config.reverse);
+
+  std::unique_ptr<TransmitScheduler> scheduler;
+  SimNode scheduler_node;
+  if (config.transmit_scheduler) {
+    scheduler = std::make_unique<TransmitScheduler>(config.scheduler_rate_bps,
+                                                    MAX_PACKET_SIZE);
+    scheduler->on_backlog_ = [&scheduler_node, &simulator]() {
+      scheduler_node.Wake(simulator.NowMicros());
+    };
+  }
+
+  // 每种文件大小一个源文件
+  std::map<int64_t, std::string> contents;
+  std::vector<std::unique_ptr<SimFlow>> flows;
+  for (int i = 0; i < config.flows; i++) {
+    std::unique_ptr<SimFlow> flow = std::make_unique<SimFlow>();
+    SimFlow *f = flow.get();
+    if (!config.flow_configs.empty()) {
+      f->config = config.flow_configs[i % config.flow_configs.size()];
+    }
+    if (f->config.file_bytes <= 0) {
+      f->config.file_bytes = config.file_bytes;
+    }
+    f->file_name = "sim_" + std::to_string(f->config.file_bytes) + ".bin";
+    std::string server_path = config.work_dir + "/" + f->file_name;
+    if (contents.count(f->config.file_bytes) == 0) {
+      std::string &expected = contents[f->config.file_bytes];
+      expected.resize(f->config.file_bytes);
+      std::mt19937 generator(static_cast<uint32_t>(config.seed + f->config.file_bytes));
+      for (char &c : expected) {
+        c = static_cast<char>(generator());
+      }
+      std::ofstream file(server_path, std::ios::binary);
+      file.write(expected.data(), expected.size());
+    }
+    f->result.file_bytes = f->config.file_bytes;
+    f->result.weight = f->config.weight;
+    struct sockaddr_in server_address = make_address(0x0a000001, 9000 + i);
+    struct sockaddr_in client_address = make_address(0x0a000002, 9000 + i);
+    // 服务端经 forward 发往客户端，客户端经 reverse 发往服务端
+    std::unique_ptr<SimEndpoint> server_endpoint =
+        std::make_unique<SimEndpoint>(&forward, server_address);
+    std::unique_ptr<SimEndpoint> client_endpoint =
+        std::make_unique<SimEndpoint>(&reverse, client_address);
+    f->server_endpoint = server_endpoint.get();
+    f->client_endpoint = client_endpoint.get();
+    reverse.Attach(server_address, f->server_endpoint);
+    forward.Attach(client_address, f->client_endpoint);
+
+    f->server = std::make_unique<UdpServer>();
+    f->server->rwnd_ = config.window;
+    f->server->path_metrics_ = config.path_metrics;
+    f->server->scheduler_ = scheduler.get();
+    f->server->transmit_options_.weight = f->config.weight;
+    f->server->transmit_options_.rate_limit_bps = f->config.rate_limit_bps;
+    if (config.packet_size > 0) {
+      f->server->max_packet_size_ = config.packet_size;
+    }
+    if (config.initial_window > 0) {
+      f->server->initial_window_ = config.initial_window;
+    }
+    f->server->UseTransport(std::move(server_endpoint), &simulator);
+
+    std::string output_dir = config.work_dir + "/flow" + std::to_string(i) + "/";
+    mkdir(output_dir.c_str(), 0755);
+    f->client = std::make_unique<UdpClient>();
+    f->client->receiver_window_ = config.window;
+    f->client->output_dir_ = output_dir;
+    if (config.packet_size > 0) {
+      f->client->max_packet_size_ = config.packet_size;
+    }
+    f->client->UseTransport(std::move(client_endpoint), &simulator, server_address);
+    f->client->on_complete_ = [f, &simulator, &flows](DownloadStatus) {
+      f->result.finish_us = simulator.NowMicros();
+      // 第一个完成的流结束了所有流同时竞争的阶段
+      bool first = true;
+      for (const std::unique_ptr<SimFlow> &other : flows) {
+        first = first && (other.get() == f || other->result.finish_us == 0);
+      }
+      if (first) {
+        for (const std::unique_ptr<SimFlow> &other : flows) {
+          other->result.contended_bytes =
+              other->server->packet_statistics()->delivered_bytes_.Value();
+        }
+      }
+    };
+
+    f->server_node.simulator = &simulator;
+    f->server_node.step = [f, &simulator, server_path]() {
+      if (f->server_done) {
+        return;
+      }
+      if (!f->server_started) {
+        if (f->server_endpoint->pending() == 0) {
+          return;
+        }
+        free(f->server->GetRequest(-1));
+        f->server_started = true;
+        if (!f->server->OpenFile(server_path)) {
+          f->server->SendError();
+          f->server_done = true;
+          return;
+        }
+        f->server->BeginFileTransfer();
+      }
+      if (!f->server->Step(simulator.NowMicros())) {
+        f->server->EndFileTransfer();
+        f->server_done = true;
+        return;
+      }
+      f->server_node.Wake(f->server->NextTimeoutUs());
+    };
+    f->server_endpoint->on_readable_ = [f, &simulator]() {
+      f->server_node.Wake(simulator.NowMicros());
+    };
+
+    f->client_node.simulator = &simulator;
+    f->client_node.step = [f, &simulator]() {
+      if (f->client->Step(simulator.NowMicros())) {
+        f->client_node.Wake(f->client->NextTimeoutUs());
+      }
+    };
+    f->client_endpoint->on_readable_ = [f, &simulator]() {
+      if (!f->client->IsFinished()) {
+        f->client_node.Wake(simulator.NowMicros());
+      }
+    };
+
+    f->result.start_us = i * config.flow_start_spacing_us;
+    simulator.Schedule(f->result.start_us, [f, &simulator]() {
+      if (f->client->StartDownload(f->file_name, simulator.NowMicros())) {
+        f->client_node.Wake(f->client->NextTimeoutUs());
+      }
+    });
+    flows.push_back(std::move(flow));
+  }
+
+  if (scheduler) {
+    scheduler_node.simulator = &simulator;
+    scheduler_node.step = [&scheduler, &scheduler_node, &flows]() {
+      if (scheduler->Dispatch(scheduler_node.simulator->NowMicros()) > 0) {
+        // 刚发出的分段可能改变了服务端的重传截止时间
+        for (const std::unique_ptr<SimFlow> &flow : flows) {
+          if (flow->server_started && !flow->server_done) {
+            flow->server_node.Wake(flow->server->NextTimeoutUs());
+          }
+        }
+      }
+      int64_t next = scheduler->NextDispatchUs();
+      if (next != std::numeric_limits<int64_t>::max()) {
+        scheduler_node.Wake(next);
+      }
+    };
+  }
+
+  simulator.Run(config.time_limit_us);
+
+  ScenarioResult result;
+  std::vector<double> throughputs;
+  std::vector<double> shares;
+  int64_t first_start = std::numeric_limits<int64_t>::max();
+  int64_t last_finish = 0;
+  int64_t total_bytes = 0;
+  for (int i = 0; i < config.flows; i++) {
+    SimFlow *f = flows[i].get();
+    FlowResult flow_result = f->result;
+    flow_result.completed = f->client->status() == DownloadStatus::COMPLETED;
+    flow_result.retransmits = f->server->packet_statistics()->retransmit_count_.Value();
+    if (flow_result.completed) {
+      std::string output = f->client->output_dir_ + f->file_name;
+      flow_result.verified = read_file(output) == contents[f->config.file_bytes];
+      int64_t elapsed = std::max<int64_t>(flow_result.finish_us - flow_result.start_us, 1);
+      flow_result.throughput_bps = f->config.file_bytes * 8.0 * 1000000 / elapsed;
+      first_start = std::min(first_start, flow_result.start_us);
+      last_finish = std::max(last_finish, flow_result.finish_us);
+      total_bytes += f->config.file_bytes;
+    }
+    throughputs.push_back(flow_result.throughput_bps);
+    shares.push_back(static_cast<double>(flow_result.contended_bytes) / f->config.weight);
+    result.flows.push_back(flow_result);
+  }
+  if (last_finish > first_start) {
+    result.duration_us = last_finish - first_start;
+    if (config.forward.bandwidth_bps > 0) {
+      result.utilization = total_bytes * 8.0 * 1000000 / result.duration_us /
+                           config.forward.bandwidth_bps;
+    }
+  }
+  result.fairness = JainFairness(throughputs);
+  result.contended_fairness = JainFairness(shares);
+  result.forward = forward.stats();
+  result.reverse = reverse.stats();
+  return result;
+}
+
+double JainFairness(const std::vector<double> &values) {
+  double sum = 0;
+  double sum_of_squares = 0;
+  for (double value : values) {
+    sum += value;
+    sum_of_squares += value * value;
+  }
+  if (values.empty() || sum_of_squares == 0) {
+    return 0;
+  }
+  return sum * sum / (values.size() * sum_of_squares);
+}
+}  // namespace safe_udp
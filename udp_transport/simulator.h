@@ -0,0 +1,186 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <queue>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "clock.h"
+#include "path_metrics.h"
+#include "transmit_scheduler.h"
+#include "transport.h"
+
+// 离散事件模拟器：UdpServer/UdpClient 的真实状态机通过 Transport/Clock 接口
+// 运行在虚拟时间与模拟链路上，几秒钟的墙钟时间即可扫过带宽、RTT、队列与丢包的组合，
+// 结果与机器负载无关且可复现（固定随机种子）。
+namespace safe_udp {
+// 模拟链路上每个数据报的 IP + UDP 头部开销
+constexpr int SIM_DATAGRAM_OVERHEAD = 28;
+
+// 虚拟时钟与事件队列，事件按时间执行，同一时刻按加入顺序执行
+class Simulator : public Clock {
+ public:
+  using Callback = std::function<void()>;
+
+  explicit Simulator(uint64_t seed);
+
+  int64_t NowMicros() override { return now_us_; }
+  void Schedule(int64_t at_us, Callback callback);
+  // 执行事件直到队列为空或下一个事件晚于 until_us
+  void Run(int64_t until_us);
+  // [0, 1) 均匀分布的随机数
+  double Uniform();
+
+ private:
+  struct Event {
+    int64_t at_us;
+    uint64_t order;
+    Callback callback;
+    bool operator>(const Event &other) const {
+      return at_us != other.at_us ? at_us > other.at_us : order > other.order;
+    }
+  };
+
+  std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events_;
+  int64_t now_us_;
+  uint64_t next_order_;
+  std::mt19937_64 random_;
+};
+
+// 单向链路：bandwidth_bps 的瓶颈（0 表示不限速）+ 传播时延，
+// 瓶颈前是 queue_packets 个数据报的尾部丢弃队列，进入队列前以 loss_rate 随机丢包
+struct LinkConfig {
+  int64_t bandwidth_bps = 100000000;
+  int64_t delay_us = 10000;
+  int queue_packets = 100;
+  double loss_rate = 0;
+};
+
+struct LinkStats {
+  int64_t delivered_packets = 0;
+  int64_t delivered_bytes = 0;
+  int64_t dropped_queue = 0;
+  int64_t dropped_loss = 0;
+  int peak_queue = 0;
+};
+
+class SimEndpoint;
+
+// 多个端点共享的链路，按目的地址把数据报交给对应端点
+class SimLink {
+ public:
+  SimLink(Simulator *simulator, const LinkConfig &config);
+
+  void Attach(const struct sockaddr_in &address, SimEndpoint *endpoint);
+  void Transmit(const void *data, size_t length, const struct sockaddr_in &source,
+                const struct sockaddr_in &destination);
+
+  const LinkConfig &config() const { return config_; }
+  const LinkStats &stats() const { return stats_; }
+
+ private:
+  using AddressKey = std::pair<uint32_t, uint16_t>;
+  static AddressKey key(const struct sockaddr_in &address);
+
+  Simulator *simulator_;
+  LinkConfig config_;
+  LinkStats stats_;
+  // 队列中（含正在发送）各数据报离开瓶颈的时间
+  std::deque<int64_t> departures_;
+  int64_t busy_until_us_;
+  std::map<AddressKey, SimEndpoint *> endpoints_;
+};
+
+// 模拟链路上的一个地址，数据报由 outgoing 链路发出，到达的数据报在 inbox 中排队
+class SimEndpoint : public Transport {
+ public:
+  SimEndpoint(SimLink *outgoing, const struct sockaddr_in &address)
+      : outgoing_(outgoing), address_(address) {}
+
+  ssize_t SendTo(const void *data, size_t length,
+                 const struct sockaddr_in &destination) override;
+  // 没有控制信息（不模拟内核丢包计数），超过 iovec 总长度的部分截断
+  ssize_t ReceiveMessage(struct msghdr *message, int flags) override;
+  int fd() const override { return -1; }
+
+  void Deliver(std::string datagram, const struct sockaddr_in &source);
+  size_t pending() const { return inbox_.size(); }
+  const struct sockaddr_in &address() const { return address_; }
+
+  // 有数据报到达时调用
+  std::function<void()> on_readable_;
+
+ private:
+  SimLink *outgoing_;
+  struct sockaddr_in address_;
+  std::deque<std::pair<std::string, struct sockaddr_in>> inbox_;
+};
+
+// 单个流的设置
+struct FlowConfig {
+  int64_t file_bytes = 0;  // 0 表示使用 ScenarioConfig::file_bytes
+  int weight = 1;  // 以下两项只在使用发送调度器时生效
+  int64_t rate_limit_bps = 0;
+};
+
+// 一次模拟：flows 个服务端/客户端对共享 forward（服务端到客户端）瓶颈，
+// ACK 与请求走 reverse 链路；第 i 个流在 i * flow_start_spacing_us 时开始下载
+struct ScenarioConfig {
+  LinkConfig forward;
+  LinkConfig reverse;
+  int flows = 1;
+  int64_t file_bytes = 4 * 1024 * 1024;
+  int window = 64;  // 服务端 rwnd 与客户端接收窗口
+  int packet_size = 0;  // 大于 MAX_PACKET_SIZE 时协商大分段
+  int initial_window = 0;  // 服务端初始拥塞窗口，0 表示默认值
+  int64_t flow_start_spacing_us = 0;
+  int64_t time_limit_us = 600LL * 1000000;
+  uint64_t seed = 1;
+  // 服务端使用的路径参数缓存，默认不使用，使结果不受之前场景的影响
+  PathMetricsCache *path_metrics = nullptr;
+  // 第 i 个流使用 flow_configs[i % size]，为空时所有流相同
+  std::vector<FlowConfig> flow_configs;
+  // 所有服务端会话共享一个 TransmitScheduler，出口速率为 scheduler_rate_bps（0 表示不限）
+  bool transmit_scheduler = false;
+  int64_t scheduler_rate_bps = 0;
+  // 服务端文件与各流的输出目录所在的目录，需已存在
+  std::string work_dir;
+};
+
+struct FlowResult {
+  int64_t file_bytes = 0;
+  int weight = 1;
+  bool completed = false;
+  bool verified = false;  // 输出文件与源文件一致
+  int64_t start_us = 0;
+  int64_t finish_us = 0;
+  double throughput_bps = 0;
+  int64_t retransmits = 0;
+  // 第一个流完成时已被确认的字节数，即所有流同时竞争期间各自得到的份额
+  int64_t contended_bytes = 0;
+};
+
+struct ScenarioResult {
+  std::vector<FlowResult> flows;
+  // 从第一个流开始到最后一个流完成的虚拟时间
+  int64_t duration_us = 0;
+  // 全部流的有效吞吐之和占瓶颈带宽的比例
+  double utilization = 0;
+  // 各流吞吐的 Jain 公平性指数
+  double fairness = 0;
+  // 竞争期间各流按权重归一化后份额的 Jain 指数，文件大小不同时比 fairness 更有意义
+  double contended_fairness = 0;
+  LinkStats forward;
+  LinkStats reverse;
+};
+
+ScenarioResult RunScenario(const ScenarioConfig &config);
+// Jain 公平性指数 (Σx)^2 / (n·Σx^2)，所有值相等时为 1
+double JainFairness(const std::vector<double> &values);
+}  // namespace safe_udp
@@ -0,0 +1,102 @@
+#include "socket_buffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include <glog/logging.h>
+
+namespace safe_udp {
+namespace {
+int get_buffer(int sockfd, int option) {
+  int value = 0;
+  socklen_t length = sizeof(value);
+  if (getsockopt(sockfd, SOL_SOCKET, option, &value, &length) < 0) {
+    return 0;
+  }
+  return value;
+}
+}  // namespace
+
+SocketBufferManager::SocketBufferManager(int sockfd) {
+  sockfd_ = sockfd;
+  cap_bytes_ = DefaultCap();
+  default_receive_bytes_ = get_buffer(sockfd, SO_RCVBUF);
+  default_send_bytes_ = get_buffer(sockfd, SO_SNDBUF);
+  receive_bytes_ = default_receive_bytes_;
+  send_bytes_ = default_send_bytes_;
+  // 默认大小已经足够的窗口不需要调整
+  target_bytes_ = std::min(default_receive_bytes_, default_send_bytes_);
+  last_drop_count_ = 0;
+}
+
+int64_t SocketBufferManager::DefaultCap() {
+  static const int64_t cap = []() -> int64_t {
+    const char *value = getenv("SAFE_UDP_SOCKET_BUFFER_MB");
+    if (value != nullptr) {
+      return atoll(value) * 1024 * 1024;
+    }
+    return DEFAULT_SOCKET_BUFFER_CAP;
+  }();
+  return cap;
+}
+
+bool SocketBufferManager::ReadDropCount(struct msghdr *message,
+                                        uint32_t *drop_count) {
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(message); cmsg != nullptr;
+       cmsg = CMSG_NXTHDR(message, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+      memcpy(drop_count, CMSG_DATA(cmsg), sizeof(*drop_count));
+      return true;
+    }
+  }
+  return false;
+}
+
+bool SocketBufferManager::EnableDropCounting() {
+  int enable = 1;
+  if (setsockopt(sockfd_, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable)) < 0) {
+    LOG(WARNING) << "SO_RXQ_OVFL unsupported, kernel drops are not counted";
+    return false;
+  }
+  return true;
+}
+
+void SocketBufferManager::Resize(int packets, int packet_size) {
+  int64_t target = static_cast<int64_t>(packets) *
+                   (packet_size + SOCKET_BUFFER_PACKET_OVERHEAD);
+  target = std::min(target, cap_bytes_);
+  // 只增不减：未占用的缓冲区不消耗内存，而超时后窗口回到 1 又会很快恢复。
+  // 增长时至少翻倍，慢启动期间只需要对数次 setsockopt
+  if (target <= target_bytes_) {
+    return;
+  }
+  target_bytes_ = std::min(std::max(target, target_bytes_ * 2), cap_bytes_);
+  receive_bytes_ = apply(SO_RCVBUFFORCE, SO_RCVBUF,
+                         std::max<int64_t>(target_bytes_, default_receive_bytes_));
+  send_bytes_ = apply(SO_SNDBUFFORCE, SO_SNDBUF,
+                      std::max<int64_t>(target_bytes_, default_send_bytes_));
+  LOG(INFO) << "Socket buffers for " << packets << " x " << packet_size
+            << " bytes: rcvbuf " << receive_bytes_ << " sndbuf " << send_bytes_;
+}
+
+int SocketBufferManager::apply(int force_option, int option, int bytes) {
+  // 内核会把设置值翻倍以容纳簿记开销，目标中已经计入了开销，因此只设置一半
+  int value = std::max(bytes / 2, 1);
+  if (setsockopt(sockfd_, SOL_SOCKET, force_option, &value, sizeof(value)) < 0) {
+    setsockopt(sockfd_, SOL_SOCKET, option, &value, sizeof(value));
+  }
+  return get_buffer(sockfd_, option);
+}
+
+int64_t SocketBufferManager::OnDropCount(uint32_t cumulative) {
+  // 计数为 32 位且会回绕，按无符号差值计算
+  uint32_t delta = cumulative - last_drop_count_;
+  last_drop_count_ = cumulative;
+  return delta;
+}
+
+int SocketBufferManager::ReceiveCapacity(int packet_size) const {
+  return receive_bytes_ / (packet_size + SOCKET_BUFFER_PACKET_OVERHEAD);
+}
+}  // namespace safe_udp
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <sys/socket.h>
+#include <cstdint>
+
+// 套接字缓冲区管理：按当前窗口（分段数 × 分段大小）调整 SO_RCVBUF/SO_SNDBUF，
+// 并开启 SO_RXQ_OVFL，从 recvmsg 的控制信息中得到内核因接收缓冲区满而丢弃的数据报数。
+// 默认缓冲区在突发窗口下会被内核静默丢包，发送端只能把它当作拥塞丢包处理。
+namespace safe_udp {
+// 缓冲区上限，可通过 SAFE_UDP_SOCKET_BUFFER_MB 修改
+constexpr int64_t DEFAULT_SOCKET_BUFFER_CAP = 16LL * 1024 * 1024;
+// 每个数据报在内核中除数据之外的开销（sk_buff 等）估计值
+constexpr int SOCKET_BUFFER_PACKET_OVERHEAD = 768;
+// recvmsg 接收 SO_RXQ_OVFL 控制信息所需的缓冲区大小
+constexpr size_t DROP_COUNT_CONTROL_SIZE = CMSG_SPACE(sizeof(uint32_t));
+
+class SocketBufferManager {
+ public:
+  explicit SocketBufferManager(int sockfd);
+
+  static int64_t DefaultCap();
+  // 从控制信息中取出累计丢包数，没有该控制信息时返回 false
+  static bool ReadDropCount(struct msghdr *message, uint32_t *drop_count);
+
+  // 开启 SO_RXQ_OVFL，之后每个数据报的控制信息都带有套接字累计丢包数
+  bool EnableDropCounting();
+  // 让收发缓冲区都能容纳 packets 个 packet_size 字节的数据报，不超过 cap_bytes_。
+  // 缓冲区只增不减，目标没有超过当前大小时直接返回，可以在每次补满窗口时调用
+  void Resize(int packets, int packet_size);
+  // cumulative 为控制信息中的累计丢包数，返回自上次以来新增的丢包数
+  int64_t OnDropCount(uint32_t cumulative);
+  // 当前接收缓冲区大约能容纳的 packet_size 字节数据报个数
+  int ReceiveCapacity(int packet_size) const;
+
+  int receive_buffer_bytes() const { return receive_bytes_; }
+  int send_buffer_bytes() const { return send_bytes_; }
+
+  int64_t cap_bytes_;
+
+ private:
+  // 优先使用 *FORCE 选项突破 rmem_max/wmem_max（需要 CAP_NET_ADMIN），返回内核实际采用的大小
+  int apply(int force_option, int option, int bytes);
+
+  int sockfd_;
+  int default_receive_bytes_;
+  int default_send_bytes_;
+  int receive_bytes_;
+  int send_bytes_;
+  int64_t target_bytes_;  // 已经设置的最大目标
+  uint32_t last_drop_count_;
+};
+}  // namespace safe_udp
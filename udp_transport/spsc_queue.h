@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+namespace safe_udp {
+// 单生产者单消费者无锁队列，容量 N 必须是 2 的幂。
+// 生产者只写 tail_，消费者只写 head_，两者分处不同缓存行避免伪共享
+template <typename T, size_t N>
+class SpscQueue {
+  static_assert((N & (N - 1)) == 0, "SpscQueue capacity must be a power of 2");
+
+ public:
+  SpscQueue() : head_(0), tail_(0) {}
+
+  // 队列已满时返回 false
+  bool Push(const T &item) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == N) {
+      return false;
+    }
+    items_[tail & (N - 1)] = item;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool Pop(T *item) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    *item = items_[head & (N - 1)];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool Empty() const {
+    return head_.load(std::memory_order_acquire) ==
+           tail_.load(std::memory_order_acquire);
+  }
+
+ private:
+  alignas(64) std::atomic<size_t> head_;
+  alignas(64) std::atomic<size_t> tail_;
+  alignas(64) T items_[N];
+};
+}  // namespace safe_udp
@@ -0,0 +1,93 @@
+#include "trace.h"
+
+#include <stdio.h>
+#include <chrono>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <glog/logging.h>
+
+namespace safe_udp {
+namespace {
+int64_t steady_now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+}  // namespace
+
+uint64_t ReadTsc() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return static_cast<uint64_t>(steady_now_ns());
+#endif
+}
+
+TraceRing::TraceRing(uint32_t thread_id)
+    : thread_id_(thread_id), head_(0), events_(new TraceEvent[TRACE_RING_SIZE]) {}
+
+std::vector<TraceEvent> TraceRing::Snapshot() const {
+  uint64_t head = head_.load(std::memory_order_acquire);
+  uint64_t count = head < TRACE_RING_SIZE ? head : TRACE_RING_SIZE;
+  std::vector<TraceEvent> events;
+  events.reserve(count);
+  for (uint64_t i = head - count; i < head; i++) {
+    events.push_back(events_[i & (TRACE_RING_SIZE - 1)]);
+  }
+  return events;
+}
+
+Tracer &Tracer::Instance() {
+  static Tracer tracer;
+  return tracer;
+}
+
+Tracer::Tracer() {
+  tsc_base_ = ReadTsc();
+  steady_base_ns_ = steady_now_ns();
+}
+
+TraceRing *Tracer::register_ring() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  rings_.push_back(std::make_unique<TraceRing>(rings_.size()));
+  return rings_.back().get();
+}
+
+bool Tracer::Dump(const std::string &file_path) {
+  // 用两次采样之间的 TSC 增量换算频率，解码时据此把 TSC 转成微秒
+  uint64_t tsc_now = ReadTsc();
+  int64_t elapsed_ns = steady_now_ns() - steady_base_ns_;
+  uint64_t tsc_hz = 1000000000;
+#if defined(__x86_64__) || defined(__i386__)
+  if (elapsed_ns > 0) {
+    tsc_hz = static_cast<uint64_t>((tsc_now - tsc_base_) * 1e9 / elapsed_ns);
+  }
+#endif
+
+  FILE *file = fopen(file_path.c_str(), "wb");
+  if (file == nullptr) {
+    LOG(ERROR) << "Failed to open trace file " << file_path;
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint32_t ring_count = rings_.size();
+  fwrite(TRACE_FILE_MAGIC, sizeof(TRACE_FILE_MAGIC), 1, file);
+  fwrite(&tsc_hz, sizeof(tsc_hz), 1, file);
+  fwrite(&tsc_base_, sizeof(tsc_base_), 1, file);
+  fwrite(&ring_count, sizeof(ring_count), 1, file);
+  for (const auto &ring : rings_) {
+    std::vector<TraceEvent> events = ring->Snapshot();
+    uint64_t event_count = events.size();
+    fwrite(&ring->thread_id_, sizeof(ring->thread_id_), 1, file);
+    fwrite(&event_count, sizeof(event_count), 1, file);
+    fwrite(events.data(), sizeof(TraceEvent), events.size(), file);
+  }
+  fclose(file);
+  LOG(INFO) << "Trace written to " << file_path;
+  return true;
+}
+}  // namespace safe_udp
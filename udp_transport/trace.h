@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 二进制事件追踪：每个线程一个无锁环形缓冲区，热路径上只写入定长事件和 TSC 时间戳，
+// 结束时统一落盘，由 tools/trace_decode 离线解析为文本或 qlog 风格的 JSON。
+// 未定义 SAFE_UDP_TRACING 时所有 SAFE_UDP_TRACE* 宏展开为空语句，不产生任何开销。
+namespace safe_udp {
+enum class TraceEventType : uint16_t {
+  PACKET_SENT = 1,   // a: seq_number  b: data length
+  ACK_RECEIVED = 2,  // a: ack_number  b: cwnd
+  DUP_ACK = 3,       // a: ack_number  b: dup ack count
+  RETRANSMIT = 4,    // a: seq_number  b: 0 超时重传 / 1 快速重传 / 2 尾部丢包探测
+  CWND_CHANGE = 5,   // a: cwnd        b: ssthresh
+  RTT_SAMPLE = 6,    // a: sample(us)  b: smoothed rtt(us)
+  PACKET_RECEIVED = 7,  // a: seq_number  b: data length
+  ACK_SENT = 8,         // a: ack_number  b: 0
+  PACKET_DROPPED = 9,   // a: seq_number  b: 0 模拟丢包 / 1 超出接收窗口 / 2 校验失败
+  TIMEOUT = 10,         // a: timeout(us) b: cwnd
+};
+
+// 定长 32 字节事件
+struct TraceEvent {
+  uint64_t tsc;
+  uint16_t type;
+  uint16_t reserved;
+  uint32_t sequence;  // 线程内事件序号的低 32 位，用于检测覆盖
+  int64_t a;
+  int64_t b;
+};
+
+constexpr char TRACE_FILE_MAGIC[8] = {'S', 'U', 'D', 'P', 'T', 'R', 'C', '1'};
+#ifndef SAFE_UDP_TRACE_RING_SIZE
+constexpr uint64_t TRACE_RING_SIZE = 1 << 16;  // 必须是 2 的幂
+#else
+constexpr uint64_t TRACE_RING_SIZE = SAFE_UDP_TRACE_RING_SIZE;
+#endif
+
+uint64_t ReadTsc();
+
+// 单生产者环形缓冲区：只有所属线程写入，写满后覆盖最旧的事件
+class TraceRing {
+ public:
+  explicit TraceRing(uint32_t thread_id);
+  ~TraceRing() {}
+
+  void Record(TraceEventType type, int64_t a, int64_t b) {
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    TraceEvent &event = events_[head & (TRACE_RING_SIZE - 1)];
+    event.tsc = ReadTsc();
+    event.type = static_cast<uint16_t>(type);
+    event.reserved = 0;
+    event.sequence = static_cast<uint32_t>(head);
+    event.a = a;
+    event.b = b;
+    head_.store(head + 1, std::memory_order_release);
+  }
+
+  // 拷贝出当前保留的事件（按时间顺序），应在写入线程停止后调用
+  std::vector<TraceEvent> Snapshot() const;
+
+  uint32_t thread_id_;
+
+ private:
+  std::atomic<uint64_t> head_;
+  std::unique_ptr<TraceEvent[]> events_;
+};
+
+class Tracer {
+ public:
+  static Tracer &Instance();
+
+  // 当前线程的环形缓冲区，首次调用时注册（只有注册时加锁）
+  static TraceRing *LocalRing() {
+    thread_local TraceRing *ring = Instance().register_ring();
+    return ring;
+  }
+
+  // 文件格式：magic(8) | tsc_hz(8) | tsc_base(8) | ring_count(4)
+  //          每个 ring: thread_id(4) | event_count(8) | TraceEvent[event_count]
+  bool Dump(const std::string &file_path);
+
+ private:
+  Tracer();
+  TraceRing *register_ring();
+
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<TraceRing>> rings_;
+  uint64_t tsc_base_;
+  int64_t steady_base_ns_;
+};
+}  // namespace safe_udp
+
+#ifdef SAFE_UDP_TRACING
+#define SAFE_UDP_TRACE(type, a, b)                                         \
+  ::safe_udp::Tracer::LocalRing()->Record(::safe_udp::TraceEventType::type, \
+                                          (a), (b))
+// 环境变量 SAFE_UDP_TRACE_FILE 指定输出文件时落盘
+#define SAFE_UDP_TRACE_DUMP()                                  \
+  do {                                                         \
+    const char *trace_file = getenv("SAFE_UDP_TRACE_FILE");    \
+    if (trace_file != nullptr) {                               \
+      ::safe_udp::Tracer::Instance().Dump(trace_file);         \
+    }                                                          \
+  } while (0)
+#else
+#define SAFE_UDP_TRACE(type, a, b) \
+  do {                             \
+  } while (0)
+#define SAFE_UDP_TRACE_DUMP() \
+  do {                        \
+  } while (0)
+#endif
@@ -0,0 +1,148 @@
+#include "transmit_scheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <glog/logging.h>
+
+namespace safe_udp {
+void TransmitScheduler::TokenBucket::Refill(int64_t now_us) {
+  if (rate_bps > 0 && now_us > updated_us) {
+    double burst = rate_bps / 8.0 * SCHEDULER_BURST_US / 1e6;
+    tokens = std::min(tokens + rate_bps / 8.0 * (now_us - updated_us) / 1e6, burst);
+  }
+  updated_us = std::max(updated_us, now_us);
+}
+
+int64_t TransmitScheduler::TokenBucket::ReadyUs() const {
+  if (rate_bps <= 0 || tokens > 0) {
+    return updated_us;
+  }
+  return updated_us + static_cast<int64_t>(std::ceil(-tokens * 8e6 / rate_bps)) + 1;
+}
+
+TransmitScheduler::TransmitScheduler(int64_t rate_bps, int quantum_bytes)
+    : quantum_bytes_(std::max(quantum_bytes, 1)), dispatching_(false) {
+  bucket_.rate_bps = rate_bps;
+}
+
+void TransmitScheduler::Add(TransmitSource *source, const TransmitOptions &options) {
+  Session &session = sessions_[source];
+  session.source = source;
+  session.weight = std::max(options.weight, 1);
+  session.bucket.rate_bps = options.rate_limit_bps;
+  LOG(INFO) << "Scheduler session added: weight " << session.weight
+            << ", rate limit " << options.rate_limit_bps << " bps";
+}
+
+void TransmitScheduler::Remove(TransmitSource *source) {
+  auto it = sessions_.find(source);
+  if (it == sessions_.end()) {
+    return;
+  }
+  Session *session = &it->second;
+  active_.erase(std::remove(active_.begin(), active_.end(), session), active_.end());
+  throttled_.erase(std::remove(throttled_.begin(), throttled_.end(), session),
+                   throttled_.end());
+  sessions_.erase(it);
+}
+
+void TransmitScheduler::Activate(TransmitSource *source) {
+  auto it = sessions_.find(source);
+  if (it == sessions_.end() || it->second.active || it->second.throttled) {
+    return;
+  }
+  enqueue(&it->second);
+}
+
+void TransmitScheduler::enqueue(Session *session) {
+  bool was_idle = active_.empty();
+  session->active = true;
+  session->credited = false;
+  active_.push_back(session);
+  // Dispatch 返回后调用方本来就会查询 NextDispatchUs，不需要再唤醒
+  if (was_idle && !dispatching_ && on_backlog_) {
+    on_backlog_();
+  }
+}
+
+int TransmitScheduler::Dispatch(int64_t now_us) {
+  dispatching_ = true;
+  // 速率上限到期的会话回到活动队列
+  for (auto it = throttled_.begin(); it != throttled_.end();) {
+    Session *session = *it;
+    if (session->throttled_until_us > now_us) {
+      ++it;
+      continue;
+    }
+    session->throttled = false;
+    it = throttled_.erase(it);
+    enqueue(session);
+  }
+
+  bucket_.Refill(now_us);
+  int sent = 0;
+  while (!active_.empty()) {
+    if (bucket_.rate_bps > 0 && bucket_.tokens <= 0) {
+      break;
+    }
+    Session *session = active_.front();
+    int bytes = session->source->NextSegmentBytes();
+    if (bytes <= 0) {
+      // 没有可发送的分段就离开队列，额度不保留（DRR 中空闲的流不积累额度）
+      active_.pop_front();
+      session->active = false;
+      session->deficit = 0;
+      continue;
+    }
+    if (!session->credited) {
+      session->deficit += quantum_bytes_ * session->weight;
+      session->credited = true;
+    }
+    if (session->deficit < bytes) {
+      // 本轮额度用完，排到队尾等下一轮
+      active_.pop_front();
+      session->credited = false;
+      active_.push_back(session);
+      continue;
+    }
+    if (session->bucket.rate_bps > 0) {
+      session->bucket.Refill(now_us);
+      if (session->bucket.tokens <= 0) {
+        active_.pop_front();
+        session->active = false;
+        session->credited = false;
+        session->throttled = true;
+        session->throttled_until_us = session->bucket.ReadyUs();
+        throttled_.push_back(session);
+        rate_limited_++;
+        continue;
+      }
+      session->bucket.tokens -= bytes;
+    }
+
+    session->source->TransmitSegment();
+    session->deficit -= bytes;
+    if (bucket_.rate_bps > 0) {
+      bucket_.tokens -= bytes;
+    }
+    dispatched_packets_++;
+    dispatched_bytes_.Add(bytes);
+    sent++;
+  }
+  dispatching_ = false;
+  return sent;
+}
+
+int64_t TransmitScheduler::NextDispatchUs() const {
+  int64_t next = std::numeric_limits<int64_t>::max();
+  if (!active_.empty()) {
+    next = bucket_.ReadyUs();
+  }
+  for (const Session *session : throttled_) {
+    next = std::min(next, session->throttled_until_us);
+  }
+  return next;
+}
+}  // namespace safe_udp
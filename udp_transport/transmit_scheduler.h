@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "metrics.h"
+
+// 服务端的发送调度：多个会话共享出口时，窗口有空位的会话不再各自立即发送，
+// 而是登记为待发送，由调度器按加权 DRR（Deficit Round Robin）轮流取分段发出。
+// 每轮每个会话获得 quantum * weight 字节的额度，发送多的会话不能挤占发送少的会话；
+// 没有数据或窗口已满的会话不在活动队列中，不会被扫描。
+// 可以为调度器设置出口总速率，并为单个会话（客户端）设置速率上限，均为令牌桶。
+// 调度器与登记的会话必须由同一个线程驱动。
+namespace safe_udp {
+// 令牌桶最多积累的时间，决定速率限制下的最大突发
+constexpr int64_t SCHEDULER_BURST_US = 2000;
+
+// 由调度器驱动发送的会话
+class TransmitSource {
+ public:
+  virtual ~TransmitSource() = default;
+  // 下一个分段的大小（字节，含头部），窗口已满或没有数据时返回 0
+  virtual int NextSegmentBytes() = 0;
+  // 发送下一个分段
+  virtual void TransmitSegment() = 0;
+};
+
+struct TransmitOptions {
+  int weight = 1;
+  // 该会话的速率上限，0 表示不限
+  int64_t rate_limit_bps = 0;
+};
+
+class TransmitScheduler {
+ public:
+  // rate_bps 为所有会话合计的出口速率，0 表示不限（只决定发送顺序）；
+  // quantum_bytes 为权重 1 的会话每轮的额度
+  TransmitScheduler(int64_t rate_bps, int quantum_bytes);
+
+  void Add(TransmitSource *source, const TransmitOptions &options);
+  void Remove(TransmitSource *source);
+  // 会话有分段可以发送时调用，已在队列中时不做任何事
+  void Activate(TransmitSource *source);
+
+  // 按 DRR 顺序发送，直到没有会话可以发送或出口令牌用完，返回发送的分段数
+  int Dispatch(int64_t now_us);
+  // 下一次需要调用 Dispatch 的时间，没有待发送的会话时返回 INT64_MAX
+  int64_t NextDispatchUs() const;
+
+  // 活动队列由空变为非空时调用，外部事件循环借此唤醒调度
+  std::function<void()> on_backlog_;
+
+  Counter dispatched_packets_;
+  Counter dispatched_bytes_;
+  Counter rate_limited_;  // 会话因速率上限暂停的次数
+
+ private:
+  struct TokenBucket {
+    int64_t rate_bps = 0;
+    double tokens = 0;
+    int64_t updated_us = 0;
+
+    void Refill(int64_t now_us);
+    // 令牌用成负数之后，恢复为正数的时间
+    int64_t ReadyUs() const;
+  };
+
+  struct Session {
+    TransmitSource *source = nullptr;
+    int weight = 1;
+    int64_t deficit = 0;
+    bool active = false;
+    // 本轮额度是否已经加过，会话重新排到队尾时清除
+    bool credited = false;
+    // 因速率上限暂停，到 throttled_until_us 再放回活动队列
+    bool throttled = false;
+    int64_t throttled_until_us = 0;
+    TokenBucket bucket;
+  };
+
+  void enqueue(Session *session);
+
+  int64_t quantum_bytes_;
+  bool dispatching_;
+  TokenBucket bucket_;
+  std::unordered_map<TransmitSource *, Session> sessions_;
+  std::deque<Session *> active_;
+  std::vector<Session *> throttled_;
+};
+}  // namespace safe_udp
@@ -0,0 +1,14 @@
+#include "transport.h"
+
+namespace safe_udp {
+ssize_t SocketTransport::SendTo(const void *data, size_t length,
+                                const struct sockaddr_in &destination) {
+  return sendto(sockfd_, data, length, 0,
+                reinterpret_cast<const struct sockaddr *>(&destination),
+                sizeof(destination));
+}
+
+ssize_t SocketTransport::ReceiveMessage(struct msghdr *message, int flags) {
+  return recvmsg(sockfd_, message, flags);
+}
+}  // namespace safe_udp
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+// 数据报收发接口：UdpServer/UdpClient 的所有收发都经过它，
+// 真实运行时是 UDP 套接字，离散事件模拟器中是模拟链路上的端点（见 simulator.h）
+namespace safe_udp {
+class Transport {
+ public:
+  virtual ~Transport() = default;
+  // 语义与 sendto 相同
+  virtual ssize_t SendTo(const void *data, size_t length,
+                         const struct sockaddr_in &destination) = 0;
+  // 语义与 recvmsg 相同：支持分散的 iovec、msg_name 与控制信息；
+  // flags 含 MSG_DONTWAIT 时不阻塞，没有数据时返回 -1 且 errno 为 EAGAIN
+  virtual ssize_t ReceiveMessage(struct msghdr *message, int flags) = 0;
+  // 底层套接字，没有真实套接字时返回 -1，调用方据此跳过 setsockopt/poll/io_uring 等系统调用
+  virtual int fd() const = 0;
+};
+
+// 基于已有 UDP 套接字的实现，不持有套接字（由创建者负责关闭）
+class SocketTransport : public Transport {
+ public:
+  explicit SocketTransport(int sockfd) : sockfd_(sockfd) {}
+
+  ssize_t SendTo(const void *data, size_t length,
+                 const struct sockaddr_in &destination) override;
+  ssize_t ReceiveMessage(struct msghdr *message, int flags) override;
+  int fd() const override { return sockfd_; }
+
+ private:
+  int sockfd_;
+};
+}  // namespace safe_udp
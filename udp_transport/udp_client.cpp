@@ -1,8 +1,15 @@
 #include "udp_client.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <netdb.h>
+#include <poll.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -10,126 +17,824 @@
 #include <glog/logging.h>
 
 #include "data_segment.h"
+#include "handshake.h"
+#include "path_mtu.h"
+#include "trace.h"
 
 namespace safe_udp {
 UdpClient::UdpClient() {
+  sockfd_ = -1;
+  is_packet_drop_ = false;
+  is_delay_ = false;
+  prob_value_ = 0;
+  status_ = DownloadStatus::IDLE;
+  deadline_us_ = 0;
+  idle_timeout_us_ = DEFAULT_IDLE_TIMEOUT_US;
+  file_length_ = -1;
+  content_length_ = -1;
+  bytes_received_ = 0;
+  resume_offset_ = 0;
+  handshake_rtt_us_ = 0;
+  resume_ = false;
+  rtt_hint_us_ = 0;
+  bundle_ = false;
+  verify_digest_ = true;
+  digest_enabled_ = false;
+  digested_until_ = 0;
+  digest_verified_ = false;
+  bundle_files_ = 0;
+  start_time_us_ = 0;
+  last_activity_us_ = 0;
+  next_request_retry_us_ = 0;
+  request_sent_us_ = 0;
+  request_attempts_ = 0;
   last_in_order_packet_ = -1;
   last_packet_received_ = -1;
   fin_flag_received_ = false;
+  packet_statistics_ = std::make_unique<PacketStatistics>();
+  receiver_window_ = 0;
+  advertised_window_ = 0;
+  window_credit_ = 0;
+  output_dir_ = CLIENT_FILE_PATH;
+  max_packet_size_ = MAX_PACKET_SIZE;
+  packet_size_ = MAX_PACKET_SIZE;
+  data_size_ = MAX_DATA_SIZE;
+  zero_copy_receive_ = true;
+  output_fd_ = -1;
+  mapping_ = nullptr;
+  next_segment_ = 0;
+  highest_segment_ = -1;
 }
 
-void UdpClient::SendFileRequest(const std::string &file_name) {
-  int n;
-  int next_seq_expected;
-  int segments_in_between = 0;
-  initial_seq_number_ = 67;
-  if (receiver_window_ == 0) {
-    receiver_window_ = 100;
+const char *DownloadStatusName(DownloadStatus status) {
+  switch (status) {
+    case DownloadStatus::IDLE:
+      return "idle";
+    case DownloadStatus::HANDSHAKE:
+      return "handshake";
+    case DownloadStatus::TRANSFER:
+      return "transfer";
+    case DownloadStatus::COMPLETED:
+      return "completed";
+    case DownloadStatus::FILE_NOT_FOUND:
+      return "file not found";
+    case DownloadStatus::TIMED_OUT:
+      return "timed out";
+    case DownloadStatus::DIGEST_MISMATCH:
+      return "digest mismatch";
+    case DownloadStatus::FAILED:
+      return "failed";
   }
-  unsigned char *buffer =
-      (unsigned char *)calloc(MAX_PACKET_SIZE, sizeof(unsigned char));
+  return "unknown";
+}
+
+void UdpClient::SendFileRequest(const std::string &file_name) {
   LOG(INFO) << "server_add::" << server_address_.sin_addr.s_addr;
   LOG(INFO) << "server_add_port::" << server_address_.sin_port;
   LOG(INFO) << "server_add_family::" << server_address_.sin_family;
-  n = sendto(sockfd_, file_name.c_str(), file_name.size(), 0,        
-             (struct sockaddr *)&(server_address_), sizeof(struct sockaddr_in)); // 请求文件名file_name           //sendto
+
+  if (low_latency_.enabled) {
+    PinCurrentThread(low_latency_.cpu);
+  }
+  if (!StartDownload(file_name, NowMicros())) {
+    return;
+  }
+  while (Step(NowMicros())) {
+    int64_t wait_us = NextTimeoutUs() - NowMicros();
+    if (low_latency_.enabled) {
+      // 数据在自旋预算内到达时不经过睡眠/唤醒；否则按微秒精度等待，不向上取整到毫秒
+      if (!SpinUntilReadable(sockfd_, std::min(wait_us, low_latency_.spin_budget_us))) {
+        WaitReadable(sockfd_, NextTimeoutUs() - NowMicros());
+      }
+      continue;
+    }
+    struct pollfd pfd;
+    pfd.fd = sockfd_;
+    pfd.events = POLLIN;
+    poll(&pfd, 1, wait_us > 0 ? static_cast<int>((wait_us + 999) / 1000) : 0);
+  }
+  if (status_ == DownloadStatus::FILE_NOT_FOUND) {
+    LOG(ERROR) << "File not found !!!";
+  } else if (status_ != DownloadStatus::COMPLETED) {
+    LOG(ERROR) << "Download " << DownloadStatusName(status_) << " !!!";
+  }
+}
+
+bool UdpClient::StartDownload(const std::string &file_name, int64_t now_us) {
+  if (status_ == DownloadStatus::HANDSHAKE || status_ == DownloadStatus::TRANSFER) {
+    LOG(ERROR) << "A download is already in progress";
+    return false;
+  }
+  // 同一个客户端可以依次下载多个文件，上一次下载的状态全部清除
+  initial_seq_number_ = DEFAULT_INITIAL_SEQ_NUMBER;
+  last_in_order_packet_ = -1;
+  last_packet_received_ = -1;
+  fin_flag_received_ = false;
+  data_segments_.clear();
+  packet_size_ = MAX_PACKET_SIZE;
+  data_size_ = MAX_DATA_SIZE;
+  segment_received_.clear();
+  next_segment_ = 0;
+  highest_segment_ = -1;
+  if (receiver_window_ == 0) {
+    receiver_window_ = 100;
+  }
+  file_name_ = file_name;
+  start_time_us_ = now_us;
+  last_activity_us_ = now_us;
+  file_length_ = -1;
+  content_length_ = -1;
+  bytes_received_ = 0;
+  resume_offset_ = 0;
+  handshake_rtt_us_ = 0;
+  request_sent_us_ = now_us;
+  request_attempts_ = 0;
+  digest_enabled_ = false;
+  digest_ = FileDigest();
+  digested_until_ = 0;
+  digest_verified_ = false;
+  bundle_writer_.reset();
+  bundle_files_ = 0;
+
+  HandshakeRequest request;
+  request.file_name_ = file_name;
+  request.packet_size_ = MAX_PACKET_SIZE;
+  request.receive_window_ = receiver_window_;
+  request.rtt_hint_us_ = static_cast<uint32_t>(std::max<int64_t>(rtt_hint_us_, 0));
+  request.congestion_control_ = CONGESTION_CONTROL_NEWRENO;
+  request.bundle_ = bundle_;
+  request.digest_ = verify_digest_;
+  cipher_.reset();
+  if (!pre_shared_key_.empty()) {
+    if (!EncryptionAvailable()) {
+      LOG(ERROR) << "Encrypted transfer requested but this build has no encryption support";
+      finish(DownloadStatus::FAILED);
+      return false;
+    }
+    key_nonce_ = NewKeyNonce();
+    request.encrypt_ = true;
+    request.key_nonce_ = key_nonce_;
+  }
+  struct stat existing;
+  if (resume_ && !bundle_ && stat((output_dir_ + file_name).c_str(), &existing) == 0 &&
+      existing.st_size <= INT32_MAX) {
+    request.resume_offset_ = static_cast<uint32_t>(existing.st_size);
+  }
+  if (max_packet_size_ > MAX_PACKET_SIZE && sockfd_ < 0) {
+    // 模拟链路没有 MTU 限制，直接请求上限
+    request.packet_size_ = max_packet_size_;
+  }
+  request_ = request;
+
+  recv_buffer_.assign(MAX_NEGOTIABLE_PACKET_SIZE, 0);
+  if (sockfd_ >= 0) {
+    // 之后的收发全部非阻塞
+    int flags = fcntl(sockfd_, F_GETFL, 0);
+    if (flags < 0 || fcntl(sockfd_, F_SETFL, flags | O_NONBLOCK) < 0) {
+      LOG(ERROR) << "Failed to set socket non-blocking !!!";
+      finish(DownloadStatus::FAILED);
+      return false;
+    }
+    if (low_latency_.enabled) {
+      EnableBusyPoll(sockfd_, low_latency_.busy_poll_us);
+    }
+    // 接收缓冲区按接收窗口预留，并统计内核丢包
+    socket_buffers_ = std::make_unique<SocketBufferManager>(sockfd_);
+    socket_buffers_->EnableDropCounting();
+    socket_buffers_->Resize(receiver_window_, MAX_PACKET_SIZE);
+  }
+  advertised_window_ = advertised_window_limit();
+  window_credit_ = 0;
+
+  status_ = DownloadStatus::HANDSHAKE;
+  mtu_discovery_.reset();
+  if (max_packet_size_ > MAX_PACKET_SIZE && sockfd_ >= 0) {
+    // 只在显式要求大分段时探测。探测在 Step() 中进行（每个大小最多 max_probes_ 个
+    // 探测超时），结束后才发出请求，不阻塞调用者的事件循环
+    mtu_discovery_ = std::make_unique<PathMtuDiscovery>(sockfd_, server_address_);
+    mtu_discovery_->Start(MAX_PACKET_SIZE, max_packet_size_, now_us);
+    if (!mtu_discovery_->IsDone()) {
+      return true;
+    }
+  }
+  begin_handshake(now_us);
+  return true;
+}
+
+void UdpClient::begin_handshake(int64_t now_us) {
+  if (mtu_discovery_) {
+    request_.packet_size_ = mtu_discovery_->result();
+    mtu_discovery_.reset();
+  }
+  request_sent_us_ = now_us;
+  send_request();
+  next_request_retry_us_ = now_us + HANDSHAKE_RETRY_US;
+}
+
+void UdpClient::send_request() {
+  request_attempts_++;
+  std::string request = request_.Serialize();
+  int n = transport_->SendTo(request.data(), request.size(), server_address_); // 请求文件名file_name           //sendto
   if (n < 0) {
     LOG(ERROR) << "Failed to write to socket !!!";
   }
-  memset(buffer, 0, MAX_PACKET_SIZE);
-
-  std::fstream file;
-  std::string file_path = std::string(CLIENT_FILE_PATH) + file_name;
-  file.open(file_path.c_str(), std::ios::out);
+}
 
-  while ((n = recvfrom(sockfd_, buffer, MAX_PACKET_SIZE, 0, NULL, NULL)) > 0) {                               // recvfrom
-    char buffer2[20];
-    memcpy(buffer2, buffer, 20);
-    if (strstr("FILE NOT FOUND", buffer2) != NULL) { // strstr 是一个 C 标准库函数，用于在一个字符串中查找另一个字符串的首次出现
-    // 如果 needle 不是 haystack 的子字符串，则返回 NULL
-      LOG(ERROR) << "File not found !!!";
-      return;
-    }
+bool UdpClient::IsFinished() const {
+  return status_ != DownloadStatus::IDLE &&
+         status_ != DownloadStatus::HANDSHAKE &&
+         status_ != DownloadStatus::TRANSFER;
+}
 
-    std::unique_ptr<DataSegment> data_segment = std::make_unique<DataSegment>(); // 创建文件包
-    data_segment->DeserializeToDataSegment(buffer, n);   // 将数据从缓冲区反序列化到 DataSegment 对象中
+int64_t UdpClient::NextTimeoutUs() const {
+  int64_t timeout = last_activity_us_ + idle_timeout_us_;
+  if (status_ == DownloadStatus::HANDSHAKE) {
+    timeout = std::min(timeout, mtu_discovery_ ? mtu_discovery_->NextTimeoutUs()
+                                               : next_request_retry_us_);
+  }
+  if (deadline_us_ > 0) {
+    timeout = std::min(timeout, start_time_us_ + deadline_us_);
+  }
+  return timeout;
+}
 
-    LOG(INFO) << "packet received with seq_number_:"
-              << data_segment->seq_number_;
+bool UdpClient::Step(int64_t now_us) {
+  if (IsFinished() || status_ == DownloadStatus::IDLE) {
+    return false;
+  }
 
-    // Random drop
-    if (is_packet_drop_ && rand() % 100 < prob_value_) {
-      LOG(INFO) << "Dropping this packet with seq "
-                << data_segment->seq_number_;
-      continue; // 丢包
+  int64_t delivered_before = bytes_received_;
+  while (!IsFinished()) {
+    if (mapping_ != nullptr) {
+      if (receive_into_mapping() < 0) {
+        break;
+      }
+      last_activity_us_ = now_us;
+      continue;
     }
+    struct iovec iov;
+    iov.iov_base = recv_buffer_.data();
+    iov.iov_len = recv_buffer_.size();
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control_buffer_;
+    message.msg_controllen = sizeof(control_buffer_);
+    int n = transport_->ReceiveMessage(&message, MSG_DONTWAIT);                        // recvmsg
+    if (n < 0) {
+      break;
+    }
+    on_receive_control(&message);
+    last_activity_us_ = now_us;
+    if (mtu_discovery_) {
+      mtu_discovery_->OnDatagram(reinterpret_cast<char *>(recv_buffer_.data()), n,
+                                 now_us);
+    } else if (status_ == DownloadStatus::HANDSHAKE) {
+      on_handshake_datagram(reinterpret_cast<char *>(recv_buffer_.data()), n,
+                            now_us);
+    } else {
+      on_data_datagram(recv_buffer_.data(), n);
+    }
+  }
+  if (on_progress_ && bytes_received_ != delivered_before) {
+    DownloadProgress progress;
+    progress.bytes_received = resume_offset_ + std::min(bytes_received_, content_length_);
+    progress.file_length = content_length_ < 0 ? -1 : resume_offset_ + content_length_;
+    on_progress_(progress);
+  }
+  if (IsFinished()) {
+    return false;
+  }
 
-    // Random delay
-    if (is_delay_ && rand() % 100 < prob_value_) {
-      int sleep_time = (rand() % 10) * 1000;
-      LOG(INFO) << "Delaying this packet with seq " << data_segment->seq_number_
-                << " for " << sleep_time << "us";
-      usleep(sleep_time);
+  // 定时器：截止时间、服务端无响应、握手重传
+  if (deadline_us_ > 0 && now_us >= start_time_us_ + deadline_us_) {
+    finish(DownloadStatus::TIMED_OUT);
+    return false;
+  }
+  if (now_us >= last_activity_us_ + idle_timeout_us_) {
+    LOG(ERROR) << "Server not responding for " << idle_timeout_us_ << "us";
+    finish(DownloadStatus::TIMED_OUT);
+    return false;
+  }
+  if (mtu_discovery_) {
+    mtu_discovery_->OnTimeout(now_us);
+    if (mtu_discovery_->IsDone()) {
+      begin_handshake(now_us);
+    }
+    return true;
+  }
+  if (status_ == DownloadStatus::HANDSHAKE && now_us >= next_request_retry_us_) {
+    if (request_attempts_ >= HANDSHAKE_MAX_ATTEMPTS) {
+      LOG(ERROR) << "Handshake with server failed !!!";
+      finish(DownloadStatus::TIMED_OUT);
+      return false;
     }
+    // 请求或应答都可能丢失，超时后重发请求
+    send_request();
+    next_request_retry_us_ = now_us + HANDSHAKE_RETRY_US;
+  }
+  return true;
+}
 
-    if (last_in_order_packet_ == -1) { // 还没有接收到任何按顺序的数据包
-      next_seq_expected = initial_seq_number_;
-    } else {
-      next_seq_expected = data_segments_[last_in_order_packet_].seq_number_ +
-                          data_segments_[last_in_order_packet_].length_; //计算下一个期望的序列号
+void UdpClient::on_handshake_datagram(const char *buffer, int n,
+                                      int64_t now_us) {
+  if (strncmp(buffer, "FILE NOT FOUND", std::min(n, 14)) == 0) {
+    finish(DownloadStatus::FILE_NOT_FOUND);
+    return;
+  }
+  HandshakeResponse response;
+  if (!response.Deserialize(buffer, n)) {
+    return; // 应答前到达的数据段，服务端会在超时后重传
+  }
+  if (!response.file_found_) {
+    finish(DownloadStatus::FILE_NOT_FOUND);
+    return;
+  }
+  if (request_attempts_ == 1) {
+    handshake_rtt_us_ = now_us - request_sent_us_;
+  }
+  packet_size_ = response.packet_size_;
+  data_size_ = packet_size_ - HEADER_LENGTH;
+  if (!pre_shared_key_.empty()) {
+    if (!response.encrypted_) {
+      LOG(ERROR) << "Server does not support encryption";
+      finish(DownloadStatus::FAILED);
+      return;
     }
+    cipher_ = SegmentCipher::Create(pre_shared_key_, key_nonce_, response.key_nonce_);
+    if (!cipher_) {
+      finish(DownloadStatus::FAILED);
+      return;
+    }
+    data_size_ -= GCM_TAG_LENGTH;
+  }
+  if (response.has_transfer_parameters_) {
+    initial_seq_number_ = response.initial_seq_number_;
+    resume_offset_ = std::min<int64_t>(response.resume_offset_, response.file_length_);
+  }
+  file_length_ = response.file_length_ - resume_offset_;
+  content_length_ = file_length_;
+  digest_enabled_ = verify_digest_ && response.digest_;
+  if (digest_enabled_) {
+    file_length_ += DIGEST_LENGTH;
+  }
+  LOG(INFO) << "Negotiated packet size: " << packet_size_
+            << " file length: " << response.file_length_ << " resume offset: "
+            << resume_offset_ << " initial window: " << response.initial_window_;
+  if (socket_buffers_) {
+    socket_buffers_->Resize(receiver_window_, packet_size_);
+  }
+  advertised_window_ = std::min(advertised_window_, advertised_window_limit());
 
-    // Old packet
-    // 假若 10000 > 5000
-    if (next_seq_expected > data_segment->seq_number_ && !data_segment->fin_flag_) {
-      send_ack(next_seq_expected); // 发送ack序号
-      continue; // 直接跳出
+  if (bundle_) {
+    if (!response.bundle_) {
+      LOG(ERROR) << "Server does not support bundle transfers";
+      finish(DownloadStatus::FAILED);
+      return;
     }
+    bundle_writer_ = std::make_unique<BundleWriter>(output_dir_);
+    status_ = DownloadStatus::TRANSFER;
+    return;
+  }
+  std::string file_path = output_dir_ + file_name_;
+  if (zero_copy_receive_ && content_length_ > 0 && map_output_file(file_path)) {
+    status_ = DownloadStatus::TRANSFER;
+    return;
+  }
+  if (resume_offset_ > 0) {
+    // 续传时保留已有内容，从续传起点开始写
+    file_.open(file_path.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+    file_.seekp(resume_offset_);
+  } else {
+    file_.open(file_path.c_str(), std::ios::out);
+  }
+  if (!file_.is_open()) {
+    LOG(ERROR) << "Failed to open " << file_path;
+    finish(DownloadStatus::FAILED);
+    return;
+  }
+  status_ = DownloadStatus::TRANSFER;
+}
 
-    // 这时一定有data_segment->seq_number_ >= next_seq_expected
-    segments_in_between =
-        (data_segment->seq_number_ - next_seq_expected) / MAX_DATA_SIZE; // 中间未收到数据包的个数
+void UdpClient::on_data_datagram(unsigned char *buffer, int n) {
+  int next_seq_expected;
+  int segments_in_between = 0;
 
-    int this_segment_index = last_in_order_packet_ + segments_in_between + 1; // 由于网络原因，可能不会按序到达
+  // 握手应答的重复报文（客户端重发请求导致）直接忽略
+  if (n < HEADER_LENGTH ||
+      PeekMagic(reinterpret_cast<char *>(buffer), n) == HANDSHAKE_RESPONSE_MAGIC) {
+    return;
+  }
 
-    if (this_segment_index - last_in_order_packet_ > receiver_window_) { // 待排序的包大于滑动窗口，丢包
-      LOG(INFO) << "Packet dropped " << this_segment_index;
-      // Drop the packet, if it exceeds receiver window
-      continue;
+  if (cipher_) {
+    // 先校验再解析：长度不符或校验失败的数据段（伪造、损坏）直接丢弃
+    DataSegment header;
+    header.DeserializeHeader(buffer);
+    int data_length = n - HEADER_LENGTH - GCM_TAG_LENGTH;
+    if (data_length < 0 || header.length_ != data_length ||
+        !cipher_->Open(reinterpret_cast<char *>(buffer), data_length)) {
+      SAFE_UDP_TRACE(PACKET_DROPPED, header.seq_number_, 2);
+      return;
     }
+  }
 
-    if (data_segment->fin_flag_) {
-      LOG(INFO) << "Fin flag received !!!";
-      fin_flag_received_ = true;
-    }
+  std::unique_ptr<DataSegment> data_segment = std::make_unique<DataSegment>(); // 创建文件包
+  data_segment->DeserializeToDataSegment(buffer, n);   // 将数据从缓冲区反序列化到 DataSegment 对象中
 
-    // 顺序插入到数组 
-    insert(this_segment_index, *data_segment);
+  SAFE_UDP_TRACE(PACKET_RECEIVED, data_segment->seq_number_,
+                 data_segment->length_);
+  packet_statistics_->packets_received_++;
 
-    // 顺序写入文本
-    for (int i = last_in_order_packet_ + 1; i <= last_packet_received_; i++) {
-      if (data_segments_[i].seq_number_ != -1) {
-        if (file.is_open()) {
-          file << data_segments_[i].data_;
-          last_in_order_packet_ = i;
+  // Random drop
+  if (is_packet_drop_ && rand() % 100 < prob_value_) {
+    SAFE_UDP_TRACE(PACKET_DROPPED, data_segment->seq_number_, 0);
+    return; // 丢包
+  }
+
+  // Random delay
+  if (is_delay_ && rand() % 100 < prob_value_) {
+    int sleep_time = (rand() % 10) * 1000;
+    usleep(sleep_time);
+  }
+
+  if (last_in_order_packet_ == -1) { // 还没有接收到任何按顺序的数据包
+    next_seq_expected = initial_seq_number_;
+  } else {
+    next_seq_expected = data_segments_[last_in_order_packet_].seq_number_ +
+                        data_segments_[last_in_order_packet_].length_; //计算下一个期望的序列号
+  }
+
+  // Old packet
+  // 假若 10000 > 5000
+  if (next_seq_expected > data_segment->seq_number_ && !data_segment->fin_flag_) {
+    send_ack(next_seq_expected); // 发送ack序号
+    return; // 直接跳出
+  }
+
+  // 这时一定有data_segment->seq_number_ >= next_seq_expected
+  segments_in_between =
+      (data_segment->seq_number_ - next_seq_expected) / data_size_; // 中间未收到数据包的个数
+
+  int this_segment_index = last_in_order_packet_ + segments_in_between + 1; // 由于网络原因，可能不会按序到达
+
+  if (this_segment_index - last_in_order_packet_ > receiver_window_) { // 待排序的包大于滑动窗口，丢包
+    SAFE_UDP_TRACE(PACKET_DROPPED, data_segment->seq_number_, 1);
+    // Drop the packet, if it exceeds receiver window
+    return;
+  }
+
+  if (data_segment->fin_flag_) {
+    LOG(INFO) << "Fin flag received !!!";
+    fin_flag_received_ = true;
+  }
+
+  // 顺序插入到数组 
+  insert(this_segment_index, *data_segment);
+  grow_advertised_window();
+
+  // 顺序写入文本
+  for (int i = last_in_order_packet_ + 1; i <= last_packet_received_; i++) {
+    if (data_segments_[i].seq_number_ != -1) {
+      if (file_.is_open() || bundle_writer_) {
+        bool written = write_in_order(data_segments_[i].data_, data_segments_[i].length_);
+        free(data_segments_[i].data_);
+        data_segments_[i].data_ = nullptr;
+        if (!written) {
+          finish(DownloadStatus::FAILED);
+          return;
         }
-      } else {
-        break; // 空包则跳出
+        packet_statistics_->delivered_bytes_.Add(data_segments_[i].length_);
+        bytes_received_ += data_segments_[i].length_;
+        last_in_order_packet_ = i;
       }
+    } else {
+      break; // 空包则跳出
     }
+  }
+  // 乱序深度：已收到但因前面缺包而无法写入的分段跨度
+  packet_statistics_->out_of_order_depth_.Record(last_packet_received_ -
+                                                 last_in_order_packet_);
+
+  // 第一个分段尚未到达时按初始序号确认，告诉服务端从头缺包
+  if (last_in_order_packet_ == -1) {
+    send_ack(initial_seq_number_);
+  } else {
+    send_ack(data_segments_[last_in_order_packet_].seq_number_ + data_segments_[last_in_order_packet_].length_);
+  }
+  // 如果已经接收到 fin_flag_ 且所有数据包都处理完毕，则下载结束
+  if (fin_flag_received_ && last_in_order_packet_ == last_packet_received_) {
+    finish(DownloadStatus::COMPLETED); // 最后一个 ACK 已发出，服务端据此结束发送
+  }
+}
+
+bool UdpClient::write_in_order(const char *data, int length) {
+  if (digest_enabled_) {
+    // 数据流末尾的摘要不写入文件
+    int content = static_cast<int>(
+        std::max<int64_t>(std::min<int64_t>(length, content_length_ - bytes_received_), 0));
+    digest_.Update(data, content);
+    store_digest_bytes(bytes_received_ + content, data + content, length - content);
+    length = content;
+  }
+  if (bundle_writer_) {
+    return bundle_writer_->Append(data, length);
+  }
+  file_.write(data, length);
+  return true;
+}
 
+void UdpClient::store_digest_bytes(int64_t offset, const char *data, int length) {
+  int64_t from = offset - content_length_;
+  if (length <= 0 || from < 0 || from >= DIGEST_LENGTH) {
+    return;
+  }
+  memcpy(received_digest_ + from, data, std::min<int64_t>(length, DIGEST_LENGTH - from));
+}
 
-    // 如果已经接收到 fin_flag_ 且所有数据包都处理完毕，则跳出循环
-    if (fin_flag_received_ && last_in_order_packet_ == last_packet_received_) {
-      break;
+void UdpClient::digest_mapped(int64_t in_order_bytes) {
+  int64_t until = std::min(in_order_bytes, content_length_);
+  if (digest_enabled_ && until > digested_until_) {
+    digest_.Update(mapping_ + digested_until_, until - digested_until_);
+    digested_until_ = until;
+  }
+}
+
+bool UdpClient::map_output_file(const std::string &file_path) {
+  // 续传时保留已有内容，映射整个文件，数据写在 resume_offset_ 之后
+  int flags = O_RDWR | O_CREAT | (resume_offset_ > 0 ? 0 : O_TRUNC);
+  int fd = open(file_path.c_str(), flags, 0644);
+  if (fd < 0) {
+    LOG(WARNING) << "Failed to open " << file_path << " for mapping";
+    return false;
+  }
+  int64_t total_length = resume_offset_ + content_length_;
+  // 一次分配全部磁盘块：写映射区时不会再触发块分配，磁盘空间不足也在这里失败而不是 SIGBUS
+  if (fallocate(fd, 0, 0, total_length) != 0 &&
+      (errno != EOPNOTSUPP || ftruncate(fd, total_length) != 0)) {
+    LOG(WARNING) << "Failed to preallocate " << total_length << " bytes for "
+                 << file_path << ": " << strerror(errno);
+    close(fd);
+    return false;
+  }
+  void *mapping = mmap(nullptr, total_length, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fd, 0);
+  if (mapping == MAP_FAILED) {
+    LOG(WARNING) << "Failed to mmap " << file_path << ": " << strerror(errno);
+    close(fd);
+    return false;
+  }
+  madvise(mapping, total_length, MADV_SEQUENTIAL);
+
+  output_fd_ = fd;
+  mapping_ = static_cast<char *>(mapping) + resume_offset_;
+  segment_received_.assign(file_length_ / data_size_ + 1, 0);
+  next_segment_ = 0;
+  highest_segment_ = -1;
+  overflow_buffer_.assign(MAX_NEGOTIABLE_PACKET_SIZE, 0);
+  LOG(INFO) << "Receiving directly into mapped " << file_path;
+  return true;
+}
+
+int UdpClient::receive_into_mapping() {
+  // 预测下一个分段紧跟在已收到的最大分段之后，按序到达时数据一次就落在最终位置。
+  // 预测位置上一定还没有已确认的数据，猜错时被临时写入也无妨
+  int64_t predicted_offset = (highest_segment_ + 1) * data_size_;
+  int64_t predicted_length = 0;
+  struct iovec iov[3];
+  int iov_count = 0;
+  iov[iov_count].iov_base = header_buffer_;
+  iov[iov_count++].iov_len = HEADER_LENGTH;
+  if (predicted_offset < content_length_) {
+    predicted_length = std::min<int64_t>(data_size_, content_length_ - predicted_offset);
+    iov[iov_count].iov_base = mapping_ + predicted_offset;
+    iov[iov_count++].iov_len = predicted_length;
+  }
+  iov[iov_count].iov_base = overflow_buffer_.data();
+  iov[iov_count++].iov_len = overflow_buffer_.size();
+
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = iov;
+  message.msg_iovlen = iov_count;
+  message.msg_control = control_buffer_;
+  message.msg_controllen = sizeof(control_buffer_);
+  int n = transport_->ReceiveMessage(&message, MSG_DONTWAIT);                          // recvmsg
+  if (n < 0) {
+    return -1;
+  }
+  on_receive_control(&message);
+  // 握手应答的重复报文（客户端重发请求导致）直接忽略
+  if (n < HEADER_LENGTH ||
+      PeekMagic(reinterpret_cast<char *>(header_buffer_), n) ==
+          HANDSHAKE_RESPONSE_MAGIC) {
+    return n;
+  }
+
+  DataSegment header;
+  header.DeserializeHeader(header_buffer_);
+  int tag_length = cipher_ ? GCM_TAG_LENGTH : 0;
+  int payload_length = std::min<int>(header.length_, n - HEADER_LENGTH - tag_length);
+  if (cipher_ && payload_length != header.length_) {
+    SAFE_UDP_TRACE(PACKET_DROPPED, header.seq_number_, 2);
+    return n;
+  }
+  header.length_ = payload_length;
+  on_mapped_segment(header, predicted_offset,
+                    std::min<int64_t>(n - HEADER_LENGTH, predicted_length));
+  return n;
+}
+
+void UdpClient::on_mapped_segment(const DataSegment &header,
+                                  int64_t landed_offset, int landed_length) {
+  SAFE_UDP_TRACE(PACKET_RECEIVED, header.seq_number_, header.length_);
+  packet_statistics_->packets_received_++;
+
+  // Random drop
+  if (is_packet_drop_ && rand() % 100 < prob_value_) {
+    SAFE_UDP_TRACE(PACKET_DROPPED, header.seq_number_, 0);
+    return; // 丢包，已写入映射区的数据没有标记，之后会被重传覆盖
+  }
+
+  // Random delay
+  if (is_delay_ && rand() % 100 < prob_value_) {
+    int sleep_time = (rand() % 10) * 1000;
+    usleep(sleep_time);
+  }
+
+  int64_t offset = static_cast<int64_t>(header.seq_number_) - initial_seq_number_;
+  if (offset < 0 || offset % data_size_ != 0 || header.length_ > data_size_ ||
+      offset + header.length_ > file_length_) {
+    return; // 不属于本文件的报文
+  }
+  int64_t index = offset / data_size_;
+  int64_t in_order_bytes = std::min(next_segment_ * data_size_, file_length_);
+  if (segment_received_[index]) {
+    send_ack(initial_seq_number_ + in_order_bytes); // 重复分段，重新确认
+    return;
+  }
+  if (index - next_segment_ >= receiver_window_) {
+    SAFE_UDP_TRACE(PACKET_DROPPED, header.seq_number_, 1);
+    // Drop the packet, if it exceeds receiver window
+    return;
+  }
+
+  // 预测落点不对时把数据搬到正确位置：前 landed_length 字节在预测位置，其余在溢出缓冲区。
+  // 两者都是按分段对齐的不同分段，不会重叠。超出文件内容的部分是末尾的摘要
+  int content = static_cast<int>(
+      std::max<int64_t>(std::min<int64_t>(header.length_, content_length_ - offset), 0));
+  auto copy_payload = [&](int from, int length, char *target) {
+    if (from < landed_length) {
+      int n = std::min(length, landed_length - from);
+      memcpy(target, mapping_ + landed_offset + from, n);
+      from += n;
+      length -= n;
+      target += n;
     }
-    send_ack(data_segments_[last_in_order_packet_].seq_number_ + data_segments_[last_in_order_packet_].length_);
+    if (length > 0) {
+      memcpy(target, overflow_buffer_.data() + from - landed_length, length);
+    }
+  };
+  if (landed_offset != offset) {
+    copy_payload(0, content, mapping_ + offset);
+  } else if (landed_length < content) {
+    copy_payload(landed_length, content - landed_length, mapping_ + offset + landed_length);
+  }
+  char trailer[DIGEST_LENGTH];
+  int trailer_length = std::min(header.length_ - content, DIGEST_LENGTH);
+  copy_payload(content, trailer_length, trailer);
+  if (cipher_) {
+    // 数据已在最终位置，原地解密；校验失败时该分段不标记为已收到，之后会被重传覆盖
+    char tag[GCM_TAG_LENGTH];
+    copy_payload(header.length_, GCM_TAG_LENGTH, tag);
+    struct iovec pieces[2];
+    pieces[0].iov_base = mapping_ + offset;
+    pieces[0].iov_len = content;
+    pieces[1].iov_base = trailer;
+    pieces[1].iov_len = trailer_length;
+    if (content + trailer_length != header.length_ ||
+        !cipher_->Open(reinterpret_cast<char *>(header_buffer_), pieces, 2, tag)) {
+      SAFE_UDP_TRACE(PACKET_DROPPED, header.seq_number_, 2);
+      return;
+    }
+  }
+  store_digest_bytes(offset + content, trailer, trailer_length);
+
+  if (header.fin_flag_) {
+    LOG(INFO) << "Fin flag received !!!";
+    fin_flag_received_ = true;
+  }
+  segment_received_[index] = 1;
+  highest_segment_ = std::max(highest_segment_, index);
+  grow_advertised_window();
+  while (next_segment_ < static_cast<int64_t>(segment_received_.size()) &&
+         segment_received_[next_segment_]) {
+    next_segment_++;
+  }
+  in_order_bytes = std::min(next_segment_ * data_size_, file_length_);
+  packet_statistics_->delivered_bytes_.Add(in_order_bytes - bytes_received_);
+  bytes_received_ = in_order_bytes;
+  digest_mapped(in_order_bytes);
+  // 乱序深度：已收到但前面仍有缺口的分段跨度
+  packet_statistics_->out_of_order_depth_.Record(highest_segment_ -
+                                                 next_segment_ + 1);
+
+  send_ack(initial_seq_number_ + in_order_bytes);
+  // 文件大小已知，数据全部按序到齐即结束：空的 FIN 分段与最后一个数据分段同时被该 ACK 确认
+  if (in_order_bytes == file_length_) {
+    finish(DownloadStatus::COMPLETED);
+  }
+}
+
+void UdpClient::unmap_output_file(bool completed) {
+  if (mapping_ == nullptr) {
+    return;
+  }
+  // MAP_SHARED 的修改由页缓存回写，与 fstream 路径一样不在这里强制落盘
+  munmap(mapping_ - resume_offset_, resume_offset_ + content_length_);
+  int64_t kept = std::min(bytes_received_, content_length_);
+  if (!completed && ftruncate(output_fd_, resume_offset_ + kept) != 0) {
+    LOG(WARNING) << "Failed to truncate partial download";
+  }
+  close(output_fd_);
+  mapping_ = nullptr;
+  output_fd_ = -1;
+  segment_received_.clear();
+}
 
-    memset(buffer, 0, MAX_PACKET_SIZE);
+void UdpClient::on_receive_control(struct msghdr *message) {
+  uint32_t drop_count;
+  if (!socket_buffers_ || !SocketBufferManager::ReadDropCount(message, &drop_count)) {
+    return;
+  }
+  int64_t dropped = socket_buffers_->OnDropCount(drop_count);
+  if (dropped <= 0) {
+    return;
   }
+  packet_statistics_->kernel_drops_.Add(dropped);
+  // 一次突发的丢包会陆续出现在之后多个数据报的控制信息中，每个窗口只收缩一次
+  if (window_credit_ < 0) {
+    return;
+  }
+  advertised_window_ = std::max(std::min(MIN_ADVERTISED_WINDOW, receiver_window_),
+                                advertised_window_ / 2);
+  window_credit_ = -advertised_window_;
+  LOG(INFO) << "Kernel dropped " << dropped << " datagrams, advertised window "
+            << advertised_window_;
+}
 
-  free(buffer);
-  file.close();
+void UdpClient::grow_advertised_window() {
+  if (++window_credit_ >= advertised_window_) {
+    window_credit_ = 0;
+    advertised_window_ = std::min(advertised_window_ + 1, advertised_window_limit());
+  }
+}
+
+int UdpClient::advertised_window_limit() const {
+  int capacity = socket_buffers_ ? socket_buffers_->ReceiveCapacity(packet_size_)
+                                 : receiver_window_;
+  return std::max(std::min(MIN_ADVERTISED_WINDOW, receiver_window_),
+                  std::min(receiver_window_, capacity));
+}
+
+void UdpClient::finish(DownloadStatus status) {
+  if (status == DownloadStatus::COMPLETED && digest_enabled_) {
+    char expected[DIGEST_LENGTH];
+    digest_.Serialize(expected);
+    digest_verified_ = memcmp(expected, received_digest_, DIGEST_LENGTH) == 0;
+    if (digest_verified_) {
+      LOG(INFO) << "Digest verified: " << std::hex << digest_.Value() << std::dec;
+    } else {
+      LOG(ERROR) << "Digest mismatch: computed " << std::hex << digest_.Value() << std::dec;
+      status = DownloadStatus::DIGEST_MISMATCH;
+      // 丢弃本次写入的内容，之后的续传从原来的起点重新下载
+      bytes_received_ = 0;
+    }
+  }
+  if (bundle_writer_) {
+    // 数据全部到齐后写出最后一批文件，流不完整也算失败
+    if (status == DownloadStatus::COMPLETED && !bundle_writer_->Finish()) {
+      status = DownloadStatus::FAILED;
+    }
+    bundle_files_ = bundle_writer_->files_written();
+    bundle_writer_.reset();
+  }
+  if (cipher_ && cipher_->rejected_segments_.Value() > 0) {
+    LOG(WARNING) << "Rejected " << cipher_->rejected_segments_.Value()
+                 << " segments that failed authentication";
+  }
+  status_ = status;
+  unmap_output_file(status == DownloadStatus::COMPLETED);
+  if (file_.is_open()) {
+    file_.close();
+  }
+  if (status == DownloadStatus::DIGEST_MISMATCH && !bundle_ &&
+      truncate((output_dir_ + file_name_).c_str(), resume_offset_) != 0) {
+    LOG(WARNING) << "Failed to discard corrupted download";
+  }
+  if (on_complete_) {
+    on_complete_(status);
+  }
 }
 
 int UdpClient::add_to_data_segment_vector(const DataSegment &data_segment) {
@@ -138,25 +843,25 @@ int UdpClient::add_to_data_segment_vector(const DataSegment &data_segment) {
 }
 
 void UdpClient::send_ack(int ackNumber) {
-  LOG(INFO) << "Sending an ack :" << ackNumber;
+  SAFE_UDP_TRACE(ACK_SENT, ackNumber, 0);
   int n = 0;
-  DataSegment *ack_segment = new DataSegment();
-  ack_segment->ack_flag_ = true;
-  ack_segment->ack_number_ = ackNumber;
-  ack_segment->fin_flag_ = false;
-  ack_segment->length_ = 0;
-  ack_segment->seq_number_ = 0;
-
-  char *data = ack_segment->SerializeToCharArray();
-  n = sendto(sockfd_, data, MAX_PACKET_SIZE, 0,
-             (struct sockaddr *)&(server_address_), sizeof(struct sockaddr_in));
+  DataSegment ack_segment;
+  ack_segment.ack_flag_ = true;
+  ack_segment.ack_number_ = ackNumber;
+  ack_segment.fin_flag_ = false;
+  ack_segment.seq_number_ = 0;
+  // 数据部分为通告窗口
+  int32_t window = advertised_window_;
+  ack_segment.length_ = ACK_WINDOW_LENGTH;
+  ack_segment.data_ = reinterpret_cast<char *>(&window);
+
+  char *data = ack_segment.SerializeToCharArray(); // 缓冲区由 ack_segment 析构时释放
+  n = transport_->SendTo(data, ack_segment.PacketSize(), server_address_);
   // 将序列化的字符数组发送到服务器
 
   if (n < 0) {
     LOG(INFO) << "Sending ack failed !!!";
   }
-
-  free(data);
 }
 
 void UdpClient::CreateSocketAndServerConnection(
@@ -182,9 +887,17 @@ void UdpClient::CreateSocketAndServerConnection(
   server_address_.sin_port = htons(port_num);
 
   sockfd_ = sfd;
+  transport_ = std::make_unique<SocketTransport>(sfd);
   this->server_address_ = server_address_;
 }
 
+void UdpClient::UseTransport(std::unique_ptr<Transport> transport, Clock *clock,
+                             const struct sockaddr_in &server_address) {
+  transport_ = std::move(transport);
+  server_address_ = server_address;
+  packet_statistics_->SetClock(clock);
+}
+
 void UdpClient::insert(int index, const DataSegment &data_segment) {
   if (index > last_packet_received_) { // 如果插入的索引大于当前最后接收的数据包索引，表示要插入的索引之前可能存在缺失的数据包
     for (int i = last_packet_received_ + 1; i <= index; i++) {
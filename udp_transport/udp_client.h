@@ -5,23 +5,104 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <cstdint>
+#include <fstream>
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
+#include "bundle.h"
+#include "clock.h"
 #include "data_segment.h"
+#include "file_digest.h"
+#include "handshake.h"
+#include "low_latency.h"
+#include "packet_statistics.h"
+#include "path_mtu.h"
+#include "segment_cipher.h"
+#include "socket_buffer.h"
+#include "transport.h"
 
 namespace safe_udp {
 constexpr char CLIENT_FILE_PATH[] = "/work/files/client_files/";
+// 握手请求的重传间隔与最大次数
+constexpr int64_t HANDSHAKE_RETRY_US = 200000;
+constexpr int HANDSHAKE_MAX_ATTEMPTS = 5;
+// 默认 10 秒收不到服务端任何报文即认为服务端已经消失
+constexpr int64_t DEFAULT_IDLE_TIMEOUT_US = 10000000;
+// 内核丢包后通告窗口减半，但不低于该值
+constexpr int MIN_ADVERTISED_WINDOW = 4;
 
+enum class DownloadStatus {
+  IDLE,
+  HANDSHAKE,       // 请求已发出，等待服务端应答
+  TRANSFER,        // 正在接收数据
+  COMPLETED,
+  FILE_NOT_FOUND,
+  TIMED_OUT,       // 超过截止时间或服务端长时间无响应
+  DIGEST_MISMATCH, // 数据全部到达但与服务端的摘要不符，本次写入的部分已丢弃
+  FAILED,
+};
+
+const char *DownloadStatusName(DownloadStatus status);
+
+struct DownloadProgress {
+  int64_t bytes_received;  // 已按序写入的字节数（续传时包含已有部分）
+  int64_t file_length;     // 握手得到的文件大小，旧服务端为 -1
+};
+
+// 客户端既可以阻塞使用（SendFileRequest），也可以作为非阻塞状态机嵌入外部事件循环：
+// StartDownload() 之后把 fd() 加入 epoll，可读或到达 NextTimeoutUs() 时调用 Step()，
+// 结束时通过 completion 回调通知
 class UdpClient {
  public:
+  using CompletionCallback = std::function<void(DownloadStatus)>;
+  using ProgressCallback = std::function<void(const DownloadProgress&)>;
+
   UdpClient();
-  ~UdpClient() { close(sockfd_); }
+  ~UdpClient() {
+    unmap_output_file(false);
+    if (sockfd_ >= 0) {
+      close(sockfd_);
+    }
+  }
 
+  // 阻塞下载，内部就是 StartDownload + poll/Step 循环
   void SendFileRequest(const std::string& file_name);
+  PacketStatistics* packet_statistics() { return packet_statistics_.get(); }
 
   void CreateSocketAndServerConnection(const std::string& server_address,
                                        const std::string& port);
+  // 替换收发数据报的方式（如模拟器中的链路），代替 CreateSocketAndServerConnection。
+  // 此时 fd() 为 -1，由调用者在数据到达时调用 Step()
+  void UseTransport(std::unique_ptr<Transport> transport, Clock* clock,
+                    const struct sockaddr_in& server_address);
+
+  // 非阻塞接口。now_us 为 NowMicros() 时间。上一次下载结束后可以再次调用，
+  // 下载进行中调用时返回 false
+  bool StartDownload(const std::string& file_name, int64_t now_us);
+  // 处理所有已到达的数据报以及到期的定时器，下载结束后返回 false
+  bool Step(int64_t now_us);
+  // 下一次需要调用 Step() 的绝对时间（微秒）
+  int64_t NextTimeoutUs() const;
+  int fd() const { return sockfd_; }
+  DownloadStatus status() const { return status_; }
+  bool IsFinished() const;
+  // 服务端接受的续传起点
+  int64_t resume_offset() const { return resume_offset_; }
+  // 握手请求到应答的时间，请求重发过（无法区分是哪次的应答）时为 0
+  int64_t handshake_rtt_us() const { return handshake_rtt_us_; }
+  // 打包传输解包得到的文件数
+  int bundle_files() const { return bundle_files_; }
+  // 下载完成且内容与服务端发来的摘要一致；服务端不支持摘要时为 false
+  bool digest_verified() const { return digest_verified_; }
+
+  CompletionCallback on_complete_;
+  ProgressCallback on_progress_;
+  // 整个下载的时限（微秒），0 表示不限
+  int64_t deadline_us_;
+  // 服务端无任何报文的最长时间（微秒），超过即判定服务端已经消失
+  int64_t idle_timeout_us_;
 
   int initial_seq_number_;
   bool is_packet_drop_;
@@ -33,18 +114,123 @@ class UdpClient {
   // 最新接收到的索引下标
   int last_packet_received_;
   int receiver_window_;
+  // 随 ACK 通告给服务端的窗口（分段数）：不超过 receiver_window_ 与接收缓冲区的容量，
+  // 内核因缓冲区满丢包时减半，之后每无丢包地收到一个窗口的分段加一
+  int advertised_window_;
   bool fin_flag_received_;
+  // 接收文件的保存目录（以 / 结尾），默认为 CLIENT_FILE_PATH
+  std::string output_dir_;
+  // 大于 MAX_PACKET_SIZE 时在请求前进行路径 MTU 探测（作为 Step() 的一个阶段，
+  // 不阻塞），并以探测结果协商分段大小
+  int max_packet_size_;
+  // 握手后采用的分段大小及数据部分大小
+  int packet_size_;
+  int data_size_;
+  // 零拷贝接收：握手得到文件大小后用 fallocate 预分配输出文件并 mmap，
+  // recvmsg 把数据部分直接分散写入其在文件中的位置，乱序分段不再缓存。
+  // 文件大小未知（旧服务端）、为空或映射失败时退回 fstream 路径
+  bool zero_copy_receive_;
+  // 低时延模式：阻塞下载时先自旋接收再等待，并按配置开启 SO_BUSY_POLL 与 CPU 绑定
+  LowLatencyConfig low_latency_;
+  // 输出文件已存在时从其当前大小续传，服务端不支持或文件已变短时完整下载
+  bool resume_;
+  // 随请求发给服务端的路径 RTT（例如上一次下载的 handshake_rtt_us()），
+  // 服务端据此设置初始 RTO；0 表示未知
+  int64_t rtt_hint_us_;
+  // 打包传输：file_name 为通配符（如 "*.txt"）或文件清单（每行一个相对路径），
+  // 服务端把匹配的文件拼成一个归档流发送，按序到达的数据直接解包到 output_dir_
+  bool bundle_;
+  // 请求服务端在数据流末尾附加内容摘要，结束时与按序写出时计算的摘要比较，
+  // 不需要再读一遍文件。续传时只校验本次传输的部分
+  bool verify_digest_;
+  // 预共享密钥（见 segment_cipher.h）。非空时请求加密传输，服务端不支持时下载失败；
+  // 校验失败的数据段按丢包处理
+  std::string pre_shared_key_;
 
  private:
+  friend class UdpClientBenchmarkAccess;
+
   void send_ack(int ackNumber);
   void insert(int index, const DataSegment& data_segment);
   int add_to_data_segment_vector(const DataSegment& data_segment);
+  void send_request();
+  // 路径 MTU 探测（如有）结束后发出第一个请求
+  void begin_handshake(int64_t now_us);
+  void on_handshake_datagram(const char* buffer, int n, int64_t now_us);
+  void on_data_datagram(unsigned char* buffer, int n);
+  bool map_output_file(const std::string& file_path);
+  // 收取一个数据报到映射区，返回数据报长度，无数据时返回 -1
+  int receive_into_mapping();
+  // header.length_ 为数据报中实际的数据长度；其前 landed_length 字节已落在
+  // 映射区 landed_offset 处，其余在 overflow_buffer_ 中
+  void on_mapped_segment(const DataSegment& header, int64_t landed_offset,
+                         int landed_length);
+  // completed 为 false 时把文件截断到已按序收到的长度，避免留下看似完整的文件
+  void unmap_output_file(bool completed);
+  // 按序写出一个分段的数据，写入失败时返回 false
+  bool write_in_order(const char* data, int length);
+  // 保存数据流中 offset 处属于末尾摘要的 length 字节
+  void store_digest_bytes(int64_t offset, const char* data, int length);
+  // 把映射区中新按序到达的内容计入摘要
+  void digest_mapped(int64_t in_order_bytes);
+  void finish(DownloadStatus status);
+  // 读取 recvmsg 控制信息中的内核丢包计数，有新增丢包时收缩通告窗口
+  void on_receive_control(struct msghdr* message);
+  void grow_advertised_window();
+  int advertised_window_limit() const;
 
   int sockfd_;
+  std::unique_ptr<Transport> transport_;
   int seq_number_;
   int ack_number_;
   int16_t length_;
   struct sockaddr_in server_address_;
   std::vector<DataSegment> data_segments_;
+  std::unique_ptr<PacketStatistics> packet_statistics_;
+  std::unique_ptr<SocketBufferManager> socket_buffers_;
+  alignas(struct cmsghdr) char control_buffer_[DROP_COUNT_CONTROL_SIZE];
+  int window_credit_;  // 上次调整通告窗口之后无丢包收到的分段数
+
+  DownloadStatus status_;
+  std::string file_name_;
+  HandshakeRequest request_;
+  // 非空时正在握手前探测路径 MTU，请求尚未发出
+  std::unique_ptr<PathMtuDiscovery> mtu_discovery_;
+  std::fstream file_;
+  std::unique_ptr<BundleWriter> bundle_writer_;
+  int bundle_files_;
+  std::vector<unsigned char> recv_buffer_;
+  // 本次传输的长度与已按序收到的字节数，都从 resume_offset_ 算起。
+  // 服务端附加摘要时 file_length_ 包含末尾的 DIGEST_LENGTH 字节
+  int64_t file_length_;
+  // 其中属于文件（或归档流）的字节数
+  int64_t content_length_;
+  int64_t bytes_received_;
+  int64_t resume_offset_;
+  int64_t handshake_rtt_us_;
+  bool digest_enabled_;
+  FileDigest digest_;
+  int64_t digested_until_;
+  char received_digest_[DIGEST_LENGTH];
+  bool digest_verified_;
+  std::unique_ptr<SegmentCipher> cipher_;
+  std::string key_nonce_;
+
+  // 零拷贝接收状态
+  int output_fd_;
+  char* mapping_;  // 整个文件映射中 resume_offset_ 处的位置
+  // 每个分段是否已经落盘（映射区），分段数为 file_length_ / data_size_ + 1，
+  // 文件大小恰为 data_size_ 整数倍时最后一个是空的 FIN 分段
+  std::vector<uint8_t> segment_received_;
+  int64_t next_segment_;     // 第一个尚未收到的分段
+  int64_t highest_segment_;  // 已收到的最大分段，-1 表示尚无
+  unsigned char header_buffer_[HEADER_LENGTH];
+  // 预测落点之外的数据（乱序分段尾部、非数据报文）先收在这里
+  std::vector<char> overflow_buffer_;
+  int64_t start_time_us_;
+  int64_t last_activity_us_;
+  int64_t request_sent_us_;  // 第一个请求的发出时间
+  int64_t next_request_retry_us_;
+  int request_attempts_;
 };
-}  // namespace safe_udp
\ No newline at end of file
+}  // namespace safe_udp
@@ -1,18 +1,34 @@
 #include "udp_server.h"
 
 #include <arpa/inet.h>
+#include <poll.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <time.h>
 #include <algorithm>
 #include <cmath>
+#include <random>
 #include <sstream>
 #include <vector>
 #include <glog/logging.h>
 
+#include "path_mtu.h"
+#include "trace.h"
+
 namespace safe_udp {
+namespace {
+struct timeval to_timeval(int64_t time_us) {
+  struct timeval time;
+  time.tv_sec = time_us / 1000000;
+  time.tv_usec = time_us % 1000000;
+  return time;
+}
+}  // namespace
+
 UdpServer::UdpServer() {
   sliding_window_ = std::make_unique<SlidingWindow>();
   packet_statistics_ = std::make_unique<PacketStatistics>();
@@ -20,12 +36,16 @@ UdpServer::UdpServer() {
   // sliding_window_ 和 packet_statistics_ 都是 std::unique_ptr 类型的成员变量。
   // std::make_unique<SlidingWindow>() 和 std::make_unique<PacketStatistics>() 分别创建一个指向 SlidingWindow 和 PacketStatistics 对象的独占智能指针。
 
-  sockfd_ = 0;
+  sockfd_ = -1;
+  clock_ = SystemClock::Instance();
+  transfer_start_us_ = 0;
   smoothed_rtt_ = 20000;
-  smoothed_timeout_ = 30000;
+  smoothed_timeout_ = INITIAL_RETRANSMIT_TIMEOUT_US;
   dev_rtt_ = 0;
+  has_rtt_sample_ = false;
+  rto_backoff_ = 0;
 
-  initial_seq_number_ = 67; // 随机值
+  initial_seq_number_ = DEFAULT_INITIAL_SEQ_NUMBER;
   start_byte_ = 0;
 
   ssthresh_ = 128;
@@ -34,6 +54,42 @@ UdpServer::UdpServer() {
   is_slow_start_ = true;
   is_cong_avd_ = false;
   is_fast_recovery_ = false;
+
+  max_packet_size_ = MAX_PACKET_SIZE;
+  initial_window_ = INITIAL_WINDOW;
+  path_metrics_ = &PathMetricsCache::Instance();
+  scheduler_ = nullptr;
+  resume_offset_ = 0;
+  congestion_control_ = CONGESTION_CONTROL_NEWRENO;
+  packet_size_ = MAX_PACKET_SIZE;
+  data_size_ = MAX_DATA_SIZE;
+  is_handshake_ = false;
+  bundle_request_ = false;
+  send_digest_ = false;
+  transmit_count_ = 0;
+  digested_until_ = 0;
+  content_length_ = 0;
+  file_length_ = 0;
+  use_io_uring_ = false;
+
+  cwnd_acked_ = 0;
+  recover_ = -1;
+  consecutive_timeouts_ = 0;
+  rto_timer_us_ = 0;
+  probe_timer_us_ = 0;
+  probe_sent_ = false;
+  frto_step_ = 0;
+  undo_cwnd_ = 0;
+  undo_ssthresh_ = 0;
+  undo_recover_ = -1;
+  undo_fast_recovery_ = false;
+  timeout_copies_ = 0;
+  ignore_dup_acks_ = 0;
+  prefetched_until_ = 0;
+  peer_window_ = 0;
+  event_fd_ = -1;
+  receiving_.store(false);
+  sender_waiting_.store(false);
 }
 
 int UdpServer::StartServer(int port) {
@@ -61,16 +117,26 @@ int UdpServer::StartServer(int port) {
   LOG(INFO) << "**Server Bind set to family: " << server_addr.sin_family;
   LOG(INFO) << "Started successfully";
   sockfd_ = sfd;
+  transport_ = std::make_unique<SocketTransport>(sfd);
   return sfd;
 }
 
+void UdpServer::UseTransport(std::unique_ptr<Transport> transport, Clock *clock) {
+  transport_ = std::move(transport);
+  clock_ = clock;
+  packet_statistics_->SetClock(clock);
+}
+
 bool UdpServer::OpenFile(const std::string &file_name) {
   LOG(INFO) << "Opening the file " << file_name;
+  if (!pre_shared_key_.empty() && !cipher_) {
+    LOG(WARNING) << "Refusing unencrypted request";
+    return false;
+  }
 
-  file_.open(file_name.c_str(), std::ios::in); // 以读取方式打开文件。这是 std::ios 命名空间中定义的一个标志，表示打开文件以供读取
-  // file_name.c_str() 返回一个 const char* 指针，指向存储文件名的 C 风格字符串
+  file_ = FileCache::Instance().Open(file_name);
 
-  if (!this->file_.is_open()) {
+  if (!file_) {
     LOG(INFO) << "File: " << file_name << " opening failed";
     return false;
   } else {
@@ -79,198 +145,246 @@ bool UdpServer::OpenFile(const std::string &file_name) {
   }
 }
 
-void UdpServer::StartFileTransfer() {
-  LOG(INFO) << "Starting the file_ transfer ";
-
-  file_.seekg(0, std::ios::end); // 将文件流 file_ 定位到文件末尾
-  file_length_ = file_.tellg(); // 获取当前文件指针的位置，即文件的大小
-  file_.seekg(0, std::ios::beg); // 将文件流 file_ 的文件指针重新定位到文件开头
-
-  send();
+bool UdpServer::OpenBundle(const std::string &directory) {
+  LOG(INFO) << "Opening bundle " << request_name_ << " in " << directory;
+  if (!pre_shared_key_.empty() && !cipher_) {
+    LOG(WARNING) << "Refusing unencrypted request";
+    return false;
+  }
+  bundle_ = Bundle::Open(directory, request_name_);
+  return bundle_ != nullptr;
 }
 
-void UdpServer::SendError() {
-  std::string error("FILE NOT FOUND");
-  sendto(sockfd_, error.c_str(), error.size(), 0,
-         (struct sockaddr *)&cli_address_, sizeof(cli_address_));
+void UdpServer::StartFileTransfer() {
+  BeginFileTransfer();
+  send();
+  EndFileTransfer();
 }
 
-void UdpServer::send() {
-  LOG(INFO) << "Entering Send()";
-
-  int sent_count = 1;
-  int sent_count_limit = 1;
+void UdpServer::BeginFileTransfer() {
+  LOG(INFO) << "Starting the file_ transfer ";
 
-  struct timeval process_start_time;
-  struct timeval process_end_time;
-  // struct timeval：这是一个结构体，用于存储时间值，通常在 C 和 C++ 中用于精确地表示时间点或时间间隔
-  // process_start_time 和 process_end_time：这是两个 struct timeval 类型的变量，用来存储程序开始和结束的时间
-  gettimeofday(&process_start_time, NULL);
-  //gettimeofday：这是一个 POSIX 标准中定义的函数，用于获取当前时间。
-  //第一个参数 &process_start_time 是一个指向 struct timeval 结构体的指针，gettimeofday 函数会将当前的时间信息填充到这个结构体中。
-  //第二个参数 NULL 是一个指向时区信息的指针，如果不需要获取时区信息，可以传入 NULL。
+  if (bundle_) {
+    // 归档流不支持续传
+    file_length_ = static_cast<int>(bundle_->length());
+    resume_offset_ = 0;
+  } else {
+    file_length_ = file_->length();
+  }
+  if (resume_offset_ > file_length_) {
+    LOG(WARNING) << "Resume offset " << resume_offset_ << " beyond file length "
+                 << file_length_ << ", sending the whole file";
+    resume_offset_ = 0;
+  }
+  file_length_ -= resume_offset_;
+  // 续传时摘要只覆盖本次发送的部分，不需要再读一遍已有的前缀
+  content_length_ = file_length_;
+  if (send_digest_) {
+    digest_ = FileDigest();
+    digested_until_ = 0;
+    file_length_ += DIGEST_LENGTH;
+  }
+  // 从初始窗口开始慢启动。初始阈值取接收窗口而不是固定值：发送量本来就受 rwnd_ 限制，
+  // 这样 cwnd_ 不会在慢启动中虚涨到远超在途数据，丢包后减半的结果仍有意义
+  cwnd_ = std::max(initial_window_, 1);
+  ssthresh_ = std::max(rwnd_, cwnd_);
+  apply_path_metrics();
+
+  // 应答与第一个窗口的数据一起发出，客户端不需要额外等待一个 RTT
+  if (is_handshake_) {
+    send_handshake_response(true);
+  }
+  if (transport_->fd() >= 0) {
+    // 收发缓冲区随窗口增长（见 fill_window），并统计内核丢弃的 ACK
+    socket_buffers_ = std::make_unique<SocketBufferManager>(transport_->fd());
+    socket_buffers_->EnableDropCounting();
+    if (low_latency_.enabled) {
+      EnableBusyPoll(transport_->fd(), low_latency_.busy_poll_us);
+    }
+    if (use_io_uring_) {
+      io_uring_ = IoUringBackend::Create(transport_->fd(), packet_size_,
+                                         IO_URING_SEND_SLOTS);
+    }
+  }
 
+  transfer_start_us_ = clock_->NowMicros();
+  if (scheduler_ != nullptr) {
+    scheduler_->Add(this, transmit_options_);
+  }
   if (sliding_window_->last_packet_sent_ == -1) {
     start_byte_ = 0;
   }
+  consecutive_timeouts_ = 0;
+}
 
-  while (start_byte_ <= file_length_) {
-    fd_set rfds;
-    struct timeval tv;
-    int res;
-
-    sent_count = 1;
-    sent_count_limit = std::min(rwnd_, cwnd_); 
-    // sent_count_limit 是接收窗口和拥塞窗口的较小值，确保发送的数据包数量既不会超过接收方的接收能力，也不会导致网络拥塞
-
-    LOG(INFO) << "SEND START  !!!!";
-    LOG(INFO) << "Before the window rwnd_: " << rwnd_ << " cwnd_: " << cwnd_
-              << " window used: "
-              << sliding_window_->last_packet_sent_ - sliding_window_->last_acked_packet_; //已发送但尚未确认的数据包数量
-
-    while (sliding_window_->last_packet_sent_ - sliding_window_->last_acked_packet_ <=std::min(rwnd_, cwnd_) 
-          && sent_count <= sent_count_limit) { // sent_count <= sent_count_limit：确保发送次数不超过设定的限制
-      send_packet(start_byte_ + initial_seq_number_, start_byte_);
-
-      if (is_slow_start_) {
-        // LOG(INFO) << "Window In SLOW START Window";
-        packet_statistics_->slow_start_packet_sent_count_++;
-      } else if (is_cong_avd_) { // 拥塞避免
-        // LOG(INFO) << "Window In CONG AVD Window";
-        packet_statistics_->cong_avd_packet_sent_count_++;
-      }
-
-      // break
-      start_byte_ = start_byte_ + MAX_DATA_SIZE;
-      if (start_byte_ > file_length_) {
-        LOG(INFO) << "No more data left to be sent";
-        break;
-      }
-      sent_count++;
-    }
-
-    LOG(INFO) << "SEND END !!!!!";
+bool UdpServer::Step(int64_t now_us) {
+  read_acks(true);
+  return advance(now_us);
+}
 
-    // socket listen whith timeout
-    FD_ZERO(&rfds);  // 将文件描述符集合 rfds 清空，确保在使用之前没有任何文件描述符被设置
-    FD_SET(sockfd_, &rfds); //将 sockfd_ 对应的文件描述符添加到 rfds 文件描述符集合中
-    // 这两行代码通常用于准备使用 select 函数来进行文件描述符的多路复用。在调用 select 前，需要清空并设置待检查的文件描述符集合
+int64_t UdpServer::NextTimeoutUs() {
+  int64_t deadline = retransmit_deadline_us();
+  int64_t probe = probe_deadline_us();
+  if (probe != 0) {
+    return probe;
+  }
+  return deadline != 0 ? deadline : clock_->NowMicros() + MAX_ACK_WAIT_US;
+}
 
-    tv.tv_sec = (int64_t)smoothed_timeout_ / 1000000;
-    tv.tv_usec = smoothed_timeout_ - tv.tv_sec;
-    // 这段代码用于设置 select 函数的超时时间。select 函数用于等待文件描述符集合中的一个或多个文件描述符变为可读、可写或异常，或者超时
-    // tv 结构体指定了等待的最长时间，当超时时间达到或者有事件发生时，select 函数会返回。
+bool UdpServer::advance(int64_t now_us) {
+  // 所有数据都发出且全部被确认后才结束；客户端已经离开时连续超时达到上限则放弃
+  if (start_byte_ > file_length_ &&
+      sliding_window_->last_acked_packet_ >= sliding_window_->last_packet_sent_) {
+    return false;
+  }
+  if (consecutive_timeouts_ >= MAX_CONSECUTIVE_TIMEOUTS) {
+    LOG(WARNING) << "Giving up after " << consecutive_timeouts_
+                 << " consecutive timeouts";
+    return false;
+  }
 
-    LOG(INFO) << "SELECT START:" << smoothed_timeout_ << "!!!";
+  // 窗口有空位就立即补满，不再等整个窗口被确认
+  fill_window();
 
-    while (true) {
-      res = select(sockfd_ + 1, &rfds, NULL, NULL, &tv); // select监听
-      if (res == -1) {
-        LOG(ERROR) << "Error in select";
-      } else if (res > 0) {  // ACK available event
-        wait_for_ack();
+  int64_t probe = probe_deadline_us();
+  if (probe != 0 && now_us >= probe) {
+    send_probe();
+  }
+  int64_t deadline = retransmit_deadline_us();
+  if (deadline != 0 && now_us >= deadline) {
+    on_timeout();
+  }
+  return true;
+}
 
-        if (cwnd_ >= ssthresh_) {
-          //慢启动---->拥塞避免
-          LOG(INFO) << "CHANGE TO CONG AVD";
-          is_cong_avd_ = true;
-          is_slow_start_ = false;
+void UdpServer::SendError() {
+  if (is_handshake_) {
+    send_handshake_response(false);
+    return;
+  }
+  std::string error("FILE NOT FOUND");
+  transport_->SendTo(error.c_str(), error.size(), cli_address_);
+}
 
-          cwnd_ = 1;
-          ssthresh_ = 64;
-        }
+void UdpServer::send() {
+  LOG(INFO) << "Entering Send()";
 
-        if (sliding_window_->last_acked_packet_ == sliding_window_->last_packet_sent_) { // 检查是否所有已发送的数据包都已经收到了确认
-          if (is_slow_start_) {
-            cwnd_ = cwnd_ * 2;
-          } else {
-            cwnd_ = cwnd_ + 1;
-          }
-          break;
-        }
-      } else {
-        // 拥塞发生--超时重传
-        LOG(INFO) << "Timeout occurred SELECT::" << smoothed_timeout_;
-        // LOG(INFO) << "CHANGE TO SLOW START";
-        ssthresh_ = cwnd_ / 2;
-        if (ssthresh_ < 1) {
-          ssthresh_ = 1;
-        }
-        cwnd_ = 1;
+  // io_uring 后端在同一个环上完成发送与 ACK 接收，低时延模式或没有真实套接字时
+  // 本线程直接接收 ACK，两者都由本线程单独驱动；否则启动 ACK 接收线程，本线程只负责发送与状态机
+  std::vector<unsigned char> ack_buffer(MAX_PACKET_SIZE);
+  if (low_latency_.enabled) {
+    PinCurrentThread(low_latency_.cpu);
+  }
+  bool direct = low_latency_.enabled || transport_->fd() < 0;
+  if (!io_uring_ && !direct) {
+    start_ack_thread();
+  }
 
-        // 重新开始慢启动
-        if (is_fast_recovery_) {
-          // LOG(INFO) << "CHANGE TO SLOW START from FastRecovery start_byte_:"
-          //           << start_byte_;
-          is_fast_recovery_ = false; // 如果 is_fast_recovery_ 为真，说明之前处于快速恢复状态，需要将其置为假，表示从快速恢复状态切换回慢启动状态
+  while (advance(clock_->NowMicros())) {
+    int64_t next_us = NextTimeoutUs();
+    if (scheduler_ != nullptr) {
+      scheduler_->Dispatch(clock_->NowMicros());
+      next_us = std::min(next_us, scheduler_->NextDispatchUs());
+    }
+    int64_t wait_us = std::max<int64_t>(next_us - clock_->NowMicros(), 0);
+    if (io_uring_) {
+      // 本轮排队的读取/发送与等待 ACK 合并为一次 io_uring_enter
+      int res = io_uring_->Receive(ack_buffer.data(), ack_buffer.size(), wait_us);
+      while (res > 0) {
+        int advertised_window;
+        int ack_number = parse_ack(ack_buffer.data(), res, &advertised_window);
+        if (ack_number >= 0) {
+          on_ack(ack_number, clock_->NowMicros(), advertised_window);
         }
-        is_slow_start_ = true;
-        is_cong_avd_ = false; // 表示不处于拥塞避免状态
-
-        // retransmit all unacked segments
-        for (int i = sliding_window_->last_acked_packet_ + 1;
-             i <= sliding_window_->last_packet_sent_; i++) {
-          int retransmit_start_byte = 0;
-          if (sliding_window_->last_acked_packet_ != -1) {
-            retransmit_start_byte = sliding_window_->sliding_window_buffers_[sliding_window_->last_acked_packet_].first_byte_ + MAX_DATA_SIZE;
-          }
-          // sliding_window_->sliding_window_buffers_[sliding_window_->last_acked_packet_] 获取最后一个被确认的数据包。 .first_byte_ 是该数据包的第一个字节位置
-          // MAX_DATA_SIZE 是每个数据包的最大数据大小
-
-          LOG(INFO) << "Timeout Retransmit seq number"
-                    << retransmit_start_byte + initial_seq_number_; // 记录要重传的数据包序列号
-          retransmit_segment(retransmit_start_byte);
-          packet_statistics_->retransmit_count_++;
-          LOG(INFO) << "Timeout: retransmission at " << retransmit_start_byte;
+        res = io_uring_->Receive(ack_buffer.data(), ack_buffer.size(), 0);
+      }
+      count_kernel_drops(io_uring_->kernel_drop_count());
+      if (res < 0) {
+        LOG(WARNING) << "io_uring backend failed, falling back to sockets";
+        io_uring_.reset();
+        if (!direct) {
+          start_ack_thread();
         }
-
-        break;
       }
+    } else if (ack_thread_.joinable()) {
+      wait_for_ack(wait_us);
+    } else {
+      poll_for_ack(wait_us);
     }
-    LOG(INFO) << "SELECT END !!!";
-    LOG(INFO) << "current byte ::" << start_byte_ << " file_length_ "
-              << file_length_;
   }
 
-  gettimeofday(&process_end_time, NULL);
+  stop_ack_thread();
+}
 
-  int64_t total_time =
-      (process_end_time.tv_sec * 1000000 + process_end_time.tv_usec) -
-      (process_start_time.tv_sec * 1000000 + process_start_time.tv_usec);
+void UdpServer::EndFileTransfer() {
+  track_congestion_state();
+  if (scheduler_ != nullptr) {
+    scheduler_->Remove(this);
+  }
+  if (io_uring_) {
+    LOG(INFO) << "io_uring: " << io_uring_->submitted_ops() << " ops in "
+              << io_uring_->enter_calls() << " io_uring_enter calls";
+    io_uring_.reset();
+  }
 
-  int total_packet_sent = packet_statistics_->slow_start_packet_sent_count_ +
-                          packet_statistics_->cong_avd_packet_sent_count_;
+  int64_t total_time = clock_->NowMicros() - transfer_start_us_;
+  record_path_metrics(total_time);
+  int64_t slow_start_sent = packet_statistics_->slow_start_packet_sent_count_.Value();
+  int64_t cong_avd_sent = packet_statistics_->cong_avd_packet_sent_count_.Value();
+  int64_t total_packet_sent = slow_start_sent + cong_avd_sent;
   LOG(INFO) << "\n";
   LOG(INFO) << "========================================";
   LOG(INFO) << "Total Time: " << (float)total_time / pow(10, 6) << " secs";
-  LOG(INFO) << "Statistics: 拥塞控制--慢启动: "
-            << packet_statistics_->slow_start_packet_sent_count_
-            << " 拥塞控制--拥塞避免: "
-            << packet_statistics_->cong_avd_packet_sent_count_;
+  LOG(INFO) << "Statistics: 拥塞控制--慢启动: " << slow_start_sent
+            << " 拥塞控制--拥塞避免: " << cong_avd_sent;
   LOG(INFO) << "Statistics: Slow start: "
-            << ((float)packet_statistics_->slow_start_packet_sent_count_ /
-                total_packet_sent) * 100 << "% CongAvd: "
-            << ((float)packet_statistics_->cong_avd_packet_sent_count_ /
-                total_packet_sent) * 100 << "%";
+            << ((float)slow_start_sent / total_packet_sent) * 100 << "% CongAvd: "
+            << ((float)cong_avd_sent / total_packet_sent) * 100 << "%";
   LOG(INFO) << "Statistics: Retransmissions: "
-            << packet_statistics_->retransmit_count_;
+            << packet_statistics_->retransmit_count_.Value() << " ("
+            << packet_statistics_->retransmit_bytes_.Value() << " bytes), timeouts: "
+            << packet_statistics_->timeouts_.Value() << " (spurious "
+            << packet_statistics_->spurious_timeouts_.Value() << ")";
+  LOG(INFO) << "Statistics: RTT p50/p99: "
+            << packet_statistics_->rtt_us_.Percentile(50) << "/"
+            << packet_statistics_->rtt_us_.Percentile(99) << " us, ACK gap p50/p99: "
+            << packet_statistics_->inter_ack_gap_us_.Percentile(50) << "/"
+            << packet_statistics_->inter_ack_gap_us_.Percentile(99) << " us";
+  LOG(INFO) << "Statistics: kernel drops: "
+            << packet_statistics_->kernel_drops_.Value() << ", socket buffers rcv/snd: "
+            << (socket_buffers_ ? socket_buffers_->receive_buffer_bytes() : 0) << "/"
+            << (socket_buffers_ ? socket_buffers_->send_buffer_bytes() : 0) << " bytes";
+  LOG(INFO) << "Statistics: time in slow start/cong avd/fast recovery: "
+            << packet_statistics_->slow_start_time_us_.Value() << "/"
+            << packet_statistics_->cong_avd_time_us_.Value() << "/"
+            << packet_statistics_->fast_recovery_time_us_.Value() << " us";
+  if (cipher_) {
+    LOG(INFO) << "Encrypted segments: " << cipher_->sealed_segments_.Value();
+  }
+  if (send_digest_) {
+    LOG(INFO) << "Digest: " << std::hex << digest_.Value() << std::dec << " over "
+              << digested_until_ << " bytes";
+  }
+  FileCache &cache = FileCache::Instance();
+  LOG(INFO) << "File cache: hits/misses/prefetched/evictions: "
+            << cache.hits_.Value() << "/" << cache.misses_.Value() << "/"
+            << cache.prefetched_chunks_.Value() << "/"
+            << cache.evictions_.Value() << " cached bytes "
+            << cache.cached_bytes();
   LOG(INFO) << "========================================";
 }
 
 void UdpServer::send_packet(int seq_number, int start_byte) {
   bool lastPacket = false;
   int dataLength = 0;
-  if (file_length_ <= start_byte + MAX_DATA_SIZE) { // 判断是否为最后一个数据包
-    LOG(INFO) << "Last packet to be sent !!!";
+  if (file_length_ <= start_byte + data_size_) { // 判断是否为最后一个数据包
     dataLength = file_length_ - start_byte;
     lastPacket = true;
   } else {
-    dataLength = MAX_DATA_SIZE;
+    dataLength = data_size_;
   }
 
-  struct timeval time;
-
-  gettimeofday(&time, NULL);
+  struct timeval time = to_timeval(clock_->NowMicros());
 
   if (sliding_window_->last_packet_sent_ != -1 &&
       start_byte < sliding_window_->sliding_window_buffers_[sliding_window_->last_packet_sent_].first_byte_) {  
@@ -289,8 +403,6 @@ void UdpServer::send_packet(int seq_number, int start_byte) {
     slidingWindowBuffer.first_byte_ = start_byte;
     slidingWindowBuffer.data_length_ = dataLength;
     slidingWindowBuffer.seq_num_ = initial_seq_number_ + start_byte;
-    struct timeval time;
-    gettimeofday(&time, NULL);
     slidingWindowBuffer.time_sent_ = time;
     sliding_window_->last_packet_sent_ =
         sliding_window_->AddToBuffer(slidingWindowBuffer);
@@ -298,91 +410,491 @@ void UdpServer::send_packet(int seq_number, int start_byte) {
   read_file_and_send(lastPacket, start_byte, start_byte + dataLength);
 }
 
-void UdpServer::wait_for_ack() { 
+void UdpServer::start_ack_thread() {
+  event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  receiving_.store(true);
+  ack_thread_ = std::thread(&UdpServer::ack_receive_loop, this);
+}
+
+void UdpServer::stop_ack_thread() {
+  if (!ack_thread_.joinable()) {
+    return;
+  }
+  receiving_.store(false);
+  ack_thread_.join();
+  close(event_fd_);
+  event_fd_ = -1;
+}
+
+void UdpServer::ack_receive_loop() {
+  struct pollfd pfd;
+  pfd.fd = transport_->fd();
+  pfd.events = POLLIN;
+
+  while (receiving_.load(std::memory_order_relaxed)) {
+    // 定期醒来检查是否需要退出
+    if (poll(&pfd, 1, ACK_THREAD_POLL_MS) <= 0) {
+      continue;
+    }
+    read_acks(false);
+  }
+}
+
+int UdpServer::read_acks(bool direct) {
   unsigned char buffer[MAX_PACKET_SIZE];
-  memset(buffer, 0, MAX_PACKET_SIZE);
-  socklen_t addr_size;
-  struct sockaddr_in client_address;
-  addr_size = sizeof(client_address);
-  int n = 0;
-  int ack_number;
+  alignas(struct cmsghdr) char control[DROP_COUNT_CONTROL_SIZE];
+  struct iovec iov;
+  iov.iov_base = buffer;
+  iov.iov_len = sizeof(buffer);
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  int acks = 0;
+  while (true) {
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    int n = transport_->ReceiveMessage(&message, MSG_DONTWAIT);
+    if (n <= 0) {
+      break;
+    }
+    // 丢包计数只在读取套接字的线程中更新
+    uint32_t drop_count;
+    if (SocketBufferManager::ReadDropCount(&message, &drop_count)) {
+      count_kernel_drops(drop_count);
+    }
+    int advertised_window;
+    int ack_number = parse_ack(buffer, n, &advertised_window);
+    if (ack_number < 0) {
+      continue;
+    }
+    acks++;
+    AckEvent event{ack_number, clock_->NowMicros(), advertised_window};
+    if (direct) {
+      on_ack(event.ack_number, event.arrival_us, event.advertised_window);
+      continue;
+    }
+    while (!ack_queue_.Push(event)) {
+      std::this_thread::yield();
+    }
+    // 只有发送线程在等待时才需要通过 eventfd 唤醒，避免每个 ACK 一次系统调用
+    if (sender_waiting_.exchange(false)) {
+      uint64_t one = 1;
+      ssize_t written = write(event_fd_, &one, sizeof(one));
+      (void)written;
+    }
+  }
+  return acks;
+}
 
-  // 接收数据包直到成功为止
-  while ((n = recvfrom(sockfd_, buffer, MAX_PACKET_SIZE, 0,
-                       (struct sockaddr *)&client_address, &addr_size)) <= 0) {
-  };
+void UdpServer::poll_for_ack(int64_t timeout_us) {
+  if (read_acks(true) > 0) {
+    return;
+  }
+  int fd = transport_->fd();
+  if (SpinUntilReadable(fd, std::min(timeout_us, low_latency_.spin_budget_us)) ||
+      WaitReadable(fd, timeout_us) > 0) {
+    read_acks(true);
+  }
+}
+
+void UdpServer::wait_for_ack(int64_t timeout_us) {
+  AckEvent event;
+  // ACK 往往紧接着到达，先短暂自旋，避免每个 ACK 都经历一次 eventfd 睡眠/唤醒；
+  // 单核时自旋只会占用接收线程的 CPU，因此跳过
+  static const int64_t spin_us =
+      std::thread::hardware_concurrency() > 1 ? ACK_SPIN_US : 0;
+  int64_t spin_until = clock_->NowMicros() + std::min(spin_us, timeout_us);
+  while (ack_queue_.Empty() && clock_->NowMicros() < spin_until) {
+  }
+  if (ack_queue_.Empty()) {
+    sender_waiting_.store(true);
+    // 置位之后再检查一次，避免错过接收线程在置位之前放入的 ACK
+    if (ack_queue_.Empty()) {
+      struct pollfd pfd;
+      pfd.fd = event_fd_;
+      pfd.events = POLLIN;
+      int timeout_ms = static_cast<int>((timeout_us + 999) / 1000);
+      if (poll(&pfd, 1, timeout_ms) > 0) {
+        uint64_t value;
+        ssize_t n = read(event_fd_, &value, sizeof(value));
+        (void)n;
+      }
+    }
+    sender_waiting_.store(false);
+  }
+  while (ack_queue_.Pop(&event)) {
+    on_ack(event.ack_number, event.arrival_us, event.advertised_window);
+  }
+}
+
+int UdpServer::parse_ack(unsigned char *buffer, int n, int *advertised_window) {
+  *advertised_window = 0;
+  // 握手应答丢失时客户端会重发请求，此时重发应答；迟到的探测报文直接忽略
+  uint32_t magic = PeekMagic(reinterpret_cast<char *>(buffer), n);
+  if (magic == HANDSHAKE_REQUEST_MAGIC) {
+    if (is_handshake_) {
+      transport_->SendTo(handshake_response_.data(), handshake_response_.size(),
+                         cli_address_);
+    }
+    return -1;
+  } else if (magic == MTU_PROBE_MAGIC) {
+    return -1;
+  }
 
   // 反序列化接收到的数据包到 DataSegment 结构
   DataSegment ack_segment;
   ack_segment.DeserializeToDataSegment(buffer, n);
+  if (ack_segment.length_ >= ACK_WINDOW_LENGTH) {
+    int32_t window;
+    memcpy(&window, ack_segment.data_, sizeof(window));
+    *advertised_window = std::max(window, 0);
+  }
+  free(ack_segment.data_);
+  if (!ack_segment.ack_flag_) {
+    return -1;
+  }
+  packet_statistics_->OnAckArrival();
+  return ack_segment.ack_number_;
+}
 
-  // LOG(INFO) << "ACK Received: ack_number " << ack_segment->ack_number_;
-  SlidWinBuffer last_packet_acked_buffer =
-      sliding_window_->sliding_window_buffers_[sliding_window_->last_acked_packet_]; 
-  //  从滑动窗口缓冲区中获取最后一个确认的数据包缓冲区
-
-  if (ack_segment.ack_flag_) { // 确认接收到的数据包是一个 ACK 包
-    if (ack_segment.ack_number_ == sliding_window_->send_base_) { // 如果 ACK 号等于 send_base_，表示重复 ACK，增加重复 ACK 计数
-      LOG(INFO) << "DUP ACK Received: ack_number: " << ack_segment.ack_number_;
-      sliding_window_->dup_ack_++;
-      // 快速重传
-      if (sliding_window_->dup_ack_ == 3) {
-        packet_statistics_->retransmit_count_++;
-        LOG(INFO) << "Fast Retransmit seq_number: " << ack_segment.ack_number_;
-        retransmit_segment(ack_segment.ack_number_ - initial_seq_number_);
-        sliding_window_->dup_ack_ = 0;
-        if (cwnd_ > 1) {
-          cwnd_ = cwnd_ / 2;
-        }
-        ssthresh_ = cwnd_;
-        is_fast_recovery_ = true;
-        // LOG(INFO) << "Change to fast Recovery ack_segment->ack_number:"
-        //           << ack_segment->ack_number_;
+void UdpServer::count_kernel_drops(uint32_t cumulative) {
+  if (!socket_buffers_) {
+    return;
+  }
+  int64_t dropped = socket_buffers_->OnDropCount(cumulative);
+  if (dropped > 0) {
+    packet_statistics_->kernel_drops_.Add(dropped);
+  }
+}
+
+void UdpServer::on_ack(int ack_number, int64_t arrival_us, int advertised_window) {
+  if (advertised_window > 0) {
+    peer_window_ = advertised_window;
+  }
+  if (ack_number == sliding_window_->send_base_) { // 如果 ACK 号等于 send_base_，表示重复 ACK，增加重复 ACK 计数
+    if (sliding_window_->last_acked_packet_ == sliding_window_->last_packet_sent_) {
+      return;  // 没有未确认的数据，重复的最终 ACK
+    }
+    probe_timer_us_ = arrival_us;
+    probe_sent_ = false;
+    sliding_window_->dup_ack_++;
+    packet_statistics_->dup_acks_++;
+    SAFE_UDP_TRACE(DUP_ACK, ack_number, sliding_window_->dup_ack_);
+    if (ignore_dup_acks_ > 0) {
+      ignore_dup_acks_--;
+      sliding_window_->dup_ack_--;
+      return;
+    }
+    if (frto_step_ > 0) {
+      // 重复 ACK 说明超时前的空洞确实丢失，回到常规的超时恢复；
+      // F-RTO 第二步发出新分段时跳过了对空洞的重传，这里补上
+      bool skipped_hole = frto_step_ == 2;
+      frto_step_ = 0;
+      if (skipped_hole) {
+        retransmit_hole();
       }
-      // 如果接收到三个重复 ACK，则触发快速重传机制，重传该数据段，并更新拥塞窗口 cwnd_ 和慢启动阈值 ssthresh_，进入快速恢复状态
-
-    } else if (ack_segment.ack_number_ > sliding_window_->send_base_) {
-      if (is_fast_recovery_) { // 快恢复
-        // LOG(INFO) << "Change to Cong Avoidance from fast recovery recv ack:"
-        //           << ack_segment->ack_number_;
-        cwnd_++;
-        is_fast_recovery_ = false;
-        is_cong_avd_ = true; // 拥塞状态
-        is_slow_start_ = false;
+    }
+    // 重复 ACK 说明接收端收到了之后发出的分段，空洞超时未确认时不必凑满三个重复 ACK
+    // 就快速重传（小窗口凑不齐），恢复期间也能发现重传再次丢失，不必等待有下限的 RTO
+    bool overdue = hole_overdue(arrival_us);
+    // 快速重传：同一个丢失只触发一次，快速恢复期间的重复 ACK 不再减半窗口
+    if ((sliding_window_->dup_ack_ == 3 || overdue) && !is_fast_recovery_) {
+      retransmit_hole();
+      if (cwnd_ > 1) {
+        cwnd_ = cwnd_ / 2;
       }
-      // 如果 ACK 号大于 send_base_，则表示接收到新的 ACK。如果当前处于快速恢复状态，则更新窗口和状态。
-
-      sliding_window_->dup_ack_ = 0; // 清零
-      sliding_window_->send_base_ = ack_segment.ack_number_;
-      // 当接收到新的 ACK 包时，清除重复 ACK 计数，并将 send_base_ 更新为最新的 ACK 号
+      ssthresh_ = cwnd_;
+      cwnd_acked_ = 0;
+      recover_ = sliding_window_->last_packet_sent_;
+      is_fast_recovery_ = true;
+      SAFE_UDP_TRACE(CWND_CHANGE, cwnd_, ssthresh_);
+      track_congestion_state();
+    } else if (overdue && sliding_window_->last_acked_packet_ < recover_) {
+      retransmit_hole();
+    }
+    return;
+  }
+  if (ack_number < sliding_window_->send_base_) {
+    return;  // 乱序到达的旧 ACK
+  }
 
-      // 如果 last_acked_packet_ 为 -1（表示没有已确认的包），则将其初始化为 0，并获取第一个已确认的包的缓冲区信息
-      if (sliding_window_->last_acked_packet_ == -1) { 
-        sliding_window_->last_acked_packet_ = 0;
-        last_packet_acked_buffer = sliding_window_->sliding_window_buffers_[sliding_window_->last_acked_packet_];
+  // 新的 ACK：推进 last_acked_packet_ 到该 ACK 覆盖的最后一个分段
+  SAFE_UDP_TRACE(ACK_RECEIVED, ack_number, cwnd_);
+  sliding_window_->dup_ack_ = 0;
+  packet_statistics_->delivered_bytes_.Add(
+      ack_number - std::max(sliding_window_->send_base_, initial_seq_number_));
+  sliding_window_->send_base_ = ack_number;
+
+  // Karn 算法：恢复期间确认的分段可能经历过重传，或在接收端等待空洞被填补，不作为 RTT 样本
+  bool in_recovery = sliding_window_->last_acked_packet_ < recover_;
+  int newly_acked = 0;
+  const std::vector<SlidWinBuffer> &buffers = sliding_window_->sliding_window_buffers_;
+  while (sliding_window_->last_acked_packet_ < sliding_window_->last_packet_sent_) {
+    const SlidWinBuffer &next = buffers[sliding_window_->last_acked_packet_ + 1];
+    if (next.seq_num_ + next.data_length_ > ack_number) {
+      break;
+    }
+    sliding_window_->last_acked_packet_++;
+    newly_acked++;
+  }
+  if (newly_acked == 0) {
+    return;
+  }
+  consecutive_timeouts_ = 0;
+  probe_timer_us_ = arrival_us;
+  probe_sent_ = false;
+  // 有新数据被确认时重启重传定时器，全部确认后停止
+  rto_timer_us_ = sliding_window_->last_acked_packet_ < sliding_window_->last_packet_sent_
+                      ? arrival_us
+                      : 0;
+  if (frto_step_ == 2) {
+    // 超时后的第二个新 ACK 仍在推进：超时之前发出的分段陆续到达，超时是伪超时
+    frto_step_ = 0;
+    undo_timeout();
+    if (sliding_window_->last_acked_packet_ >= recover_) {
+      return;  // 窗口已恢复到超时之前，这次确认不再增长窗口
+    }
+  } else if (frto_step_ == 1) {
+    frto_step_ = 0;
+    if (sliding_window_->last_acked_packet_ < recover_ && start_byte_ <= file_length_) {
+      // 第一个新 ACK 没有确认全部在途数据：先发两个新分段而不是重传下一个空洞，
+      // 由下一个 ACK 判断超时是否为伪超时
+      frto_step_ = 2;
+      for (int i = 0; i < 2 && start_byte_ <= file_length_; i++) {
+        send_next_segment();
       }
+      return;
+    }
+  }
 
-      ack_number = last_packet_acked_buffer.seq_num_ +
-                   last_packet_acked_buffer.data_length_; // 计算当前已确认包的 ACK 号，该值为包的序列号加上包的数据长度
+  const SlidWinBuffer &last_acked =
+      buffers[sliding_window_->last_acked_packet_];
+  int64_t sent_us = static_cast<int64_t>(last_acked.time_sent_.tv_sec) * 1000000 +
+                    last_acked.time_sent_.tv_usec;
+  struct timeval start_time = last_acked.time_sent_;
+  struct timeval end_time;
+  end_time.tv_sec = arrival_us / 1000000;
+  end_time.tv_usec = arrival_us % 1000000;
+  if (!in_recovery && arrival_us >= sent_us) {
+    calculate_rtt_and_time(start_time, end_time);
+  }
 
-      while (ack_number < ack_segment.ack_number_) {
-        sliding_window_->last_acked_packet_++;
-        last_packet_acked_buffer = sliding_window_->sliding_window_buffers_[sliding_window_->last_acked_packet_];
-        ack_number = last_packet_acked_buffer.seq_num_ + last_packet_acked_buffer.data_length_;
-      }
-      // 如果计算的 ack_number 小于接收到的 ACK 包的 ACK 号，则更新 last_acked_packet_，
-      // 并获取下一个已确认包的缓冲区信息，直到 ack_number 大于或等于接收到的 ACK 号
+  bool all_recovered = sliding_window_->last_acked_packet_ >= recover_;
+  if (!all_recovered) {
+    // 部分确认（NewReno）：同一窗口里还有丢失，立即重传下一个空洞，不必等超时。
+    // 空洞可能只是乱序或在伪超时后仍在路上，未超时的由之后的重复 ACK 判断
+    if (hole_overdue(arrival_us)) {
+      retransmit_hole();
+    }
+    return;
+  }
+  if (is_fast_recovery_) { // 快恢复
+    is_fast_recovery_ = false;
+    is_cong_avd_ = true; // 拥塞状态
+    is_slow_start_ = false;
+    cwnd_ = std::max(ssthresh_, 1);
+    track_congestion_state();
+  } else if (is_slow_start_) {
+    // 慢启动：每确认一个分段窗口加一
+    cwnd_ += newly_acked;
+    if (cwnd_ >= ssthresh_) {
+      //慢启动---->拥塞避免
+      is_cong_avd_ = true;
+      is_slow_start_ = false;
+      cwnd_acked_ = 0;
+      track_congestion_state();
+    }
+  } else {
+    // 拥塞避免：每确认一个窗口的数据窗口加一
+    cwnd_acked_ += newly_acked;
+    if (cwnd_acked_ >= cwnd_) {
+      cwnd_acked_ -= cwnd_;
+      cwnd_++;
+    }
+  }
+  SAFE_UDP_TRACE(CWND_CHANGE, cwnd_, ssthresh_);
+}
+
+void UdpServer::on_timeout() {
+  // 拥塞发生--超时重传
+  SAFE_UDP_TRACE(TIMEOUT, static_cast<int64_t>(smoothed_timeout_), cwnd_);
+  packet_statistics_->timeouts_++;
+  consecutive_timeouts_++;
+  // 每次超时都做 F-RTO 检测（接收端停顿时会连续超时），撤销时恢复到第一次超时之前
+  frto_step_ = 1;
+  if (consecutive_timeouts_ == 1) {
+    undo_cwnd_ = cwnd_;
+    undo_ssthresh_ = ssthresh_;
+    undo_recover_ = recover_;
+    undo_fast_recovery_ = is_fast_recovery_;
+  }
+  timeout_copies_ = consecutive_timeouts_;
+  rto_backoff_ = std::min(rto_backoff_ + 1, MAX_RTO_BACKOFF);
+  ssthresh_ = cwnd_ / 2;
+  if (ssthresh_ < 1) {
+    ssthresh_ = 1;
+  }
+  cwnd_ = 1;
+  cwnd_acked_ = 0;
+  SAFE_UDP_TRACE(CWND_CHANGE, cwnd_, ssthresh_);
 
-      struct timeval startTime = last_packet_acked_buffer.time_sent_;
-      struct timeval endTime;
-      gettimeofday(&endTime, NULL);
+  // 重新开始慢启动
+  is_fast_recovery_ = false;
+  is_slow_start_ = true;
+  is_cong_avd_ = false; // 表示不处于拥塞避免状态
+  track_congestion_state();
+
+  // 只重传第一个未确认的分段，之后的空洞由部分确认逐个补齐
+  recover_ = sliding_window_->last_packet_sent_;
+  rto_timer_us_ = clock_->NowMicros();
+  int retransmit_start_byte =
+      sliding_window_->sliding_window_buffers_[sliding_window_->last_acked_packet_ + 1]
+          .first_byte_;
+  SAFE_UDP_TRACE(RETRANSMIT, retransmit_start_byte + initial_seq_number_,
+                 0); // 记录要重传的数据包序列号
+  retransmit_segment(retransmit_start_byte);
+  packet_statistics_->retransmit_count_++;
+}
+
+bool UdpServer::hole_overdue(int64_t now_us) {
+  const SlidWinBuffer &hole =
+      sliding_window_->sliding_window_buffers_[sliding_window_->last_acked_packet_ + 1];
+  int64_t sent_us = static_cast<int64_t>(hole.time_sent_.tv_sec) * 1000000 +
+                    hole.time_sent_.tv_usec;
+  return now_us - sent_us > smoothed_timeout_ + smoothed_rtt_ / 4;
+}
 
-      // LOG(INFO) << "seq num of last_acked "
-      //           << last_packet_acked_buffer.seq_num_;
-      calculate_rtt_and_time(startTime, endTime);
+void UdpServer::retransmit_hole() {
+  const SlidWinBuffer &hole =
+      sliding_window_->sliding_window_buffers_[sliding_window_->last_acked_packet_ + 1];
+  packet_statistics_->retransmit_count_++;
+  SAFE_UDP_TRACE(RETRANSMIT, hole.seq_num_, 1);
+  retransmit_segment(hole.first_byte_);
+}
+
+void UdpServer::undo_timeout() {
+  packet_statistics_->spurious_timeouts_++;
+  ignore_dup_acks_ = timeout_copies_;
+  cwnd_ = undo_cwnd_;
+  ssthresh_ = undo_ssthresh_;
+  recover_ = undo_recover_;
+  cwnd_acked_ = 0;
+  rto_backoff_ = 0;
+  is_fast_recovery_ = undo_fast_recovery_;
+  is_slow_start_ = !is_fast_recovery_ && cwnd_ < ssthresh_;
+  is_cong_avd_ = !is_fast_recovery_ && !is_slow_start_;
+  SAFE_UDP_TRACE(CWND_CHANGE, cwnd_, ssthresh_);
+  track_congestion_state();
+}
+
+int64_t UdpServer::retransmit_deadline_us() {
+  if (sliding_window_->last_acked_packet_ >= sliding_window_->last_packet_sent_) {
+    return 0;
+  }
+  // RTO = max(SRTT + 4 * RTTVAR, 下限)，从定时器最近一次重启算起；
+  // 超时后指数退避，直到得到新的 RTT 样本（RFC 6298 5.7）。恢复期间的 ACK 不产生样本，
+  // 若在新 ACK 到达时就撤销退避，初始 RTO 小于路径 RTT 时每个窗口都会伪超时
+  int64_t timeout = std::min(
+      std::max<int64_t>(static_cast<int64_t>(smoothed_timeout_), MIN_RETRANSMIT_TIMEOUT_US)
+          << rto_backoff_,
+      MAX_RETRANSMIT_TIMEOUT_US);
+  return rto_timer_us_ + timeout;
+}
+
+int64_t UdpServer::probe_deadline_us() {
+  int64_t deadline = retransmit_deadline_us();
+  // 超时恢复（含 F-RTO 检测）期间不探测
+  if (deadline == 0 || probe_sent_ || consecutive_timeouts_ > 0 || frto_step_ > 0) {
+    return 0;
+  }
+  int64_t probe = probe_timer_us_ + std::max<int64_t>(static_cast<int64_t>(2 * smoothed_rtt_),
+                                                     MIN_PROBE_TIMEOUT_US);
+  return probe < deadline ? probe : 0;
+}
+
+void UdpServer::send_probe() {
+  probe_sent_ = true;
+  if (start_byte_ <= file_length_ &&
+      sliding_window_->last_packet_sent_ - sliding_window_->last_acked_packet_ < rwnd_) {
+    send_next_segment();
+    return;
+  }
+  packet_statistics_->retransmit_count_++;
+  const SlidWinBuffer &last =
+      sliding_window_->sliding_window_buffers_[sliding_window_->last_packet_sent_];
+  SAFE_UDP_TRACE(RETRANSMIT, last.seq_num_, 2);
+  retransmit_segment(last.first_byte_);
+}
+
+int UdpServer::send_window() {
+  // 每个重复 ACK 表示有一个分段离开了网络，可以多发一个分段：即有限传输（RFC 3042）
+  // 与快速恢复中的窗口膨胀（RFC 5681）。否则小窗口凑不齐三个重复 ACK，
+  // 恢复期间也没有新分段维持 ACK 时钟，丢包只能等待 RTO
+  int window = std::min(rwnd_, cwnd_ + sliding_window_->dup_ack_);
+  if (peer_window_ > 0) {
+    // 客户端通告的窗口在其接收缓冲区溢出之前就收缩，先于丢包限制发送
+    window = std::min(window, peer_window_);
+  }
+  return window;
+}
+
+bool UdpServer::can_send_segment(int window) {
+  return start_byte_ <= file_length_ &&
+         sliding_window_->last_packet_sent_ - sliding_window_->last_acked_packet_ < window;
+}
+
+void UdpServer::send_next_segment() {
+  if (sliding_window_->last_acked_packet_ >= sliding_window_->last_packet_sent_) {
+    // 没有在途数据时由这个分段启动定时器
+    rto_timer_us_ = clock_->NowMicros();
+    probe_timer_us_ = rto_timer_us_;
+  }
+  send_packet(start_byte_ + initial_seq_number_, start_byte_);
+
+  if (is_slow_start_) {
+    packet_statistics_->slow_start_packet_sent_count_++;
+  } else {
+    packet_statistics_->cong_avd_packet_sent_count_++;
+  }
+  start_byte_ = start_byte_ + data_size_;
+}
+
+int UdpServer::NextSegmentBytes() {
+  if (!can_send_segment(send_window())) {
+    return 0;
+  }
+  return std::min(data_size_, file_length_ - start_byte_) + packet_size_ - data_size_;
+}
+
+void UdpServer::TransmitSegment() {
+  send_next_segment();
+}
+
+void UdpServer::fill_window() {
+  // 缓冲区按可能在途的数据量调整，ACK 的突发也落在同一个套接字上
+  if (socket_buffers_) {
+    socket_buffers_->Resize(std::min(rwnd_, cwnd_), packet_size_);
+  }
+  int window = send_window();
+  if (scheduler_ != nullptr) {
+    // 由调度器决定何时发送，这里只登记有分段可发
+    if (can_send_segment(window)) {
+      scheduler_->Activate(this);
+    }
+  } else {
+    while (can_send_segment(window)) {
+      send_next_segment();
     }
-    // LOG(INFO) << "sliding_window_->lastAckedPacket"
-    //           << sliding_window_->last_acked_packet_;
+  }
+  // 预读到下一个窗口的末尾；只在越过已预读位置时才提交，避免每个 ACK 都加锁
+  int64_t prefetch_end =
+      static_cast<int64_t>(start_byte_) + static_cast<int64_t>(window + 1) * data_size_;
+  prefetch_end = std::min<int64_t>(prefetch_end, content_length_);
+  if (file_ && start_byte_ < content_length_ && prefetch_end > prefetched_until_) {
+    int64_t from = std::max<int64_t>(start_byte_, prefetched_until_);
+    file_->Prefetch(resume_offset_ + from, prefetch_end - from);
+    prefetched_until_ = prefetch_end + FILE_CACHE_CHUNK_SIZE;
   }
 }
 
@@ -393,33 +905,100 @@ void UdpServer::calculate_rtt_and_time(struct timeval start_time,
   }
   long sample_rtt = (end_time.tv_sec * 1000000 + end_time.tv_usec) -
                     (start_time.tv_sec * 1000000 + start_time.tv_usec); 
+  rto_backoff_ = 0;
   // 计算从 start_time 到 end_time 的样本往返时延（RTT），单位为微秒
 
-  smoothed_rtt_ = smoothed_rtt_ + 0.125 * (sample_rtt - smoothed_rtt_);
-  // 平滑的往返时延，通过加权平均来更新，以减少抖动
+  if (!has_rtt_sample_) {
+    // 第一个样本（RFC 6298）：SRTT = R，RTTVAR = R / 2
+    has_rtt_sample_ = true;
+    smoothed_rtt_ = sample_rtt;
+    dev_rtt_ = sample_rtt / 2.0;
+  } else {
+    smoothed_rtt_ = smoothed_rtt_ + 0.125 * (sample_rtt - smoothed_rtt_);
+    // 平滑的往返时延，通过加权平均来更新，以减少抖动
 
-  dev_rtt_ = 0.75 * dev_rtt_ + 0.25 * (abs(smoothed_rtt_ - sample_rtt));
+    dev_rtt_ = 0.75 * dev_rtt_ + 0.25 * (abs(smoothed_rtt_ - sample_rtt));
+  }
   smoothed_timeout_ = smoothed_rtt_ + 4 * dev_rtt_;
+  SAFE_UDP_TRACE(RTT_SAMPLE, sample_rtt, static_cast<int64_t>(smoothed_rtt_));
+  packet_statistics_->rtt_us_.Record(sample_rtt);
   // 根据平滑RTT和RTT偏差计算的平滑超时时间。通常情况下，超时时间应该考虑网络传输的不确定性，平滑超时时间可以更好地适应网络环境的变化
+}
 
-  if (smoothed_timeout_ > 1000000) {
-    smoothed_timeout_ = rand() % 30000;
+void UdpServer::retransmit_segment(int index_number) {
+  // 分段按 data_size_ 连续切分，下标可以直接算出
+  int index = index_number / data_size_;
+  if (index > sliding_window_->last_packet_sent_ ||
+      sliding_window_->sliding_window_buffers_[index].first_byte_ != index_number) {
+    LOG(WARNING) << "Retransmit request for unknown byte " << index_number;
+    return;
   }
+  // 记录下数据段的重传时间
+  sliding_window_->sliding_window_buffers_[index].time_sent_ =
+      to_timeval(clock_->NowMicros());
+
+  packet_statistics_->retransmit_bytes_.Add(
+      std::min(data_size_, file_length_ - index_number));
+  read_file_and_send(false, index_number, index_number + data_size_);
 }
 
-void UdpServer::retransmit_segment(int index_number) {
-  for (int i = sliding_window_->last_acked_packet_ + 1;
-       i < sliding_window_->last_packet_sent_; i++) {
-    if (sliding_window_->sliding_window_buffers_[i].first_byte_ == index_number) {
-      struct timeval time;
-      gettimeofday(&time, NULL); // 获取当前时间戳，记录下数据段的重传时间
-      sliding_window_->sliding_window_buffers_[i].time_sent_ = time;
-      // 更新找到的数据段的 time_sent_ 属性为当前时间戳 time
-      break;
-    }
+void UdpServer::track_congestion_state() {
+  if (is_fast_recovery_) {
+    packet_statistics_->EnterState(CongestionState::FAST_RECOVERY);
+  } else if (is_cong_avd_) {
+    packet_statistics_->EnterState(CongestionState::CONG_AVOIDANCE);
+  } else {
+    packet_statistics_->EnterState(CongestionState::SLOW_START);
   }
+}
 
-  read_file_and_send(false, index_number, index_number + MAX_DATA_SIZE);
+void UdpServer::apply_path_metrics() {
+  PathMetrics metrics;
+  if (path_metrics_ == nullptr ||
+      !path_metrics_->Lookup(cli_address_.sin_addr, &metrics)) {
+    return;
+  }
+  if (!has_rtt_sample_ && metrics.smoothed_rtt_us > 0) {
+    // 客户端给出的 RTT 提示优先，没有时使用上次会话的估计
+    has_rtt_sample_ = true;
+    smoothed_rtt_ = metrics.smoothed_rtt_us;
+    dev_rtt_ = metrics.rtt_variance_us;
+    smoothed_timeout_ = smoothed_rtt_ + 4 * dev_rtt_;
+  }
+  // 上次结束时的阈值可能因个别随机丢包降得很低，不低于初始窗口
+  if (metrics.ssthresh > 0) {
+    ssthresh_ = std::max(cwnd_, std::min(metrics.ssthresh, ssthresh_));
+  }
+  // 初始窗口取上次带宽时延积的一半：平滑 RTT 含排队时延，整窗突发容易打满浅队列。
+  // 不超过慢启动阈值，也不小于默认初始窗口
+  if (metrics.bandwidth_bps > 0) {
+    double bdp_bytes = metrics.bandwidth_bps / 8.0 * smoothed_rtt_ / 1e6;
+    int segments = static_cast<int>(std::min<double>(bdp_bytes / 2 / data_size_, INT32_MAX));
+    cwnd_ = std::max(cwnd_, std::min(segments, ssthresh_));
+  }
+  LOG(INFO) << "Using cached path metrics: srtt " << smoothed_rtt_ << " us, ssthresh "
+            << ssthresh_ << ", bandwidth " << metrics.bandwidth_bps
+            << " bps, initial window " << cwnd_;
+}
+
+void UdpServer::record_path_metrics(int64_t total_time_us) {
+  // 放弃的传输（客户端消失）得到的估计没有意义
+  bool completed = start_byte_ > file_length_ &&
+                   sliding_window_->last_acked_packet_ >= sliding_window_->last_packet_sent_;
+  if (path_metrics_ == nullptr || !has_rtt_sample_ || !completed) {
+    return;
+  }
+  PathMetrics metrics;
+  metrics.smoothed_rtt_us = static_cast<int64_t>(smoothed_rtt_);
+  metrics.rtt_variance_us = static_cast<int64_t>(dev_rtt_);
+  // 没有发生拥塞时记录达到的窗口，之后的会话可以直接从这里开始
+  bool congested = packet_statistics_->retransmit_count_.Value() > 0;
+  metrics.ssthresh = congested ? ssthresh_ : cwnd_;
+  // 小文件的吞吐偏低（包含慢启动与握手），只会让之后的初始窗口更保守
+  if (total_time_us > 0) {
+    metrics.bandwidth_bps = static_cast<int64_t>(file_length_ * 8e6 / total_time_us);
+  }
+  path_metrics_->Update(cli_address_.sin_addr, metrics);
 }
 
 void UdpServer::read_file_and_send(bool fin_flag, int start_byte,
@@ -429,15 +1008,61 @@ void UdpServer::read_file_and_send(bool fin_flag, int start_byte,
     datalength = file_length_ - start_byte;
     fin_flag = true;
   }
-  char *fileData = reinterpret_cast<char *>(calloc(datalength, sizeof(char)));
-  if (!file_.is_open()) {
+  if (!file_ && !bundle_) {
     LOG(ERROR) << "File open failed !!!";
     return;
   }
 
-  // read txt
-  file_.seekg(start_byte); // 将文件流 file_ 的读取位置（文件指针）移动到 start_byte 字节处
-  file_.read(fileData, datalength); // 从当前文件指针位置开始读取数据，并存储到 fileData 数组中
+  DataSegment header;
+  header.seq_number_ = start_byte + initial_seq_number_;
+  // 加密时 ack_number_ 为发送计数，与序号一起组成 nonce，同一分段的重传也不会重复
+  header.ack_number_ = cipher_ ? static_cast<int>(transmit_count_++) : 0;
+  header.ack_flag_ = false;
+  header.fin_flag_ = fin_flag;
+  header.length_ = datalength;
+  int tag_length = cipher_ ? GCM_TAG_LENGTH : 0;
+
+  if (io_uring_) {
+    char *packet = io_uring_->AcquireSendBuffer();
+    if (packet != nullptr) {
+      header.SerializeHeader(packet);
+      // 摘要与加密要求第一次发送的数据经过用户态，未加密时重传的部分仍可由内核读取
+      if (bundle_ || cipher_ || FileCache::Instance().capacity() > 0 ||
+          (send_digest_ && end_byte > digested_until_)) {
+        read_data(start_byte, datalength, packet + HEADER_LENGTH);
+        if (cipher_) {
+          seal_segment(packet, datalength);
+        }
+        io_uring_->QueueSend(packet, HEADER_LENGTH + datalength + tag_length, cli_address_);
+      } else {
+        // 未启用缓存时由内核把文件读入已注册的缓冲区，并链式发送
+        io_uring_->QueueFileReadAndSend(packet, HEADER_LENGTH, file_->fd(),
+                                        resume_offset_ + start_byte, datalength,
+                                        cli_address_);
+      }
+      SAFE_UDP_TRACE(PACKET_SENT, header.seq_number_, datalength);
+      packet_statistics_->bytes_sent_.Add(datalength);
+      return;
+    }
+  }
+
+  if (cipher_) {
+    // 头部、密文与 tag 在同一个缓冲区中原地生成
+    send_buffer_.resize(HEADER_LENGTH + datalength + tag_length);
+    header.SerializeHeader(send_buffer_.data());
+    read_data(start_byte, datalength, send_buffer_.data() + HEADER_LENGTH);
+    if (seal_segment(send_buffer_.data(), datalength)) {
+      transport_->SendTo(send_buffer_.data(), send_buffer_.size(), cli_address_);
+    }
+    SAFE_UDP_TRACE(PACKET_SENT, header.seq_number_, datalength);
+    packet_statistics_->bytes_sent_.Add(datalength);
+    return;
+  }
+
+  char *fileData = reinterpret_cast<char *>(calloc(datalength, sizeof(char)));
+
+  // 从共享缓存读取，未命中时才访问文件
+  read_data(start_byte, datalength, fileData);
 
   DataSegment *data_segment = new DataSegment();
   data_segment->seq_number_ = start_byte + initial_seq_number_;
@@ -448,31 +1073,189 @@ void UdpServer::read_file_and_send(bool fin_flag, int start_byte,
   data_segment->data_ = fileData;
 
   send_data_segment(data_segment);
-  LOG(INFO) << "Packet sent:seq number: " << data_segment->seq_number_;
+  SAFE_UDP_TRACE(PACKET_SENT, data_segment->seq_number_, datalength);
+  packet_statistics_->bytes_sent_.Add(datalength);
 
   free(fileData);
   free(data_segment);
 }
 
+bool UdpServer::seal_segment(char *packet, int data_length) {
+  if (cipher_->Seal(packet, data_length)) {
+    return true;
+  }
+  // 不能把明文发出去：清空负载，客户端校验失败后按丢包处理
+  LOG(ERROR) << "Failed to encrypt segment";
+  memset(packet + HEADER_LENGTH, 0, data_length + GCM_TAG_LENGTH);
+  return false;
+}
+
+void UdpServer::read_data(int start_byte, int length, char *buffer) {
+  int content = std::max(std::min(length, content_length_ - start_byte), 0);
+  if (content > 0 && bundle_) {
+    bundle_->Read(start_byte, content, buffer);
+  } else if (content > 0) {
+    file_->Read(resume_offset_ + start_byte, content, buffer);
+  }
+  if (!send_digest_) {
+    return;
+  }
+  // 新数据总是按序第一次发送，重传的部分已经计入
+  if (start_byte <= digested_until_ && digested_until_ < start_byte + content) {
+    digest_.Update(buffer + (digested_until_ - start_byte),
+                   start_byte + content - digested_until_);
+    digested_until_ = start_byte + content;
+    if (digested_until_ == content_length_) {
+      digest_.Serialize(digest_bytes_);
+    }
+  }
+  if (content < length) {
+    // 摘要紧跟在内容之后，可能跨越最后两个分段
+    if (content_length_ == 0) {
+      digest_.Serialize(digest_bytes_);
+    }
+    int from = start_byte + content - content_length_;
+    memcpy(buffer + content, digest_bytes_ + from,
+           std::min(length - content, DIGEST_LENGTH - from));
+  }
+}
+
 char *UdpServer::GetRequest(int client_sockfd) {
+  if (!transport_) {
+    // 未经 StartServer/UseTransport 时直接在调用者提供的套接字上收发，不接管其关闭
+    transport_ = std::make_unique<SocketTransport>(client_sockfd);
+  }
+  // 接收缓冲区需要能容纳最大的 MTU 探测报文
+  std::vector<char> recv_buffer(MAX_NEGOTIABLE_PACKET_SIZE + 1);
+  struct sockaddr_in client_address;
+  struct iovec iov;
+  iov.iov_base = recv_buffer.data();
+  iov.iov_len = MAX_NEGOTIABLE_PACKET_SIZE;
+  struct msghdr message;
+  int n = 0;
+
+  while (true) {
+    memset(&message, 0, sizeof(message));
+    message.msg_name = &client_address;
+    message.msg_namelen = sizeof(client_address);
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    n = transport_->ReceiveMessage(&message, 0);                                       // recvmsg
+    if (n <= 0) {
+      continue;
+    }
+    cli_address_ = client_address;
+
+    MtuProbe probe;
+    if (probe.Deserialize(recv_buffer.data(), n)) {
+      if (!probe.is_ack_) {
+        answer_mtu_probe(probe);
+      }
+      continue; // 探测阶段结束后客户端才会发送真正的请求
+    }
+    break;
+  }
+
   char *buffer =
       reinterpret_cast<char *>(calloc(MAX_PACKET_SIZE, sizeof(char))); // calloc 函数用于分配一块大小为 MAX_PACKET_SIZE 字节的内存，并将其初始化为零
-  struct sockaddr_in client_address;
-  socklen_t addr_size;
-  memset(buffer, 0, MAX_PACKET_SIZE); // 使用 memset 将 buffer 置零，确保缓冲区没有残留数据
-  addr_size = sizeof(client_address);
-  recvfrom(client_sockfd, buffer, MAX_PACKET_SIZE, 0,                    
-           (struct sockaddr *)&client_address, &addr_size);                   // recvfrom
+  HandshakeRequest request;
+  if (request.Deserialize(recv_buffer.data(), n)) {
+    negotiate(request);
+    bundle_request_ = request.bundle_;
+    send_digest_ = request.digest_;
+    request_name_ = request.file_name_;
+    strncpy(buffer, request.file_name_.c_str(), MAX_PACKET_SIZE - 1);
+  } else {
+    // 旧客户端：请求内容就是文件名，使用默认分段大小
+    memcpy(buffer, recv_buffer.data(), std::min(n, MAX_PACKET_SIZE - 1));
+  }
 
   LOG(INFO) << "***Request received is: " << buffer;
-  cli_address_ = client_address;
   return buffer;
 }
 
+void UdpServer::negotiate(const HandshakeRequest &request) {
+  is_handshake_ = true;
+  packet_size_ = std::max(MAX_PACKET_SIZE,
+                          std::min<int>(request.packet_size_, max_packet_size_));
+  packet_size_ = std::min(packet_size_, MAX_NEGOTIABLE_PACKET_SIZE);
+  data_size_ = packet_size_ - HEADER_LENGTH;
+  cipher_.reset();
+  if (!pre_shared_key_.empty() && request.encrypt_ && EncryptionAvailable()) {
+    key_nonce_ = NewKeyNonce();
+    cipher_ = SegmentCipher::Create(pre_shared_key_, request.key_nonce_, key_nonce_);
+    transmit_count_ = 0;
+  }
+  if (cipher_) {
+    // tag 放在数据之后，数据报仍不超过协商的分段大小
+    data_size_ -= GCM_TAG_LENGTH;
+  }
+  if (request.receive_window_ > 0) {
+    rwnd_ = std::min<int>(rwnd_, request.receive_window_);
+  }
+  resume_offset_ = static_cast<int>(std::min<uint32_t>(request.resume_offset_, INT32_MAX));
+  if (request.rtt_hint_us_ > 0) {
+    // 提示按第一个 RTT 样本处理（不计入 RTT 统计），初始窗口不必等保守的初始 RTO
+    has_rtt_sample_ = true;
+    smoothed_rtt_ = request.rtt_hint_us_;
+    dev_rtt_ = smoothed_rtt_ / 2;
+    smoothed_timeout_ = smoothed_rtt_ + 4 * dev_rtt_;
+  }
+  if (request.congestion_control_ != CONGESTION_CONTROL_NEWRENO) {
+    LOG(WARNING) << "Unsupported congestion control "
+                 << static_cast<int>(request.congestion_control_)
+                 << ", using NewReno";
+  }
+  congestion_control_ = CONGESTION_CONTROL_NEWRENO;
+  // 随机初始序号：旧报文或其他会话的报文不会被当作本次传输的数据确认。
+  // 序号为 int，留出 2GB 文件的空间
+  std::random_device random;
+  initial_seq_number_ = 1 + random() % MAX_INITIAL_SEQ_NUMBER;
+  if (packet_size_ > MAX_PACKET_SIZE && transport_->fd() >= 0) {
+    // 超过默认大小的分段已经过探测验证，禁止内核分片
+    PathMtuDiscovery::EnableProbeMode(transport_->fd());
+  }
+  LOG(INFO) << "Negotiated packet size: " << packet_size_
+            << " (requested " << request.packet_size_ << "), window " << rwnd_
+            << ", resume offset " << resume_offset_ << ", rtt hint "
+            << request.rtt_hint_us_ << " us";
+}
+
+void UdpServer::send_handshake_response(bool file_found) {
+  HandshakeResponse response;
+  response.packet_size_ = packet_size_;
+  response.file_length_ = file_found ? resume_offset_ + content_length_ : 0;
+  response.file_found_ = file_found;
+  response.initial_seq_number_ = initial_seq_number_;
+  response.resume_offset_ = file_found ? resume_offset_ : 0;
+  response.initial_window_ = cwnd_;
+  response.congestion_control_ = congestion_control_;
+  response.bundle_ = bundle_ != nullptr;
+  response.digest_ = send_digest_;
+  response.encrypted_ = cipher_ != nullptr;
+  response.key_nonce_ = key_nonce_;
+  handshake_response_ = response.Serialize();
+  transport_->SendTo(handshake_response_.data(), handshake_response_.size(),
+                     cli_address_);
+}
+
+void UdpServer::answer_mtu_probe(const MtuProbe &probe) {
+  // 只有不超过服务端上限的探测才回显，回显报文同样大小以验证反方向路径
+  if (static_cast<int>(probe.probe_size_) > max_packet_size_) {
+    return;
+  }
+  if (transport_->fd() >= 0) {
+    PathMtuDiscovery::EnableProbeMode(transport_->fd());
+  }
+  MtuProbe ack = probe;
+  ack.is_ack_ = true;
+  std::string datagram = ack.Serialize();
+  transport_->SendTo(datagram.data(), datagram.size(), cli_address_);
+}
+
 void UdpServer::send_data_segment(DataSegment *data_segment) {
   char *datagramChars = data_segment->SerializeToCharArray();
-  sendto(sockfd_, datagramChars, MAX_PACKET_SIZE, 0,                        // sendto
-         (struct sockaddr *)&cli_address_, sizeof(cli_address_));
+  transport_->SendTo(datagramChars, data_segment->PacketSize(), cli_address_);          // sendto
   free(datagramChars);
 }
 }  // namespace safe_udp
@@ -2,17 +2,65 @@
 
 #include <netinet/in.h>
 #include <unistd.h>
-#include <fstream>
+#include <atomic>
 #include <iostream>
 #include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
+#include "bundle.h"
+#include "clock.h"
 #include "data_segment.h"
+#include "file_cache.h"
+#include "file_digest.h"
+#include "handshake.h"
+#include "io_uring_backend.h"
+#include "low_latency.h"
 #include "packet_statistics.h"
+#include "path_metrics.h"
+#include "segment_cipher.h"
 #include "sliding_window.h"
+#include "socket_buffer.h"
+#include "spsc_queue.h"
+#include "transmit_scheduler.h"
+#include "transport.h"
 
 namespace safe_udp {
-class UdpServer {
+// 客户端消失后服务端最多等待的连续超时次数（RTO 退避后约 15 秒）
+constexpr int MAX_CONSECUTIVE_TIMEOUTS = 10;
+// RTO 的下限。与 Linux 一样取 200ms（RFC 6298 建议 1 秒）：SRTT + 4 * RTTVAR 在 RTT
+// 很稳定时几乎等于 SRTT，排队抖动或接收端短暂停顿就会伪超时
+constexpr int64_t MIN_RETRANSMIT_TIMEOUT_US = 200000;
+// 指数退避后 RTO 的上限
+constexpr int64_t MAX_RETRANSMIT_TIMEOUT_US = 2000000;
+// 尾部丢包探测（RFC 8985 TLP）的最小等待：2 * SRTT 内没有 ACK 就先发一个探测分段，
+// 引出的重复 ACK 触发快速重传，窗口太小或重传再次丢失时不必等待 RTO
+constexpr int64_t MIN_PROBE_TIMEOUT_US = 2000;
+// 取得第一个 RTT 样本之前的 RTO（RFC 6298）。初始窗口有 10 个分段，
+// 比路径 RTT 短的初始 RTO 会让整个初始窗口伪超时；客户端给出 RTT 提示时不使用
+constexpr int64_t INITIAL_RETRANSMIT_TIMEOUT_US = 1000000;
+// 初始拥塞窗口（分段数），与 RFC 6928 的 IW10 相同
+constexpr int INITIAL_WINDOW = 10;
+// 随机初始序号的上限
+constexpr int MAX_INITIAL_SEQ_NUMBER = 1 << 16;
+// RTO 指数退避的最大次数（最多放大 64 倍）
+constexpr int MAX_RTO_BACKOFF = 6;
+// 没有未确认数据时发送线程单次等待 ACK 的上限
+constexpr int64_t MAX_ACK_WAIT_US = 100000;
+constexpr int ACK_THREAD_POLL_MS = 20;
+// 发送线程在 eventfd 上睡眠前自旋等待 ACK 的时间
+constexpr int64_t ACK_SPIN_US = 50;
+constexpr size_t ACK_QUEUE_SIZE = 4096;
+
+// 接收线程交给发送线程的 ACK
+struct AckEvent {
+  int ack_number;
+  int64_t arrival_us;
+  int advertised_window;  // 客户端通告窗口，旧客户端为 0
+};
+
+class UdpServer : public TransmitSource {
  public:
   UdpServer();
 
@@ -25,15 +73,38 @@ class UdpServer {
     //   free(packet_statistics_);
     // }
 
-    close(sockfd_);
-    file_.close();
+    if (sockfd_ >= 0) {
+      close(sockfd_);
+    }
   }
 
-  char *GetRequest(int client_sockfd); // 获取客户端请求
+  // 获取客户端请求。已调用 StartServer/UseTransport 时 client_sockfd 不再使用，
+  // 否则在该套接字上接收请求并完成之后的传输
+  char *GetRequest(int client_sockfd);
   bool OpenFile(const std::string &file_name); 
+  // 客户端请求的是打包传输时为 true，此时用 OpenBundle 代替 OpenFile
+  bool is_bundle_request() const { return bundle_request_; }
+  // 在 directory（以 / 结尾）下展开请求中的通配符或文件清单
+  bool OpenBundle(const std::string &directory);
   void StartFileTransfer();
   void SendError();
 
+  // 以下接口供模拟器等外部事件循环驱动发送端，StartFileTransfer 即依次调用它们。
+  // 替换收发数据报的方式与时钟，需在 GetRequest 之前调用
+  void UseTransport(std::unique_ptr<Transport> transport, Clock *clock);
+  // 发送握手应答并准备发送状态
+  void BeginFileTransfer();
+  // 处理已到达的 ACK，补满窗口并在到期时重传；传输结束（或放弃）时返回 false
+  bool Step(int64_t now_us);
+  // 下一次需要调用 Step 的时间（重传截止时间）
+  int64_t NextTimeoutUs();
+  // 输出本次传输的统计信息
+  void EndFileTransfer();
+
+  // 使用 scheduler_ 时由调度器调用
+  int NextSegmentBytes() override;
+  void TransmitSegment() override;
+
   int rwnd_; // 接收窗口大小
   int cwnd_; // 拥塞窗口大小
   int ssthresh_;
@@ -41,29 +112,162 @@ class UdpServer {
   bool is_slow_start_;
   bool is_cong_avd_;
   bool is_fast_recovery_;
+  // 服务端允许协商的最大分段大小，默认不协商（MAX_PACKET_SIZE）
+  int max_packet_size_;
+  // 传输开始时的拥塞窗口（分段数），超时后仍从 1 开始
+  int initial_window_;
+  // 按对端缓存的路径参数，默认为进程内共享的缓存，nullptr 表示不使用
+  PathMetricsCache *path_metrics_;
+  // 多个会话共享的发送调度器，nullptr 表示窗口有空位就立即发送。
+  // 新数据按 transmit_options_ 的权重与速率上限经调度器发出，重传不经过调度器
+  TransmitScheduler *scheduler_;
+  TransmitOptions transmit_options_;
+  // 为 true 时尝试使用 io_uring 后端，内核不支持时自动回退
+  bool use_io_uring_;
+  // 预共享密钥（见 segment_cipher.h）。非空时数据段经 AES-128-GCM 加密，
+  // 不带加密请求的客户端被拒绝（OpenFile / OpenBundle 返回 false）
+  std::string pre_shared_key_;
+  // 低时延模式：不启动 ACK 线程，发送线程自己自旋接收 ACK（io_uring 后端优先）
+  LowLatencyConfig low_latency_;
   int StartServer(int port); // 启动服务器
+  PacketStatistics *packet_statistics() { return packet_statistics_.get(); }
 
  private:
   std::unique_ptr<SlidingWindow> sliding_window_;
   std::unique_ptr<PacketStatistics> packet_statistics_;
 
   int sockfd_;
-  std::fstream file_;
+  std::unique_ptr<Transport> transport_;
+  Clock *clock_;
+  int64_t transfer_start_us_;
+  // 来自进程内共享的 FileCache，发送与重传都从内存读取
+  std::shared_ptr<CachedFile> file_;
+  // 打包传输时代替 file_ 提供数据
+  std::unique_ptr<Bundle> bundle_;
+  bool bundle_request_;
+  // 握手请求中完整的文件名（文件清单可能超过 GetRequest 返回的缓冲区）
+  std::string request_name_;
   struct sockaddr_in cli_address_;
   int initial_seq_number_;
+  // 本次传输的长度；发送摘要时包含末尾的 DIGEST_LENGTH 字节
   int file_length_;
+  // 其中属于文件（或归档流）的字节数
+  int content_length_;
   double smoothed_rtt_;
   double dev_rtt_;
   double smoothed_timeout_;
+  bool has_rtt_sample_;
+  // 本次会话协商得到的分段大小及其中的数据部分大小
+  int packet_size_;
+  int data_size_;
+  // 客户端使用握手请求时为 true，旧客户端发送裸文件名
+  bool is_handshake_;
+  // 续传起点：本次传输的字节偏移 0 对应文件中的 resume_offset_，file_length_ 为剩余长度
+  int resume_offset_;
+  uint8_t congestion_control_;
+  // 客户端请求了摘要：新数据第一次发送时按序计入 digest_，
+  // 全部内容发出后摘要作为数据流的最后 DIGEST_LENGTH 字节发送
+  bool send_digest_;
+  FileDigest digest_;
+  int digested_until_;
+  char digest_bytes_[DIGEST_LENGTH];
+  // 加密会话的状态：服务端随机数、密钥以及作为 nonce 一部分的发送计数
+  std::unique_ptr<SegmentCipher> cipher_;
+  std::string key_nonce_;
+  uint32_t transmit_count_;
+  std::vector<char> send_buffer_;
+  std::string handshake_response_;
+  std::unique_ptr<IoUringBackend> io_uring_;
+
+  // 发送端状态机（只在发送线程中访问）
+  int cwnd_acked_;  // 拥塞避免阶段累计确认的分段数，满一个窗口 cwnd_ 加一
+  int recover_;     // 进入恢复时已发送的最后一个分段，确认越过它才算恢复完成
+  int consecutive_timeouts_;
+  int rto_backoff_;  // RTO 当前的退避次数，取得有效 RTT 样本后清零
+  // 重传定时器的起点：有新数据被确认时重启（RFC 6298 5.3），0 表示未启动
+  int64_t rto_timer_us_;
+  // 尾部丢包探测定时器的起点（最近一个 ACK 的到达时间），已发出的探测得到 ACK 之前不再探测
+  int64_t probe_timer_us_;
+  bool probe_sent_;
+  // F-RTO（RFC 5682）伪超时检测：1 表示等待超时后的第一个新 ACK，2 表示已发出两个新分段、
+  // 等待第二个新 ACK，0 表示不在检测中；以及超时前的拥塞状态，判定为伪超时时据此撤销窗口收缩
+  int frto_step_;
+  int undo_cwnd_;
+  int undo_ssthresh_;
+  int undo_recover_;
+  bool undo_fast_recovery_;
+  int timeout_copies_;   // 这一轮连续超时重传的次数
+  int ignore_dup_acks_;  // 伪超时的重传副本到达接收端后各引起一个重复 ACK，不触发快速重传
+  int64_t prefetched_until_;
+  // 客户端最近一次通告的窗口（分段数），0 表示客户端不通告，只受 rwnd_ 限制
+  int peer_window_;
+  std::unique_ptr<SocketBufferManager> socket_buffers_;
+
+  // ACK 接收线程通过无锁队列把 ACK 交给发送线程，发送线程空闲时在 eventfd 上等待
+  std::thread ack_thread_;
+  std::atomic<bool> receiving_;
+  std::atomic<bool> sender_waiting_;
+  int event_fd_;
+  SpscQueue<AckEvent, ACK_QUEUE_SIZE> ack_queue_;
 
   void send();
+  // 推进一次状态机，返回值同 Step
+  bool advance(int64_t now_us);
+  void negotiate(const HandshakeRequest &request);
+  void send_handshake_response(bool file_found);
+  void answer_mtu_probe(const MtuProbe &probe);
 
   void send_packet(int seq_number, int start_byte);
   void calculate_rtt_and_time(struct timeval start_time,
                               struct timeval end_time);
   void retransmit_segment(int index_number);
   void read_file_and_send(bool fin_flag, int start_byte, int end_byte);
+  // 从 file_ 或 bundle_ 读取本次传输中 [start_byte, start_byte + length) 的数据
+  void read_data(int start_byte, int length, char *buffer);
+  // 原地加密已填好头部与数据的分段，失败时清空负载并返回 false
+  bool seal_segment(char *packet, int data_length);
   void send_data_segment(DataSegment *data_segment);
-  void wait_for_ack();
+  void start_ack_thread();
+  void stop_ack_thread();
+  void ack_receive_loop();
+  // 非阻塞地读完套接字中的 ACK：direct 为 true 时直接交给状态机，否则放入 ACK 队列。
+  // 返回读到的 ACK 个数
+  int read_acks(bool direct);
+  // 低时延模式下的等待：先自旋接收，预算用完后以微秒精度等待
+  void poll_for_ack(int64_t timeout_us);
+  // 等待接收线程的 ACK（最多 timeout_us），并交给状态机处理
+  void wait_for_ack(int64_t timeout_us);
+  // 解析客户端数据报并在需要时重发握手应答，返回 ACK 号，不是 ACK 时返回 -1；
+  // advertised_window 为 ACK 携带的通告窗口，未携带时为 0
+  int parse_ack(unsigned char *buffer, int n, int *advertised_window);
+  // 把 recvmsg 控制信息中的累计丢包数计入统计
+  void count_kernel_drops(uint32_t cumulative);
+
+  // 发送端状态机：ACK、超时与补满窗口，可由单个线程依次调用
+  void on_ack(int ack_number, int64_t arrival_us, int advertised_window);
+  void on_timeout();
+  void fill_window();
+  // 当前允许的在途分段数：拥塞窗口、rwnd_ 与客户端通告窗口中最小的一个
+  int send_window();
+  bool can_send_segment(int window);
+  void send_next_segment();
+  // 重传定时器的截止时间，没有未确认数据时返回 0
+  int64_t retransmit_deadline_us();
+  // 尾部丢包探测的截止时间，不需要探测时返回 0
+  int64_t probe_deadline_us();
+  // 发出探测：有新数据且接收窗口允许时发送一个新分段，否则重传最后一个分段
+  void send_probe();
+  // 第一个未确认的分段（空洞）最近一次发出后已超过 SRTT * 5 / 4 + 4 * RTTVAR：
+  // 之后发出的分段已被接收而它仍未被确认，视为丢失（RFC 8985 RACK 的时间判据，
+  // SRTT / 4 为乱序余量）。刚重传过的空洞不算，它的确认可能还在路上
+  bool hole_overdue(int64_t now_us);
+  void retransmit_hole();
+  // 伪超时：恢复超时之前的拥塞窗口、阈值与恢复状态
+  void undo_timeout();
+  void track_congestion_state();
+  // 同一对端有缓存的路径参数时，以其 RTT、慢启动阈值与带宽时延积作为起点
+  void apply_path_metrics();
+  // 传输完成后记录本次会话得到的路径参数
+  void record_path_metrics(int64_t total_time_us);
 };
 }  // namespace safe_udp